@@ -0,0 +1,60 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * App Events
+ * Queue of events from the server and WiFi modules to
+ * the top level state machine, so that it wakes as
+ * soon as something happens rather than polling.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+
+#include "app_events.h"
+
+/* Events are few and consumed promptly. Only the newest matter if nobody is listening. */
+#define APP_EVENTS_LENGTH 8
+
+#define APP_EVENTS_TAG "app_events"
+
+static QueueHandle_t queue;
+static StaticQueue_t queue_buffer;
+static uint8_t queue_storage[APP_EVENTS_LENGTH * sizeof(app_event_t)];
+
+void app_events_init() {
+	if (queue == NULL) {
+		queue = xQueueCreateStatic(APP_EVENTS_LENGTH, sizeof(app_event_t), queue_storage, &queue_buffer);
+	}
+}
+
+esp_err_t app_events_post(app_event_type_t type, int32_t data) {
+	app_event_t event = { .type = type, .data = data };
+	app_event_t dropped;
+
+	if (queue == NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	while (xQueueSend(queue, &event, 0) != pdTRUE) {
+		if (xQueueReceive(queue, &dropped, 0) == pdTRUE) {
+			ESP_LOGW(APP_EVENTS_TAG, "Queue full - dropped event %d", dropped.type);
+		}
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t app_events_wait(app_event_t *event, uint32_t timeout_ms) {
+	TickType_t ticks = (timeout_ms == APP_EVENTS_WAIT_FOREVER) ? portMAX_DELAY : timeout_ms/portTICK_PERIOD_MS;
+
+	if (queue == NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	return (xQueueReceive(queue, event, ticks) == pdTRUE) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
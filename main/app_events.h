@@ -0,0 +1,58 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * App Events
+ * Queue of events from the server and WiFi modules to
+ * the top level state machine, so that it wakes as
+ * soon as something happens rather than polling.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MAIN_APP_EVENTS_H_
+#define MAIN_APP_EVENTS_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Timeout for app_events_wait() that never expires */
+#define APP_EVENTS_WAIT_FOREVER UINT32_MAX
+
+/** Events passed to the state machine */
+typedef enum {
+	APP_EVENT_USER_INFORMED = 0,      /* Portal has told the user the device is connected */
+	APP_EVENT_STA_GOT_IP = 1,         /* Station got an IP address */
+	APP_EVENT_STA_DISCONNECTED = 2    /* Station lost its AP. Data is the disconnect reason. */
+} app_event_type_t;
+
+/** An event and the data that goes with it */
+typedef struct {
+	app_event_type_t type;
+	int32_t data;
+} app_event_t;
+
+/**
+ * @brief Create the event queue. Does nothing if it already exists.
+ */
+void app_events_init();
+
+/**
+ * @brief Post an event. Never blocks. If the queue is full, the oldest event is dropped to make room.
+ * May be called from any task, but not from an ISR.
+ * @param type Type of event
+ * @param data Data for the event. 0 if the type has none.
+ * @return ESP_OK on success. ESP_ERR_INVALID_STATE if the queue has not been created.
+ */
+esp_err_t app_events_post(app_event_type_t type, int32_t data);
+
+/**
+ * @brief Wait for the next event
+ * @param event Output event
+ * @param timeout_ms Longest time to wait. APP_EVENTS_WAIT_FOREVER to wait until an event arrives.
+ * @return ESP_OK on success. ESP_ERR_TIMEOUT if no event arrived in time.
+ */
+esp_err_t app_events_wait(app_event_t *event, uint32_t timeout_ms);
+
+#endif /* MAIN_APP_EVENTS_H_ */
@@ -0,0 +1,44 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Assets
+ * Static files served by the local webserver. The table
+ * itself is generated at build time from the www
+ * directory by tools/gen_assets.py.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <string.h>
+
+#include "assets.h"
+
+const portal_asset_t *find_asset(const char *path, size_t len) {
+	size_t low = 0;
+	size_t high = portal_asset_count;
+
+	// Binary search - the generator sorts the table by path
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		const portal_asset_t *asset = &portal_assets[mid];
+		int cmp = strncmp(asset->path, path, len);
+
+		if (cmp == 0) {
+			// Asset path may be longer than the requested prefix
+			if (asset->path[len] == '\0') {
+				return asset;
+			}
+			cmp = 1;
+		}
+
+		if (cmp < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return NULL;
+}
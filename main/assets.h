@@ -0,0 +1,47 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Assets
+ * Static files served by the local webserver. The table
+ * itself is generated at build time from the www
+ * directory by tools/gen_assets.py.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MAIN_ASSETS_H_
+#define MAIN_ASSETS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** A file embedded in flash */
+typedef struct {
+	const char *path;         /* URI path, e.g. "/network_select.html" */
+	const uint8_t *data;
+	size_t length;
+	const char *mime_type;
+	const char *encoding;     /* Content-Encoding of data, or NULL if stored as-is */
+	const char *etag;         /* Strong ETag, including quotes */
+	const char *slot;         /* Name of the dynamic slot in a template, or NULL if the asset is static */
+	size_t slot_offset;       /* Offset in data at which the slot is rendered */
+	const uint8_t *plain;     /* Uncompressed copy of a gzip asset, for clients that do not accept gzip, or NULL */
+	size_t plain_length;
+	const char *plain_etag;   /* Strong ETag of the uncompressed copy, including quotes */
+} portal_asset_t;
+
+/* Generated table, sorted by path */
+extern const portal_asset_t portal_assets[];
+extern const size_t portal_asset_count;
+
+/**
+ * @brief Find an embedded asset by its URI path.
+ * @param path URI path. Need not be null terminated.
+ * @param len Length of path, excluding any query string
+ * @return Asset, or NULL if no asset has that path
+ */
+const portal_asset_t *find_asset(const char *path, size_t len);
+
+#endif /* MAIN_ASSETS_H_ */
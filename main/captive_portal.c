@@ -13,232 +13,471 @@
 
 #include "captive_portal.h"
 
-#define DNS_LEN 512
-
-#define FLAG_QR (1<<7)
-#define FLAG_AA (1<<2)
-#define FLAG_TC (1<<1) //Truncated
-#define FLAG_RD (1<<0)
-
-#define FLAG_RA (1<<7)
-
-#define QTYPE_A  1
-#define QTYPE_NS 2
-#define QTYPE_CNAME 5
-#define QTYPE_SOA 6
-#define QTYPE_WKS 11
-#define QTYPE_PTR 12
-#define QTYPE_HINFO 13
-#define QTYPE_MINFO 14
-#define QTYPE_MX 15
-#define QTYPE_TXT 16
-#define QTYPE_URI 256
-
-#define QCLASS_IN 1
-#define QCLASS_ANY 255
-#define QCLASS_URI 256
-
-static int sockFd;
-
-// Header for DNS packet
+/* Answer record: name pointer, type, class, TTL, rdlength, IPv4 rdata */
+#define DNS_NAME_POINTER 0xC000
+#define DNS_ANSWER_TTL 10
+#define DNS_ANSWER_LEN 16
+
+/* Authority record for negative answers: root owner, type, class, TTL, rdlength,
+ * root MNAME and RNAME, then serial, refresh, retry, expire and minimum */
+#define DNS_NEGATIVE_TTL 60
+#define DNS_SOA_LEN 33
+
+/* Known OS connectivity-check hosts get a prebuilt reply. The hash index is a
+ * power of two at least twice the number of names. */
+#define DNS_PROBE_NAME_LEN 40
+#define DNS_PROBE_REPLY_LEN (DNS_HEADER_LEN + DNS_PROBE_NAME_LEN + 2*sizeof(uint16_t) + DNS_ANSWER_LEN)
+#define DNS_PROBE_INDEX_SIZE 32
+#define DNS_PROBE_TTL 60
+
+/* Number of qtypes that may be given their own policy */
+#define DNS_POLICY_TABLE_SIZE 8
+
+/* Per-client rate limiting. Each source address gets a token bucket, so a client
+ * that floods the server only exhausts its own reply budget. */
+#define DNS_CLIENT_TABLE_SIZE (2*MAX_STA_CONN)
+#define DNS_BUCKET_CAPACITY 20          // Burst of replies allowed per client
+#define DNS_BUCKET_REFILL_PER_SEC 10    // Sustained replies per second per client
+#define DNS_TOKEN 1000                  // Tokens are held in thousandths
+
+/* Time in which a client earns one token. Lets the refill be worked out in 32 bits, as
+ * 64-bit division is a library call on the ESP32. */
+#define DNS_US_PER_TOKEN (1000000/(DNS_BUCKET_REFILL_PER_SEC*DNS_TOKEN))
+
+/* The task only handles one packet at a time, with its buffers held statically */
+#define CAPTIVE_PORTAL_STACK_SIZE 3072
+#define CAPTIVE_PORTAL_PRIORITY 3
+#define CAPTIVE_PORTAL_STOP_TIMEOUT_MS 1000
+#define CAPTIVE_PORTAL_REAP_POLL_MS 10
+
+#define CAPTIVE_PORTAL_TAG "captive_portal"
+
+static int sockFd = -1;
+static int ctrlFd = -1;
+static uint16_t ctrl_port;
+
+static TaskHandle_t task;
+static StaticTask_t task_buffer;
+static StackType_t task_stack[CAPTIVE_PORTAL_STACK_SIZE];
+static SemaphoreHandle_t stopped;
+static StaticSemaphore_t stopped_buffer;
+static uint32_t stack_high_water_mark;
+
+/* Token bucket for a single client */
 typedef struct {
-	uint16_t id;
-	uint8_t flags;
-	uint8_t rcode;
-	uint16_t qdcount;
-	uint16_t ancount;
-	uint16_t nscount;
-	uint16_t arcount;
-} DnsHeader;
-
-// Type and class information for each DNS query
-typedef struct {
-	uint16_t type;
-	uint16_t class;
-} DnsQuestionFooter;
+	uint32_t addr;          // Source IPv4 address, 0 if entry is free
+	int64_t last_seen;      // Time of last query (us)
+	uint32_t tokens;        // Thousandths of a reply
+	uint32_t served;
+	uint32_t dropped;
+} dns_client_t;
+
+static dns_client_t client_table[DNS_CLIENT_TABLE_SIZE];
+static captive_portal_stats_t stats;
 
-// Header and Footer that make up a DNS query
+/* Per-qtype policy. Types not listed get default_policy. */
 typedef struct {
-	DnsHeader header;
-	DnsQuestionFooter footer;
-} DnsQuery;
+	uint16_t qtype;
+	dns_policy_t policy;
+} dns_policy_entry_t;
+
+static dns_policy_entry_t policy_table[DNS_POLICY_TABLE_SIZE] = {
+		{ .qtype = QTYPE_A,     .policy = DNS_POLICY_ANSWER },
+		{ .qtype = QTYPE_AAAA,  .policy = DNS_POLICY_NODATA },
+		{ .qtype = QTYPE_SVCB,  .policy = DNS_POLICY_NODATA },
+		{ .qtype = QTYPE_HTTPS, .policy = DNS_POLICY_NODATA },
+};
+static int policy_count = 4;
+static dns_policy_t default_policy = DNS_POLICY_NODATA;
 
-// Footer for a DNS reply - followed by rdata
+/*
+ * @brief SOA record sent in the authority section of NODATA and NXDOMAIN replies.
+ * The portal claims to be authoritative for the root zone, so the owner is the root
+ * rather than the name queried. The minimum field sets how long clients cache the
+ * negative answer.
+ */
+static const uint8_t soa_template[DNS_SOA_LEN] = {
+		0,                   // Owner - root
+		0, QTYPE_SOA,
+		0, QCLASS_IN,
+		0, 0, 0, DNS_NEGATIVE_TTL,
+		0, 22,
+		0,                   // MNAME - root
+		0,                   // RNAME - root
+		0, 0, 0, 1,          // Serial
+		0, 0, 0x0E, 0x10,    // Refresh - 3600
+		0, 0, 0x02, 0x58,    // Retry - 600
+		0, 0x01, 0x51, 0x80, // Expire - 86400
+		0, 0, 0, DNS_NEGATIVE_TTL
+};
+
+/* Connectivity-check hosts queried repeatedly while a client is on the portal */
 typedef struct {
-	uint16_t name;
-	uint16_t type;
-	uint16_t class;
+	const char *name;
 	uint32_t ttl;
-	uint16_t rdlength;
-} DnsResponseFooter;
+} dns_probe_name_t;
+
+static const dns_probe_name_t probe_names[] = {
+		{ "captive.apple.com",                 DNS_PROBE_TTL },
+		{ "www.apple.com",                     DNS_PROBE_TTL },
+		{ "connectivitycheck.gstatic.com",     DNS_PROBE_TTL },
+		{ "connectivitycheck.android.com",     DNS_PROBE_TTL },
+		{ "clients3.google.com",               DNS_PROBE_TTL },
+		{ "www.google.com",                    DNS_PROBE_TTL },
+		{ "www.msftconnecttest.com",           DNS_PROBE_TTL },
+		{ "msftconnecttest.com",               DNS_PROBE_TTL },
+		{ "www.msftncsi.com",                  DNS_PROBE_TTL },
+		{ "detectportal.firefox.com",          DNS_PROBE_TTL },
+		{ "nmcheck.gnome.org",                 DNS_PROBE_TTL },
+		{ "connectivity-check.ubuntu.com",     DNS_PROBE_TTL },
+};
+#define DNS_PROBE_NAME_COUNT (sizeof(probe_names)/sizeof(probe_names[0]))
+
+/* Complete reply to a single A question for a probe host. Only the ID and RD bit
+ * are patched in when it is sent. */
+typedef struct {
+	uint16_t name_len;     // Encoded length of the name in the question
+	uint16_t length;       // Length of reply
+	uint8_t reply[DNS_PROBE_REPLY_LEN];
+} dns_probe_reply_t;
+
+static dns_probe_reply_t probe_replies[DNS_PROBE_NAME_COUNT];
+static uint8_t probe_index[DNS_PROBE_INDEX_SIZE];   // probe_replies index + 1, 0 if empty
+static uint64_t probe_lengths;                      // Bit n set if a probe host name encodes to n bytes
 
 /*
- * @brief Function to extract information from a dns query
- * @param data Query received
- * @param length Length of query
- * @param query Output struct with information from received query
- * @param verbose Specifies whether debug information should be printed
- * @return ESP_OK on success
+ * @brief Precomputed answer record appended to every A reply.
+ * Built once when the AP netif is up so that replying to a query only needs
+ * a header patch and a single memcpy.
  */
-esp_err_t get_dns_query_info(char* data, unsigned short length, DnsQuery *query, bool verbose) {
-	int len;
-	char *p = data;
-	// Get Header
-	query->header.id = (int)p[0]*256 + (int)p[1];
-	query->header.flags = p[2];
-	query->header.rcode = p[3];
-	query->header.qdcount = (int)p[4]*256 + (int)p[5];
-	query->header.ancount = (int)p[6]*256 + (int)p[7];
-	query->header.nscount = (int)p[8]*256 + (int)p[9];
-	query->header.arcount = (int)p[10]*256 + (int)p[11];
-
-//	if(verbose) {
-//		printf("--------HEADER--------\n");
-//		printf("ID:      %hu\n", query->header.id);
-//		printf("FLAGS:   %d \n", query->header.flags);
-//		printf("RCODE:   %d \n", query->header.rcode);
-//		printf("QDCOUNT: %hu\n", query->header.qdcount);
-//		printf("ANCOUNT: %hu\n", query->header.ancount);
-//		printf("NSCOUNT: %hu\n", query->header.nscount);
-//		printf("ARCOUNT: %hu\n", query->header.arcount);
-//	}
-
-	if (query->header.ancount || query->header.nscount || query->header.arcount) {
-		printf("This is a reply...");
-		return ESP_FAIL;
-	}
-	if (query->header.flags&FLAG_TC) {
-		printf("Truncated. Can't use this.");
-		return ESP_FAIL;
-	}
+static uint8_t answer_template[DNS_ANSWER_LEN];
 
-//	if(verbose) printf("--------BODY--------\n");
-	p = &p[12];
+/*
+ * @brief Build an A answer record for the current AP IP address
+ * @param out Output record of DNS_ANSWER_LEN bytes
+ * @param ip AP IPv4 address, in network byte order as held by esp_netif
+ * @param ttl Time clients may cache the answer for (s)
+ */
+static void build_answer(uint8_t *out, uint32_t ip, uint32_t ttl) {
+	uint8_t *p = out;
 
-	while(p[0] != 0) {
-		len = (int) p++[0];
-//		for (int i = 0; i < len; i++) {
-//			if(verbose) printf("%c", p[i]);
-//		}
-		p += len;
-//		if(p[0] != 0 && verbose) {
-//			printf(".");
-//		}
+	// Name - compression pointer to the QNAME directly after the header
+	*p++ = DNS_NAME_POINTER >> 8;
+	*p++ = DNS_HEADER_LEN;
 
-	}
-//	if(verbose) printf("\n");
-	p++;
+	*p++ = QTYPE_A >> 8;
+	*p++ = QTYPE_A & 0xFF;
 
-	query->footer.type = (int)p[0]*256 + (int)p[1];
-	query->footer.class = (int)p[2]*256 + (int)p[3];
+	*p++ = QCLASS_IN >> 8;
+	*p++ = QCLASS_IN & 0xFF;
 
-//	if(verbose) {
-//		printf("--------FOOTER--------\n");
-//		printf("QTYPE:   %hu\n", query->footer.type);
-//		printf("QCLASS:  %hu\n", query->footer.class);
-//	}
+	*p++ = (ttl >> 24) & 0xFF;
+	*p++ = (ttl >> 16) & 0xFF;
+	*p++ = (ttl >> 8) & 0xFF;
+	*p++ = ttl & 0xFF;
 
-	return ESP_OK;
+	*p++ = 0;
+	*p++ = sizeof(uint32_t);
 
+	// esp_netif already holds the address in network byte order
+	memcpy(p, &ip, sizeof(uint32_t));
 }
 
 /*
- * @brief Convert a uint32_t IPv4 address to a uint8_t array
- * @param ip The IP to be converted
- * @param footer Array of numbers which make up plaintext IPv4 address
- * @return ESP_OK on success
+ * @brief Read 4 bytes of a name as a word, with the ASCII case bit set
  */
-esp_err_t get_rdata(uint32_t ip, uint8_t *footer) {
+static inline uint32_t get_folded_word(const uint8_t *p) {
+	uint32_t word;
 
-	footer[3] = floor(ip / pow(2, 24));
-	ip -= footer[3] * pow(2, 24);
+	memcpy(&word, p, sizeof(word));
+	return word | 0x20202020u;
+}
 
-	footer[2] = floor(ip / pow(2, 16));
-	ip -= footer[2] * pow(2, 16);
+/*
+ * @brief Hash of an encoded name, ignoring ASCII case. Only the length, the start and the
+ * end of the name before the top-level domain are mixed in, which is enough to tell the probe
+ * hosts apart without touching every byte. Matches are confirmed with names_equal().
+ * @param name Encoded name
+ * @param len Encoded length of name
+ * @return Hash of name
+ */
+static uint32_t hash_name(const uint8_t *name, size_t len) {
+	uint32_t hash = (uint32_t)len * 0x9E3779B1u;
+
+	if (len >= 2*sizeof(uint32_t)) {
+		hash ^= get_folded_word(name) * 0x85EBCA77u;
+		hash = (hash ^ (hash >> 13)) + get_folded_word(&name[len - 2*sizeof(uint32_t)]) * 0xC2B2AE3Du;
+	} else {
+		for (size_t i = 0; i < len; i++) {
+			hash = (hash ^ (name[i] | 0x20)) * 16777619u;
+		}
+	}
 
-	footer[1] = floor(ip / pow(2, 8));
-	ip -= footer[1] * pow(2, 8);
+	return hash ^ (hash >> 16);
+}
 
-	footer[0] = ip;
+/*
+ * @brief Compare two encoded names, ignoring ASCII case
+ */
+static bool names_equal(const uint8_t *a, const uint8_t *b, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		uint8_t x = a[i];
+		uint8_t y = b[i];
+		if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+		if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+		if (x != y) {
+			return false;
+		}
+	}
+	return true;
+}
 
-	return ESP_OK;
+/*
+ * @brief Build the prebuilt reply for every probe host and index them by name hash
+ * @param ip AP IPv4 address, in network byte order as held by esp_netif
+ */
+static void build_probe_replies(uint32_t ip) {
+	memset(probe_index, 0, sizeof(probe_index));
+	probe_lengths = 0;
+
+	for (int i = 0; i < DNS_PROBE_NAME_COUNT; i++) {
+		dns_probe_reply_t *entry = &probe_replies[i];
+		const char *name = probe_names[i].name;
+		uint8_t *p = &entry->reply[DNS_HEADER_LEN];
+
+		// Header - QDCOUNT 1, ANCOUNT 1. ID and flags are patched per query.
+		memset(entry->reply, 0, DNS_HEADER_LEN);
+		entry->reply[5] = 1;
+		entry->reply[7] = 1;
+
+		// Question - encode the name as labels
+		while (*name) {
+			const char *dot = strchr(name, '.');
+			size_t len = dot ? (size_t)(dot - name) : strlen(name);
+
+			*p++ = len;
+			memcpy(p, name, len);
+			p += len;
+			name += len + (dot ? 1 : 0);
+		}
+		*p++ = 0;
+		entry->name_len = p - &entry->reply[DNS_HEADER_LEN];
+		probe_lengths |= 1ULL << entry->name_len;
+
+		*p++ = QTYPE_A >> 8;
+		*p++ = QTYPE_A & 0xFF;
+		*p++ = QCLASS_IN >> 8;
+		*p++ = QCLASS_IN & 0xFF;
+
+		build_answer(p, ip, probe_names[i].ttl);
+		p += DNS_ANSWER_LEN;
+		entry->length = p - entry->reply;
+
+		// Open addressing with linear probing
+		uint32_t slot = hash_name(&entry->reply[DNS_HEADER_LEN], entry->name_len);
+		while (probe_index[slot % DNS_PROBE_INDEX_SIZE] != 0) {
+			slot++;
+		}
+		probe_index[slot % DNS_PROBE_INDEX_SIZE] = i + 1;
+	}
+}
 
+/*
+ * @brief Find the policy for a qtype
+ */
+static dns_policy_t get_policy(uint16_t qtype) {
+	for (int i = 0; i < policy_count; i++) {
+		if (policy_table[i].qtype == qtype) {
+			return policy_table[i].policy;
+		}
+	}
+	return default_policy;
 }
 
 /*
- * @brief convert a 16-bit uint16_t to 2 chars
- * @param from The uint16_t to be converted
- * @param to The char array output
- * @return ESP_OK on success
+ * @brief Find the prebuilt reply for a single A question, if the policy is to answer A questions
+ * @param query Query received
+ * @param view Parsed query
+ * @return Prebuilt reply, or NULL if the name is not a known probe host or A questions are not answered
  */
-esp_err_t copy_uint16(uint16_t from, char *to) {
-	uint8_t num = floor(from / pow(2, 8));
-	to[0] = (char)num;
+static const dns_probe_reply_t *find_probe_reply(const uint8_t *query, const dns_query_view_t *view) {
+	const dns_question_t *question = &view->questions[0];
+
+	if (view->qdcount != 1 || question->type != QTYPE_A || question->class != QCLASS_IN) {
+		return NULL;
+	}
+
+	// The prebuilt replies are answers, so any other policy takes the general path
+	if (get_policy(QTYPE_A) != DNS_POLICY_ANSWER) {
+		return NULL;
+	}
+
+	// Most names are ruled out by their length alone
+	if (question->name_len > DNS_PROBE_NAME_LEN || !(probe_lengths & (1ULL << question->name_len))) {
+		stats.probe_misses++;
+		return NULL;
+	}
 
-	to[1] = (char)from-num*pow(2,8);
+	const uint8_t *name = &query[question->name];
+	uint32_t slot = hash_name(name, question->name_len);
 
+	for (int i = 0; i < DNS_PROBE_INDEX_SIZE; i++, slot++) {
+		uint8_t index = probe_index[slot % DNS_PROBE_INDEX_SIZE];
+		if (index == 0) {
+			break;
+		}
+
+		const dns_probe_reply_t *entry = &probe_replies[index - 1];
+		if (entry->name_len == question->name_len &&
+				names_equal(&entry->reply[DNS_HEADER_LEN], name, question->name_len)) {
+			stats.probe_hits++;
+			return entry;
+		}
+	}
+
+	stats.probe_misses++;
+	return NULL;
+}
+
+esp_err_t captive_portal_set_policy(uint16_t qtype, dns_policy_t policy) {
+	// Only A records can be answered with the AP address
+	if (policy == DNS_POLICY_ANSWER && qtype != QTYPE_A) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	for (int i = 0; i < policy_count; i++) {
+		if (policy_table[i].qtype == qtype) {
+			policy_table[i].policy = policy;
+			return ESP_OK;
+		}
+	}
+	if (policy_count == DNS_POLICY_TABLE_SIZE) {
+		return ESP_ERR_NO_MEM;
+	}
+	policy_table[policy_count].qtype = qtype;
+	policy_table[policy_count].policy = policy;
+	policy_count++;
+
+	return ESP_OK;
+}
+
+esp_err_t captive_portal_set_default_policy(dns_policy_t policy) {
+	if (policy == DNS_POLICY_ANSWER) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	default_policy = policy;
 	return ESP_OK;
 }
 
 /*
- * @brief Alter a received DNS query to form a reply
- * @param header Altered DNS response header
- * @param footer Type and class info from original request
- * @param rdata IPv4 Address to be transmitted as reply
- * @param reply Pointer to beginning of response
- * @param original_length Length of original DNS query
- * @return Length of response
+ * @brief Append a record template to a reply, pointing its name at a question
+ * @param reply Reply being built
+ * @param reply_length Current length of reply. Updated on success.
+ * @param record Record template, starting with a name pointer
+ * @param record_length Length of record template
+ * @param name Offset of question name the record belongs to
+ * @return true if the record fit into the reply
  */
-int alter_query_to_reply(DnsHeader *header, DnsResponseFooter *footer, uint8_t *rdata, char *reply, unsigned short original_length) {
-	char *footer_ptr = &reply[original_length]; // Set pointer to end of query
-	char *header_ptr = reply;
-
-	// Copy over header - ID
-	copy_uint16(header->id, header_ptr);
-	header_ptr += sizeof(uint16_t);
+static bool append_record(uint8_t *reply, size_t *reply_length, const uint8_t *record, size_t record_length, uint16_t name) {
+	uint8_t *p = &reply[*reply_length];
 
-	memcpy(header_ptr, &header->flags, sizeof(uint8_t));
-	header_ptr += sizeof(uint8_t);
+	if (*reply_length + record_length > DNS_LEN) {
+		return false;
+	}
 
-	memcpy(header_ptr, &header->rcode, sizeof(uint8_t));
-	header_ptr += sizeof(uint8_t);
+	memcpy(p, record, record_length);
+	p[0] = (DNS_NAME_POINTER | name) >> 8;
+	p[1] = name & 0xFF;
+	*reply_length += record_length;
 
-	copy_uint16(header->qdcount, header_ptr);
-	header_ptr += sizeof(uint16_t);
+	return true;
+}
 
-	copy_uint16(header->ancount, header_ptr);
-	header_ptr += sizeof(uint16_t);
+/*
+ * @brief Patch the header of a copied query so that it becomes a reply
+ * @param reply Buffer holding a copy of the query
+ * @param rcode Response code
+ * @param ancount Number of answers that follow the question section
+ * @param nscount Number of authority records that follow the answers
+ */
+static void patch_reply_header(uint8_t *reply, uint8_t rcode, uint16_t ancount, uint16_t nscount) {
+	reply[2] |= FLAG_QR | FLAG_AA;
+	reply[3] = FLAG_RA | rcode;
 
-	copy_uint16(header->nscount, header_ptr);
-	header_ptr += sizeof(uint16_t);
+	reply[6] = ancount >> 8;
+	reply[7] = ancount & 0xFF;
 
-	copy_uint16(header->arcount, header_ptr);
-	header_ptr += sizeof(uint16_t);
+	reply[8] = nscount >> 8;
+	reply[9] = nscount & 0xFF;
 
-	// Move rend to beginning of footer
-	copy_uint16(footer->name, footer_ptr);
-	footer_ptr += sizeof(uint16_t);
+	// Any additional records of the query (e.g. EDNS) are not echoed back
+	reply[10] = 0;
+	reply[11] = 0;
+}
 
-	copy_uint16(footer->type, footer_ptr);
-	footer_ptr += sizeof(uint16_t);
+/*
+ * @brief Find the bucket for a client. A new client takes a free entry, or failing that
+ * replaces the least recently seen client.
+ * @param addr Source IPv4 address
+ * @param now Current time (us)
+ * @return Client entry
+ */
+static dns_client_t *get_client(uint32_t addr, int64_t now) {
+	dns_client_t *oldest = &client_table[0];
 
-	copy_uint16(footer->class, footer_ptr);
-	footer_ptr += sizeof(uint16_t);
+	for (int i = 0; i < DNS_CLIENT_TABLE_SIZE; i++) {
+		dns_client_t *client = &client_table[i];
 
-	for (int i = 0; i < 3; i++) {
-		footer_ptr[i] = 0;
+		if (client->addr == addr) {
+			return client;
+		}
+		if (oldest->addr != 0 && (client->addr == 0 || client->last_seen < oldest->last_seen)) {
+			oldest = client;
+		}
 	}
-	footer_ptr[2] = 1;
-	footer_ptr += sizeof(uint32_t);
 
-	copy_uint16(footer->rdlength, footer_ptr);
-	footer_ptr += sizeof(uint16_t);
+	// New client starts with a full bucket
+	memset(oldest, 0, sizeof(dns_client_t));
+	oldest->addr = addr;
+	oldest->last_seen = now;
+	oldest->tokens = DNS_BUCKET_CAPACITY*DNS_TOKEN;
+
+	return oldest;
+}
 
-	// Copy over footer and IP address
-	memcpy(footer_ptr, rdata, 4);
-	footer_ptr += 4;
+/*
+ * @brief Take a token from the bucket of a client
+ * @param addr Source IPv4 address
+ * @return true if the client is within its reply budget
+ */
+static bool client_allowed(uint32_t addr) {
+	int64_t now = esp_timer_get_time();
+	dns_client_t *client = get_client(addr, now);
+
+	// Refill in proportion to the time since the last query. A client quiet for long enough
+	// to fill its bucket needs no arithmetic at all.
+	int64_t elapsed = now - client->last_seen;
+	if (elapsed >= (int64_t)DNS_BUCKET_CAPACITY*DNS_TOKEN*DNS_US_PER_TOKEN) {
+		client->tokens = DNS_BUCKET_CAPACITY*DNS_TOKEN;
+	} else if (elapsed > 0) {
+		uint32_t refill = (uint32_t)elapsed / DNS_US_PER_TOKEN;
+		if (refill > DNS_BUCKET_CAPACITY*DNS_TOKEN - client->tokens) {
+			client->tokens = DNS_BUCKET_CAPACITY*DNS_TOKEN;
+		} else {
+			client->tokens += refill;
+		}
+	}
+	client->last_seen = now;
 
-	return footer_ptr-reply;
+	if (client->tokens < DNS_TOKEN) {
+		client->dropped++;
+		stats.rate_limited++;
+		return false;
+	}
+	client->tokens -= DNS_TOKEN;
+	client->served++;
+
+	return true;
 }
 
 /*
@@ -247,104 +486,268 @@ int alter_query_to_reply(DnsHeader *header, DnsResponseFooter *footer, uint8_t *
  * @param pusrdata Data in query
  * @param length Length of query
  */
-static void captive_portal_recv(struct sockaddr_in *premote_addr, char *pusrdata, unsigned short length) {
-	char reply[DNS_LEN];
-	int transmit_length;
-	DnsQuery query;
-	DnsHeader response_header;
-	DnsResponseFooter response_footer;
-	uint32_t ip_address;
-
-
-	// Sanity Checks
-	if (length > DNS_LEN) {
-		printf("Packet larger than DNS implementation");
+static void captive_portal_recv(struct sockaddr_in *premote_addr, uint8_t *pusrdata, unsigned short length) {
+	static uint8_t reply[DNS_LEN];
+	dns_query_view_t query;
+	size_t reply_length;
+	uint16_t ancount = 0;
+	uint16_t nscount = 0;
+	uint8_t rcode = RCODE_NOERROR;
+	bool negative = false;
+
+	// Drop over-budget clients before doing any work for them
+	if (!client_allowed(premote_addr->sin_addr.s_addr)) {
 		return;
 	}
-	if (length < sizeof(DnsHeader)) {
-		printf("Packet too short");
+
+	esp_err_t err = dns_parse_query(pusrdata, length, &query);
+	if (err != ESP_OK) {
+		ESP_LOGD(CAPTIVE_PORTAL_TAG, "Dropping query: %s", esp_err_to_name(err));
+		stats.malformed++;
 		return;
 	}
 
-	// Response will be same as request with some added data
-	memcpy(reply, pusrdata, length);
-
-	ESP_ERROR_CHECK(get_dns_query_info(pusrdata, length, &query, 1));
+	// Known probe hosts are served with a lookup and a single send
+	const dns_probe_reply_t *probe = find_probe_reply(pusrdata, &query);
+	if (probe != NULL) {
+		memcpy(reply, probe->reply, probe->length);
+		reply[0] = pusrdata[0];
+		reply[1] = pusrdata[1];
+		reply[2] = FLAG_QR | FLAG_AA | (pusrdata[2] & FLAG_RD);
+		reply[3] = FLAG_RA;
+		// Echo the name with the case the client used
+		memcpy(&reply[DNS_HEADER_LEN], &pusrdata[DNS_HEADER_LEN], probe->name_len);
+
+		sendto(sockFd, reply, probe->length, 0, (struct sockaddr *)premote_addr, sizeof(struct sockaddr_in));
+		stats.replies++;
+		return;
+	}
 
-	// Build response header
-	response_header = query.header;
-	response_header.flags |= FLAG_QR;
-	response_header.rcode |= FLAG_RA;
-	response_header.ancount = 1;
+	// Response is the question section of the request followed by the answers
+	reply_length = query.question_end;
+	memcpy(reply, pusrdata, reply_length);
+
+	for (int i = 0; i < query.qdcount; i++) {
+		const dns_question_t *question = &query.questions[i];
+
+		switch (get_policy(question->type)) {
+		case	DNS_POLICY_ANSWER:
+			// This is a request for an IPv4 address - point the answer at its question name
+			if (append_record(reply, &reply_length, answer_template, DNS_ANSWER_LEN, question->name)) {
+				ancount++;
+			}
+			break;
+		case	DNS_POLICY_NXDOMAIN:
+			rcode = RCODE_NXDOMAIN;
+			negative = true;
+			break;
+		case	DNS_POLICY_NODATA:
+			negative = true;
+			break;
+		case	DNS_POLICY_DROP:
+			break;
+		}
+	}
 
-	if (query.footer.type == QTYPE_A) {
-		// This is a request for an IPv4 address
+	if (ancount == 0) {
+		if (!negative) {
+			return;
+		}
+		// Answer immediately with an SOA so the client does not wait for a timeout
+		if (reply_length + DNS_SOA_LEN <= DNS_LEN) {
+			memcpy(&reply[reply_length], soa_template, DNS_SOA_LEN);
+			reply_length += DNS_SOA_LEN;
+			nscount++;
+		}
+	} else {
+		rcode = RCODE_NOERROR;
+	}
 
-		uint8_t rdata[4];
+	patch_reply_header(reply, rcode, ancount, nscount);
 
-		response_footer.name = pow(2, 15) + pow(2, 14) + 12;
-		response_footer.type = QTYPE_A;    // A record
-		response_footer.class = QCLASS_IN; // An internet address
-		response_footer.ttl = 10;
-		response_footer.rdlength = 4;
+	sendto(sockFd, reply, reply_length, 0, (struct sockaddr *)premote_addr, sizeof(struct sockaddr_in));
+	stats.replies++;
+}
 
-		// Get IP address
-		ip_address = get_ap_ip_address();
-		get_rdata(ip_address, rdata);
+/*
+ * @brief Build the replies for the current AP address, and clear the client table and counters
+ */
+static void prepare_replies() {
+	uint32_t ip = get_ap_ip_address();
 
-		transmit_length = alter_query_to_reply(&response_header, &response_footer, rdata, reply, length);
+	build_answer(answer_template, ip, DNS_ANSWER_TTL);
+	build_probe_replies(ip);
+	memset(client_table, 0, sizeof(client_table));
+	memset(&stats, 0, sizeof(stats));
+}
 
-		sendto(sockFd, (uint8_t*)reply, transmit_length, 0, (struct sockaddr *)premote_addr, sizeof(struct sockaddr_in));
+/*
+ * @brief Open a UDP socket bound to an address
+ * @param addr IPv4 address to bind to, in network byte order
+ * @param port Port to bind to, in network byte order. 0 for any port.
+ * @return Socket, or -1 on failure
+ */
+static int open_udp_socket(uint32_t addr, uint16_t port) {
+	struct sockaddr_in bind_addr;
+
+	memset(&bind_addr, 0, sizeof(bind_addr));
+	bind_addr.sin_family = AF_INET;
+	bind_addr.sin_addr.s_addr = addr;
+	bind_addr.sin_port = port;
+	bind_addr.sin_len = sizeof(bind_addr);
+
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	if (bind(fd, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) != 0) {
+		close(fd);
+		return -1;
 	}
 
+	return fd;
 }
 
 /*
- * @brief Captive portal task to be run
+ * @brief Captive portal task to be run.
+ * Waits on both the DNS socket and the control socket, so that a stop request
+ * wakes the task immediately.
  */
 static void captive_portal_task(void *pvParameters) {
-	struct sockaddr_in server_addr;
-	uint32_t ret;
+	static uint8_t udp_msg[DNS_LEN];
 	struct sockaddr_in from;
 	socklen_t fromlen;
-	char udp_msg[DNS_LEN];
-
-	memset(&server_addr, 0, sizeof(server_addr));
-	server_addr.sin_family = AF_INET;
-	server_addr.sin_addr.s_addr = INADDR_ANY;
-	server_addr.sin_port = htons(53);
-	server_addr.sin_len = sizeof(server_addr);
-
-	do {
-		sockFd = socket(AF_INET, SOCK_DGRAM, 0);
-		if (sockFd == -1) {
-			printf("captive_portal_task failed to create socket\n");
-			vTaskDelay(1000/portTICK_RATE_MS);
+	fd_set read_fds;
+	int ret;
+	int max_fd = (sockFd > ctrlFd) ? sockFd : ctrlFd;
+
+	while (1) {
+		FD_ZERO(&read_fds);
+		FD_SET(sockFd, &read_fds);
+		FD_SET(ctrlFd, &read_fds);
+
+		ret = select(max_fd + 1, &read_fds, NULL, NULL, NULL);
+		if (ret < 0) {
+			ESP_LOGE(CAPTIVE_PORTAL_TAG, "select failed");
+			break;
 		}
-	} while (sockFd ==-1);
 
-	do {
-		ret = bind(sockFd, (struct sockaddr *)&server_addr, sizeof(server_addr));
-		if (ret !=0) {
-			printf("captive_portal_task failed to bind socket \n");
-			vTaskDelay(1000/portTICK_RATE_MS);
+		if (FD_ISSET(ctrlFd, &read_fds)) {
+			// Stop requested
+			break;
 		}
-	} while (ret!=0);
 
-	while (1) {
-		memset(&from, 0, sizeof(from));
-		fromlen=sizeof(struct sockaddr_in);
-		ret = recvfrom(sockFd, (uint8_t *)udp_msg, DNS_LEN, 0, (struct sockaddr *)&from, (socklen_t *)&fromlen);
-		if (ret > 0) {
-			captive_portal_recv(&from,udp_msg,ret);
+		if (FD_ISSET(sockFd, &read_fds)) {
+			memset(&from, 0, sizeof(from));
+			fromlen=sizeof(struct sockaddr_in);
+			ret = recvfrom(sockFd, udp_msg, DNS_LEN, 0, (struct sockaddr *)&from, (socklen_t *)&fromlen);
+			if (ret > 0) {
+				captive_portal_recv(&from,udp_msg,ret);
+			}
 		}
 	}
 
+	stack_high_water_mark = uxTaskGetStackHighWaterMark(NULL);
+
 	close(sockFd);
+	close(ctrlFd);
+	sockFd = -1;
+	ctrlFd = -1;
+
+	xSemaphoreGive(stopped);
 	vTaskDelete(NULL);
 }
 
-void captive_portal_init() {
-	xTaskCreate(captive_portal_task, (const char *)"captive_portal_task", 10000, NULL, 3, NULL);
+/*
+ * @brief Wait for the task to finish deleting itself. It signals that it has stopped just
+ * before it deletes itself, and its stack and TCB must not be reused until it has gone.
+ */
+static void reap_task() {
+	while (eTaskGetState(task) != eDeleted) {
+		vTaskDelay(CAPTIVE_PORTAL_REAP_POLL_MS/portTICK_PERIOD_MS);
+	}
+	task = NULL;
 }
 
+esp_err_t captive_portal_start() {
+	struct sockaddr_in ctrl_addr;
+	socklen_t ctrl_len = sizeof(ctrl_addr);
+
+	if (task != NULL) {
+		// The task may have ended by itself after a socket error
+		if (xSemaphoreTake(stopped, 0) != pdTRUE) {
+			return ESP_ERR_INVALID_STATE;
+		}
+		reap_task();
+	}
+
+	prepare_replies();
+
+	sockFd = open_udp_socket(htonl(INADDR_ANY), htons(53));
+	if (sockFd < 0) {
+		ESP_LOGE(CAPTIVE_PORTAL_TAG, "Failed to open DNS socket");
+		return ESP_FAIL;
+	}
+
+	// Control socket on loopback - a datagram sent to it stops the task
+	ctrlFd = open_udp_socket(htonl(INADDR_LOOPBACK), 0);
+	if (ctrlFd < 0 || getsockname(ctrlFd, (struct sockaddr *)&ctrl_addr, &ctrl_len) != 0) {
+		ESP_LOGE(CAPTIVE_PORTAL_TAG, "Failed to open control socket");
+		close(sockFd);
+		if (ctrlFd >= 0) {
+			close(ctrlFd);
+		}
+		sockFd = -1;
+		ctrlFd = -1;
+		return ESP_FAIL;
+	}
+	ctrl_port = ctrl_addr.sin_port;
+
+	if (stopped == NULL) {
+		stopped = xSemaphoreCreateBinaryStatic(&stopped_buffer);
+	}
+
+	task = xTaskCreateStatic(captive_portal_task, "captive_portal_task", CAPTIVE_PORTAL_STACK_SIZE,
+			NULL, CAPTIVE_PORTAL_PRIORITY, task_stack, &task_buffer);
+
+	ESP_LOGI(CAPTIVE_PORTAL_TAG, "DNS server started");
+
+	return ESP_OK;
+}
+
+esp_err_t captive_portal_stop() {
+	struct sockaddr_in ctrl_addr;
+	uint8_t stop = 0;
+
+	if (task == NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	memset(&ctrl_addr, 0, sizeof(ctrl_addr));
+	ctrl_addr.sin_family = AF_INET;
+	ctrl_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	ctrl_addr.sin_port = ctrl_port;
+	ctrl_addr.sin_len = sizeof(ctrl_addr);
+
+	sendto(ctrlFd, &stop, sizeof(stop), 0, (struct sockaddr *)&ctrl_addr, sizeof(ctrl_addr));
+
+	if (xSemaphoreTake(stopped, CAPTIVE_PORTAL_STOP_TIMEOUT_MS/portTICK_PERIOD_MS) != pdTRUE) {
+		ESP_LOGE(CAPTIVE_PORTAL_TAG, "DNS server did not stop");
+		return ESP_ERR_TIMEOUT;
+	}
+	reap_task();
+
+	ESP_LOGI(CAPTIVE_PORTAL_TAG, "DNS server stopped. Stack high water mark: %u of %u bytes free",
+			stack_high_water_mark, CAPTIVE_PORTAL_STACK_SIZE);
+	ESP_LOGI(CAPTIVE_PORTAL_TAG, "Replies: %u, rate limited: %u, malformed: %u, probe hosts: %u hit %u missed",
+			stats.replies, stats.rate_limited, stats.malformed, stats.probe_hits, stats.probe_misses);
+
+	return ESP_OK;
+}
+
+uint32_t captive_portal_get_stack_high_water_mark() {
+	if (task != NULL) {
+		return uxTaskGetStackHighWaterMark(task);
+	}
+	return stack_high_water_mark;
+}
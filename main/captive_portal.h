@@ -13,20 +13,74 @@
 #ifndef MAIN_CAPTIVE_PORTAL_H_
 #define MAIN_CAPTIVE_PORTAL_H_
 
-#include <math.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "lwip/sockets.h"
 #include "lwip/err.h"
 #include "esp_netif.h"
+#include "esp_log.h"
+#include "esp_timer.h"
 #include "string.h"
 
 #include "wifi.h"
+#include "dns.h"
 
-/*
- * @brief Function to initialise a captive portal RTOS task
+/* Sockets held while the DNS server runs - the DNS socket and the loopback control socket */
+#define CAPTIVE_PORTAL_SOCKETS 2
+
+/** How the DNS server responds to a given qtype */
+typedef enum {
+	DNS_POLICY_ANSWER = 0,    /* Answer with the AP address (A only) */
+	DNS_POLICY_NODATA = 1,    /* NOERROR with no answers and an SOA */
+	DNS_POLICY_NXDOMAIN = 2,  /* NXDOMAIN with an SOA */
+	DNS_POLICY_DROP = 3       /* No reply - client waits for a timeout */
+} dns_policy_t;
+
+/** Counters kept by the DNS server. Logged when it stops. */
+typedef struct {
+	uint32_t replies;        /* Replies sent */
+	uint32_t rate_limited;   /* Queries dropped because the client exceeded its budget */
+	uint32_t malformed;      /* Queries dropped because they could not be parsed */
+	uint32_t probe_hits;     /* A queries served from the connectivity-check host table */
+	uint32_t probe_misses;   /* A queries for any other name */
+} captive_portal_stats_t;
+
+/**
+ * @brief Set how queries of a given type are answered.
+ * By default A is answered, and all other types get an immediate NODATA reply.
+ * @param qtype DNS qtype
+ * @param policy Policy for qtype. DNS_POLICY_ANSWER is only valid for QTYPE_A.
+ * @return ESP_OK on success. ESP_ERR_NO_MEM if the policy table is full.
+ */
+esp_err_t captive_portal_set_policy(uint16_t qtype, dns_policy_t policy);
+
+/**
+ * @brief Set how queries of a type with no policy of its own are answered.
+ * @param policy Policy for unlisted qtypes. Must not be DNS_POLICY_ANSWER.
+ * @return ESP_OK on success
+ */
+esp_err_t captive_portal_set_default_policy(dns_policy_t policy);
+
+/**
+ * @brief Start the captive portal DNS server task.
+ * The AP netif must be up, as its IP address is baked into the DNS answer.
+ * @return ESP_OK on success. ESP_ERR_INVALID_STATE if already running.
+ */
+esp_err_t captive_portal_start();
+
+/**
+ * @brief Stop the captive portal DNS server task and close its sockets.
+ * @return ESP_OK on success. ESP_ERR_INVALID_STATE if not running.
+ */
+esp_err_t captive_portal_stop();
+
+/**
+ * @brief Get the minimum free stack of the DNS server task.
+ * Once the task has stopped, the value recorded just before it exited is returned.
+ * @return Stack high water mark in bytes
  */
-void captive_portal_init();
+uint32_t captive_portal_get_stack_high_water_mark();
 
 #endif /* MAIN_CAPTIVE_PORTAL_H_ */
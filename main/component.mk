@@ -1,9 +1,20 @@
 #
 # Main component makefile.
 #
-# 3 HTML files are embedded when flashing to be used as part of First Boot
+# Every file under www/ is served by the portal. tools/gen_assets.py
+# turns them into a sorted, constant asset table in portal_assets.c
+# at build time.
 #
 
-COMPONENT_EMBED_FILES := network_select.html
-COMPONENT_EMBED_FILES += network_details.html
-COMPONENT_EMBED_FILES += connection_check.html
\ No newline at end of file
+WWW_FILES := $(shell find $(COMPONENT_PATH)/www -type f)
+
+COMPONENT_OBJS := $(patsubst %.c,%.o,$(notdir $(wildcard $(COMPONENT_PATH)/*.c))) portal_assets.o
+COMPONENT_EXTRA_CLEAN := portal_assets.c
+
+portal_assets.c: $(WWW_FILES) $(COMPONENT_PATH)/tools/gen_assets.py
+	$(summary) GEN $@
+	$(PYTHON) $(COMPONENT_PATH)/tools/gen_assets.py $(COMPONENT_PATH)/www $(COMPONENT_BUILD_DIR)
+
+portal_assets.o: portal_assets.c
+	$(summary) CC $@
+	$(CC) $(CFLAGS) $(CPPFLAGS) $(addprefix -I ,$(COMPONENT_INCLUDES)) -c $< -o $@
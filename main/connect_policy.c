@@ -0,0 +1,53 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Connect Policy
+ * How hard the station keeps trying to connect: the
+ * deadlines, the jittered exponential backoff between
+ * attempts, and which disconnect reasons mean the AP
+ * rejected the credentials.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "esp_wifi_types.h"
+
+#include "connect_policy.h"
+
+bool connect_policy_is_auth_failure(uint8_t reason) {
+	switch (reason) {
+	case	WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+	case	WIFI_REASON_HANDSHAKE_TIMEOUT:
+	case	WIFI_REASON_AUTH_FAIL:
+	case	WIFI_REASON_802_1X_AUTH_FAILED:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void connect_retry_init(connect_retry_t *retry, const connect_policy_t *policy) {
+	retry->policy = policy;
+	retry->backoff_ms = policy->backoff_base_ms;
+	retry->auth_failures = 0;
+}
+
+bool connect_retry_failed(connect_retry_t *retry, uint8_t reason) {
+	// One rejection may be a lost handshake frame - only repeated ones mean a wrong password
+	if (connect_policy_is_auth_failure(reason) && retry->auth_failures < UINT8_MAX) {
+		retry->auth_failures++;
+	}
+
+	return retry->auth_failures >= retry->policy->max_auth_failures && retry->auth_failures > 0;
+}
+
+uint32_t connect_retry_next_delay_ms(connect_retry_t *retry, uint32_t random) {
+	uint32_t backoff_ms = retry->backoff_ms;
+	uint32_t delay_ms = backoff_ms/2 + (backoff_ms ? random % (backoff_ms/2 + 1) : 0);
+
+	retry->backoff_ms = (backoff_ms < retry->policy->backoff_max_ms/2) ? backoff_ms*2 : retry->policy->backoff_max_ms;
+
+	return delay_ms;
+}
@@ -0,0 +1,77 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Connect Policy
+ * How hard the station keeps trying to connect: the
+ * deadlines, the jittered exponential backoff between
+ * attempts, and which disconnect reasons mean the AP
+ * rejected the credentials.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MAIN_CONNECT_POLICY_H_
+#define MAIN_CONNECT_POLICY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** How hard a connect keeps trying before giving up */
+typedef struct {
+	uint32_t attempt_timeout_ms;   /* Longest one attempt, association to IP, may take */
+	uint32_t total_timeout_ms;     /* Longest all attempts together may take */
+	uint32_t backoff_base_ms;      /* Pause after the first failed attempt. Doubles after each one. */
+	uint32_t backoff_max_ms;       /* Longest pause between attempts */
+	uint8_t max_auth_failures;     /* Rejections by the AP before the password is taken to be wrong */
+} connect_policy_t;
+
+#define CONNECT_POLICY_DEFAULT() { \
+	.attempt_timeout_ms = 15000,   \
+	.total_timeout_ms = 60000,     \
+	.backoff_base_ms = 500,        \
+	.backoff_max_ms = 8000,        \
+	.max_auth_failures = 2         \
+}
+
+/** Progress of a series of attempts made under a policy */
+typedef struct {
+	const connect_policy_t *policy;
+	uint32_t backoff_ms;           /* Backoff before jitter for the next pause */
+	uint8_t auth_failures;
+} connect_retry_t;
+
+/**
+ * @brief Check whether a disconnect reason means the AP rejected the credentials, rather than
+ * that it could not be reached. Timeouts waiting for the AP, such as WIFI_REASON_AUTH_EXPIRE, are
+ * the usual weak-signal reasons, so do not count.
+ * @param reason Reason from WIFI_EVENT_STA_DISCONNECTED
+ */
+bool connect_policy_is_auth_failure(uint8_t reason);
+
+/**
+ * @brief Start a series of attempts
+ * @param retry Progress to reset
+ * @param policy Policy to follow. Must outlive retry.
+ */
+void connect_retry_init(connect_retry_t *retry, const connect_policy_t *policy);
+
+/**
+ * @brief Record a failed attempt
+ * @param retry Progress
+ * @param reason Disconnect reason, or 0 if the attempt timed out
+ * @return true once the AP has rejected the credentials max_auth_failures times
+ */
+bool connect_retry_failed(connect_retry_t *retry, uint8_t reason);
+
+/**
+ * @brief Get the pause before the next attempt, and double the backoff after it, up to backoff_max_ms.
+ * The pause is between half and all of the backoff, so that devices do not retry in step.
+ * @param retry Progress
+ * @param random Random number, from esp_random()
+ * @return Pause in ms
+ */
+uint32_t connect_retry_next_delay_ms(connect_retry_t *retry, uint32_t random);
+
+#endif /* MAIN_CONNECT_POLICY_H_ */
@@ -0,0 +1,271 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Credential Store
+ * Table of the WiFi networks the device knows, kept in
+ * NVS as a single blob. Each network has a priority
+ * and a record of how connecting to it has gone, used
+ * to rank the known networks found by a scan.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "esp_log.h"
+
+#include "cred_store.h"
+#include "memory.h"
+
+#define CRED_STORE_TAG "cred_store"
+
+#define CRED_TABLE_HANDLE "cred_table"
+
+/* Hint cache written by earlier firmware, now kept in the table */
+#define LEGACY_AP_CACHE_HANDLE "ap_cache"
+
+/* Bumped whenever the layout of cred_table_t changes. A table of another version is discarded. */
+#define CRED_TABLE_VERSION 1
+
+/* Layout of the table in NVS */
+typedef struct {
+	uint8_t version;
+	uint8_t count;
+	uint32_t success_counter;    /* Number of successful connects, used to order them */
+	cred_entry_t entries[CRED_STORE_CAPACITY];
+} cred_table_t;
+
+static cred_table_t table;
+
+/*
+ * @brief Write the table to NVS
+ */
+static esp_err_t save() {
+	table.version = CRED_TABLE_VERSION;
+	return write_blob(CRED_TABLE_HANDLE, &table, sizeof(table));
+}
+
+/*
+ * @brief Find a known network by SSID
+ * @return Index of the network, or -1 if it is not known
+ */
+static int find(const char *ssid) {
+	for (int i = 0; i < table.count; i++) {
+		if (strcmp(table.entries[i].ssid, ssid) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * @brief Drop a network from the table, keeping the rest in order
+ */
+static void drop(int index) {
+	memmove(&table.entries[index], &table.entries[index + 1], (table.count - index - 1) * sizeof(cred_entry_t));
+	table.count--;
+	memset(&table.entries[table.count], 0, sizeof(cred_entry_t));
+}
+
+/*
+ * @brief Compare two candidates
+ * @return true if a should be tried before b
+ */
+static bool ranks_before(const cred_candidate_t *a, const cred_candidate_t *b) {
+	const cred_entry_t *x = &table.entries[a->entry];
+	const cred_entry_t *y = &table.entries[b->entry];
+
+	if (x->priority != y->priority) {
+		return x->priority > y->priority;
+	}
+	if (x->fail_count != y->fail_count) {
+		return x->fail_count < y->fail_count;
+	}
+	if (x->last_success != y->last_success) {
+		return x->last_success > y->last_success;
+	}
+	return a->rssi > b->rssi;
+}
+
+/*
+ * @brief Build a table from the single network stored by earlier firmware
+ */
+static void migrate_legacy() {
+	char ssid[SSID_SIZE];
+	char pword[PWORD_SIZE];
+	size_t ssid_size = sizeof(ssid);
+	size_t pword_size = sizeof(pword);
+
+	if (read_string(SSID_HANDLE, ssid, &ssid_size) != ESP_OK ||
+			read_string(PWORD_HANDLE, pword, &pword_size) != ESP_OK) {
+		return;
+	}
+
+	ESP_LOGI(CRED_STORE_TAG, "Moving %s into the table", ssid);
+	if (cred_store_add(ssid, pword, CRED_PRIORITY_DEFAULT) != ESP_OK) {
+		return;
+	}
+
+	// The hint is remade on the next successful connect
+	erase_key(SSID_HANDLE);
+	erase_key(PWORD_HANDLE);
+	erase_key(LEGACY_AP_CACHE_HANDLE);
+}
+
+esp_err_t cred_store_load() {
+	size_t size = sizeof(table);
+
+	esp_err_t err = read_blob(CRED_TABLE_HANDLE, &table, &size);
+	if (err == ESP_OK && (size != sizeof(table) || table.version != CRED_TABLE_VERSION ||
+			table.count > CRED_STORE_CAPACITY)) {
+		ESP_LOGW(CRED_STORE_TAG, "Discarding table of unknown layout");
+		err = ESP_ERR_INVALID_VERSION;
+	}
+
+	if (err != ESP_OK) {
+		memset(&table, 0, sizeof(table));
+		migrate_legacy();
+	}
+
+	ESP_LOGI(CRED_STORE_TAG, "%d known networks", table.count);
+
+	return ESP_OK;
+}
+
+int cred_store_count() {
+	return table.count;
+}
+
+esp_err_t cred_store_get(int index, cred_entry_t *out) {
+	if (index < 0 || index >= table.count) {
+		memset(out, 0, sizeof(cred_entry_t));
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	*out = table.entries[index];
+	return ESP_OK;
+}
+
+esp_err_t cred_store_add(const char *ssid, const char *pword, uint8_t priority) {
+	if (strlen(ssid) >= SSID_SIZE || strlen(pword) >= PWORD_SIZE) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	int index = find(ssid);
+
+	if (index < 0) {
+		if (table.count == CRED_STORE_CAPACITY) {
+			// Make room by dropping the network that would be tried last
+			cred_candidate_t ranked[CRED_STORE_CAPACITY];
+			int count = cred_store_rank(NULL, 0, ranked, CRED_STORE_CAPACITY);
+			ESP_LOGW(CRED_STORE_TAG, "Table full - forgetting %s", table.entries[ranked[count - 1].entry].ssid);
+			drop(ranked[count - 1].entry);
+		}
+		index = table.count++;
+		memset(&table.entries[index], 0, sizeof(cred_entry_t));
+		strcpy(table.entries[index].ssid, ssid);
+	}
+
+	cred_entry_t *entry = &table.entries[index];
+
+	// A new password makes the cached PMK and failure record meaningless
+	if (strcmp(entry->pword, pword) != 0) {
+		strcpy(entry->pword, pword);
+		entry->has_hint = 0;
+		entry->fail_count = 0;
+	}
+	entry->priority = priority;
+
+	return save();
+}
+
+esp_err_t cred_store_remove(const char *ssid) {
+	int index = find(ssid);
+
+	if (index < 0) {
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	drop(index);
+	return save();
+}
+
+esp_err_t cred_store_record_result(const char *ssid, esp_err_t result, const ap_hint_t *hint) {
+	int index = find(ssid);
+
+	if (index < 0) {
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	cred_entry_t *entry = &table.entries[index];
+
+	if (result == ESP_OK) {
+		// Reconnecting to the network already on top changes nothing worth a flash write
+		if (entry->last_success != 0 && entry->last_success == table.success_counter && entry->fail_count == 0 &&
+				(hint == NULL || (entry->has_hint && memcmp(&entry->hint, hint, sizeof(*hint)) == 0))) {
+			return ESP_OK;
+		}
+		entry->last_success = ++table.success_counter;
+		entry->fail_count = 0;
+		if (hint != NULL) {
+			entry->hint = *hint;
+			entry->has_hint = 1;
+		}
+	} else if (result == ESP_ERR_WIFI_PASSWORD) {
+		ESP_LOGW(CRED_STORE_TAG, "%s rejected its password - forgetting it", ssid);
+		drop(index);
+	} else {
+		// Counted in RAM only. An AP that stays down would otherwise cost a commit every retry
+		// round. The count is written with the table the next time something else changes it.
+		if (entry->fail_count < UINT8_MAX) {
+			entry->fail_count++;
+		}
+		return ESP_OK;
+	}
+
+	return save();
+}
+
+int cred_store_rank(const ap_details_t *visible, int visible_count, cred_candidate_t *out, int max) {
+	cred_candidate_t ranked[CRED_STORE_CAPACITY];
+	int count = 0;
+
+	for (int i = 0; i < table.count; i++) {
+		cred_candidate_t candidate = { .entry = i, .rssi = INT8_MIN };
+
+		if (visible != NULL) {
+			int seen = -1;
+			for (int j = 0; j < visible_count; j++) {
+				if (strcmp(visible[j].ssid, table.entries[i].ssid) == 0) {
+					seen = j;
+					break;
+				}
+			}
+			if (seen < 0) {
+				continue;
+			}
+			candidate.rssi = visible[seen].rssi;
+			candidate.channel = visible[seen].channel;
+			memcpy(candidate.bssid, visible[seen].bssid, sizeof(candidate.bssid));
+		}
+
+		// Insertion sort, as the table is short
+		int j = count - 1;
+		while (j >= 0 && ranks_before(&candidate, &ranked[j])) {
+			ranked[j + 1] = ranked[j];
+			j--;
+		}
+		ranked[j + 1] = candidate;
+		count++;
+	}
+
+	if (count > max) {
+		count = max;
+	}
+	memcpy(out, ranked, count * sizeof(cred_candidate_t));
+
+	return count;
+}
@@ -0,0 +1,110 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Credential Store
+ * Table of the WiFi networks the device knows, kept in
+ * NVS as a single blob. Each network has a priority
+ * and a record of how connecting to it has gone, used
+ * to rank the known networks found by a scan.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MAIN_CRED_STORE_H_
+#define MAIN_CRED_STORE_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "wifi.h"
+
+#define SSID_SIZE 33
+#define PWORD_SIZE 64
+
+/* Maximum number of networks remembered */
+#define CRED_STORE_CAPACITY 4
+
+/* Priority given to networks added through the portal. Higher is preferred. */
+#define CRED_PRIORITY_DEFAULT 100
+
+/** A known network */
+typedef struct {
+	char ssid[SSID_SIZE];
+	char pword[PWORD_SIZE];
+	uint8_t priority;         /* Higher is preferred */
+	uint8_t fail_count;       /* Failed connects since the last success */
+	uint8_t has_hint;         /* Set if hint is valid */
+	uint32_t last_success;    /* Value of the success counter at the last connect. 0 if never connected. */
+	ap_hint_t hint;           /* Where the network was last connected to */
+} cred_entry_t;
+
+/** A known network to try connecting to, and where it was seen */
+typedef struct {
+	int entry;                /* Index of the known network */
+	int8_t rssi;
+	uint8_t bssid[6];
+	uint8_t channel;          /* Channel it was seen on. 0 if not seen. */
+} cred_candidate_t;
+
+/**
+ * @brief Load the table from NVS. Memory must be open. If there is no table, one is made from
+ * the single SSID and password stored by earlier firmware, which are then erased.
+ * @return ESP_OK on success, including when no networks are known
+ */
+esp_err_t cred_store_load();
+
+/**
+ * @brief Get the number of known networks
+ */
+int cred_store_count();
+
+/**
+ * @brief Get a known network
+ * @param index Index of network
+ * @param out Copy of network. Zeroed if index is out of range.
+ * @return ESP_OK on success. ESP_ERR_INVALID_ARG if index is out of range.
+ */
+esp_err_t cred_store_get(int index, cred_entry_t *out);
+
+/**
+ * @brief Add a network, or update the password and priority of a known one.
+ * If the table is full, the lowest ranked network is dropped to make room.
+ * @param ssid SSID of network
+ * @param pword Password of network. Empty for an open network.
+ * @param priority Priority of network. Higher is preferred.
+ * @return ESP_OK on success. ESP_ERR_INVALID_ARG if the SSID or password is too long.
+ */
+esp_err_t cred_store_add(const char *ssid, const char *pword, uint8_t priority);
+
+/**
+ * @brief Forget a network
+ * @return ESP_OK on success. ESP_ERR_NOT_FOUND if the network is not known.
+ */
+esp_err_t cred_store_remove(const char *ssid);
+
+/**
+ * @brief Record the result of connecting to a known network.
+ * A success clears the failure count and stores the hint. A rejected password forgets the
+ * network. Any other failure counts against it, in RAM only, so that an AP which stays down
+ * costs no flash writes. Only writes to NVS when the stored table changes.
+ * @param ssid SSID of network
+ * @param result ESP_OK, ESP_ERR_WIFI_PASSWORD, or another error
+ * @param hint Where the network was connected to. NULL to keep the previous hint.
+ * @return ESP_OK on success. ESP_ERR_NOT_FOUND if the network is not known.
+ */
+esp_err_t cred_store_record_result(const char *ssid, esp_err_t result, const ap_hint_t *hint);
+
+/**
+ * @brief Rank the known networks seen by a scan, best first. Ranked by priority, then fewest
+ * failures, then most recent success, then signal strength. Does not touch NVS or the radio.
+ * @param visible Networks found by the scan. NULL to rank every known network, as if unseen.
+ * @param visible_count Number of networks in visible
+ * @param out Output candidates
+ * @param max Size of out
+ * @return Number of candidates written
+ */
+int cred_store_rank(const ap_details_t *visible, int visible_count, cred_candidate_t *out, int max);
+
+#endif /* MAIN_CRED_STORE_H_ */
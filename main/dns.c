@@ -0,0 +1,104 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * DNS
+ * Wire format definitions and a bounds-checked parser
+ * for the DNS queries answered by the captive portal.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "dns.h"
+
+/*
+ * @brief Read a big-endian 16-bit value
+ */
+static inline uint16_t get_uint16(const uint8_t *p) {
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+/*
+ * @brief Walk the labels of an uncompressed QNAME
+ * @param data Packet received
+ * @param length Length of packet
+ * @param offset Offset of QNAME
+ * @return Encoded length of QNAME, or 0 if it is malformed or runs past the packet
+ */
+static size_t walk_name(const uint8_t *data, size_t length, size_t offset) {
+	size_t pos = offset;
+
+	while (pos < length) {
+		uint8_t len = data[pos];
+
+		if (len == 0) {
+			return pos + 1 - offset;
+		}
+		// Compression pointers and extended label types are not expected in a question
+		if (len > DNS_MAX_LABEL_LEN) {
+			return 0;
+		}
+		pos += 1 + len;
+		// Leave room for the root label
+		if (pos + 1 - offset > DNS_MAX_NAME_LEN) {
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+esp_err_t dns_parse_query(const uint8_t *data, size_t length, dns_query_view_t *view) {
+	size_t pos;
+
+	if (length < DNS_HEADER_LEN) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	// Get Header
+	view->id = get_uint16(&data[0]);
+	view->flags = data[2];
+	view->rcode = data[3];
+	view->qdcount = get_uint16(&data[4]);
+	view->ancount = get_uint16(&data[6]);
+	view->nscount = get_uint16(&data[8]);
+	view->arcount = get_uint16(&data[10]);
+
+	// Replies and non-standard opcodes are never answered.
+	// ARCOUNT is allowed, as clients commonly attach an EDNS OPT record.
+	if ((view->flags & (FLAG_QR | FLAG_OPCODE)) || view->ancount || view->nscount) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (view->flags & FLAG_TC) {
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+	if (view->qdcount == 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (view->qdcount > DNS_MAX_QUESTIONS) {
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+
+	// Get each question
+	pos = DNS_HEADER_LEN;
+	for (int i = 0; i < view->qdcount; i++) {
+		dns_question_t *question = &view->questions[i];
+		size_t name_len = walk_name(data, length, pos);
+
+		if (name_len == 0 || pos + name_len + 2*sizeof(uint16_t) > length) {
+			return ESP_ERR_INVALID_SIZE;
+		}
+
+		question->name = pos;
+		question->name_len = name_len;
+		pos += name_len;
+
+		question->type = get_uint16(&data[pos]);
+		question->class = get_uint16(&data[pos + 2]);
+		pos += 2*sizeof(uint16_t);
+	}
+	view->question_end = pos;
+
+	return ESP_OK;
+}
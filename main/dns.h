@@ -0,0 +1,95 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * DNS
+ * Wire format definitions and a bounds-checked parser
+ * for the DNS queries answered by the captive portal.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MAIN_DNS_H_
+#define MAIN_DNS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define DNS_LEN 512
+#define DNS_HEADER_LEN 12
+
+/* Maximum number of questions handled in a single query */
+#define DNS_MAX_QUESTIONS 4
+
+/* Maximum length of an encoded name, as per RFC 1035 */
+#define DNS_MAX_NAME_LEN 255
+#define DNS_MAX_LABEL_LEN 63
+
+#define FLAG_QR (1<<7)
+#define FLAG_OPCODE (0xF<<3)
+#define FLAG_AA (1<<2)
+#define FLAG_TC (1<<1) //Truncated
+#define FLAG_RD (1<<0)
+
+#define FLAG_RA (1<<7)
+
+#define QTYPE_A  1
+#define QTYPE_NS 2
+#define QTYPE_CNAME 5
+#define QTYPE_SOA 6
+#define QTYPE_WKS 11
+#define QTYPE_PTR 12
+#define QTYPE_HINFO 13
+#define QTYPE_MINFO 14
+#define QTYPE_MX 15
+#define QTYPE_TXT 16
+#define QTYPE_AAAA 28
+#define QTYPE_SVCB 64
+#define QTYPE_HTTPS 65
+#define QTYPE_URI 256
+
+#define QCLASS_IN 1
+#define QCLASS_ANY 255
+#define QCLASS_URI 256
+
+#define RCODE_NOERROR 0
+#define RCODE_NXDOMAIN 3
+
+/** A single question, given as offsets into the received packet */
+typedef struct {
+	uint16_t name;       /* Offset of QNAME */
+	uint16_t name_len;   /* Encoded length of QNAME, including the root label */
+	uint16_t type;
+	uint16_t class;
+} dns_question_t;
+
+/** View of a received query. Holds no copy of the packet itself. */
+typedef struct {
+	uint16_t id;
+	uint8_t flags;
+	uint8_t rcode;
+	uint16_t qdcount;
+	uint16_t ancount;
+	uint16_t nscount;
+	uint16_t arcount;
+	uint16_t question_end;   /* Offset of first byte after the question section */
+	dns_question_t questions[DNS_MAX_QUESTIONS];
+} dns_query_view_t;
+
+/**
+ * @brief Parse a DNS query without copying it.
+ * Every read is checked against length, so malformed packets are rejected rather than
+ * read past the end of the buffer.
+ * @param data Packet received
+ * @param length Length of packet
+ * @param view Output view of header and questions
+ * @return ESP_OK on success.
+ *         ESP_ERR_INVALID_SIZE if the packet is truncated or a name is too long.
+ *         ESP_ERR_INVALID_ARG if the packet is not a standard query.
+ *         ESP_ERR_NOT_SUPPORTED if the query is truncated (TC) or has too many questions.
+ */
+esp_err_t dns_parse_query(const uint8_t *data, size_t length, dns_query_view_t *view);
+
+#endif /* MAIN_DNS_H_ */
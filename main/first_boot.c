@@ -17,6 +17,70 @@
 #define FIRST_BOOT_NAMESPACE "first_boot"
 
 #define VALID_NETWORK_DETAILS_STORED_TAG "valid_network_details_stored"
+#define CONNECTION_TEST_TAG "connection_test"
+#define CONNECT_TO_SAVED_AP_TAG "connect_to_saved_ap"
+#define END_PROVISIONING_TAG "end_provisioning"
+
+/* With a single network known, a directed connect gets one short try before scanning. A stale
+ * PMK is rejected like a wrong password, so a single rejection is enough to fall back. */
+static const connect_policy_t directed_policy = {
+		.attempt_timeout_ms = 5000,
+		.total_timeout_ms = 5000,
+		.backoff_base_ms = 500,
+		.backoff_max_ms = 500,
+		.max_auth_failures = 1
+};
+
+/* Each known network found by the boot scan gets a shorter try than the default, so that the
+ * next one is reached quickly if it fails */
+static const connect_policy_t saved_ap_policy = {
+		.attempt_timeout_ms = 10000,
+		.total_timeout_ms = 20000,
+		.backoff_base_ms = 500,
+		.backoff_max_ms = 4000,
+		.max_auth_failures = 2
+};
+
+/* Time on each channel in the boot scan. Long enough for a probe response; about a second in all. */
+#define QUICK_SCAN_DWELL_MS 60
+
+/* Resource profile of the portal webserver */
+#define PORTAL_SERVER_PROFILE SERVER_PROFILE_BALANCED
+
+/* Background rescans while the portal runs. Two channels every two seconds keeps the AP
+ * away from its own channel for at most 120 ms at a time. */
+static const scanner_config_t portal_scanner_config = SCANNER_CONFIG_DEFAULT();
+
+#define CONNECTION_TEST_STACK_SIZE 4096
+#define CONNECTION_TEST_PRIORITY 4
+
+/* Set whenever the connection test changes state */
+#define CONNECTION_TEST_CHANGED_BIT BIT0
+
+static volatile connection_test_state_t connection_test_state = CONNECTION_TEST_IDLE;
+static connection_test_listener_t connection_test_listener;
+static void *connection_test_listener_arg;
+
+/* Held while the listener is changed or called, so that it is never called with the argument
+ * of another, and never called once it has been removed */
+static SemaphoreHandle_t listener_lock;
+static StaticSemaphore_t listener_lock_buffer;
+static EventGroupHandle_t connection_test_events;
+
+/* Held by whatever is connecting the station while the portal runs - the connection test, or a
+ * retry of the known networks - so that they never fight over it */
+static SemaphoreHandle_t station_lock;
+static StaticSemaphore_t station_lock_buffer;
+
+/* Webserver of the portal, while it runs */
+static httpd_handle_t portal_server;
+
+/* Time for the last portal response to leave the device before the AP goes down */
+#define HANDOVER_GRACE_MS 1000
+
+/* Network being tested. Only added to the credential store once connected to. */
+static char test_ssid[SSID_SIZE];
+static char test_pword[PWORD_SIZE];
 
 /* Stages of connection to a WiFi network */
 typedef enum {
@@ -36,49 +100,269 @@ void init() {
 
 
 bool valid_network_details_stored(bool verbose) {
+	int count = cred_store_count();
 
-	// Check NVS
-	size_t ssid_size = SSID_SIZE;
-	esp_err_t ssid_err = read_string(SSID_HANDLE, NULL, &ssid_size);
-
-	size_t pword_size = PWORD_SIZE;
-	esp_err_t pword_err = read_string(PWORD_HANDLE, NULL, &pword_size);
-
-	// Check if SSID and Password were obtained from NVS
-	if (ssid_err == ESP_OK && pword_err == ESP_OK) {
-		ESP_LOGI(VALID_NETWORK_DETAILS_STORED_TAG, "Valid SSID and Password exist");
+	if (count > 0) {
+		ESP_LOGI(VALID_NETWORK_DETAILS_STORED_TAG, "%d known networks", count);
 		return true;
 	} else {
 		if (verbose) {
-			ESP_LOGE(VALID_NETWORK_DETAILS_STORED_TAG, "No valid SSID and/or Password exists");
-			ESP_LOGE(VALID_NETWORK_DETAILS_STORED_TAG, "Error getting SSID:     %s", esp_err_to_name(ssid_err));
-			ESP_LOGE(VALID_NETWORK_DETAILS_STORED_TAG, "Error getting password: %s", esp_err_to_name(pword_err));
+			ESP_LOGE(VALID_NETWORK_DETAILS_STORED_TAG, "No known networks");
 		}
 		return false;
 	}
 
 }
 
+/*
+ * @brief Rank the known networks in range, best first. On the boot path, scans briefly first.
+ * While the portal runs, ranks from the list the background scanner keeps fresh instead, as an
+ * all-channel scan would take the AP off its channel for far longer than a slice and replace the
+ * list the user is choosing from.
+ * @return Number of candidates
+ */
+static int rank_visible_networks(cred_candidate_t *candidates) {
+	bool portal_running = (portal_server != NULL);
+	int count = 0;
+
+	if (portal_running || scan_aps_quick(QUICK_SCAN_DWELL_MS) == ESP_OK) {
+		int visible_count = get_ap_count();
+		ap_details_t *visible = malloc((visible_count + 1) * sizeof(ap_details_t));
+
+		if (visible != NULL) {
+			// The store may shrink under a merge, so only what can still be read is ranked
+			int found = 0;
+			while (found < visible_count && scan_store_get(found, &visible[found]) == ESP_OK) {
+				found++;
+			}
+			count = cred_store_rank(visible, found, candidates, CRED_STORE_CAPACITY);
+			free(visible);
+		}
+	}
+
+	// On the boot path the list is only wanted again if the portal has to be started, which scans afresh
+	if (!portal_running) {
+		scan_store_release();
+	}
+
+	return count;
+}
+
+/*
+ * @brief Connect to a known network. If the AP rejects a cached PMK, tries again with the password,
+ * as only the password decides whether the credentials are wrong.
+ * @param hint Where to find the AP. NULL to scan all channels.
+ */
+static esp_err_t connect_to_known(cred_entry_t *entry, ap_hint_t *hint, const connect_policy_t *policy) {
+	esp_err_t err = connect_to_ap_directed(entry->ssid, entry->pword, hint, policy);
+
+	if (err == ESP_ERR_WIFI_PASSWORD && hint != NULL && hint->has_pmk) {
+		hint->has_pmk = 0;
+		err = connect_to_ap_directed(entry->ssid, entry->pword, hint, policy);
+	}
+
+	return err;
+}
+
 esp_err_t connect_to_saved_ap() {
+	cred_candidate_t candidates[CRED_STORE_CAPACITY];
+	cred_entry_t entry;
+	ap_hint_t hint;
+	ap_hint_t *target = NULL;
+	esp_err_t err = ESP_ERR_NOT_FOUND;
+	const char *method = "directed";
+
+	int64_t start = esp_timer_get_time();
+
+	// With only one network known, go straight to the AP last connected to
+	if (cred_store_count() == 1 && cred_store_get(0, &entry) == ESP_OK && entry.has_hint) {
+		hint = entry.hint;
+		target = &hint;
+		err = connect_to_ap_directed(entry.ssid, entry.pword, target, &directed_policy);
+		if (err != ESP_OK) {
+			ESP_LOGW(CONNECT_TO_SAVED_AP_TAG, "Directed connect failed - falling back to scan");
+		}
+	}
+
+	if (err != ESP_OK) {
+		int count = rank_visible_networks(candidates);
+		method = "scan";
+
+		if (count == 0) {
+			// None in range, or hidden - try every known network in turn
+			count = cred_store_rank(NULL, 0, candidates, CRED_STORE_CAPACITY);
+			method = "fallback";
+		}
+
+		for (int i = 0; i < count && err != ESP_OK; i++) {
+			cred_store_get(candidates[i].entry, &entry);
+			ESP_LOGI(CONNECT_TO_SAVED_AP_TAG, "Trying %s (%d of %d)", entry.ssid, i + 1, count);
 
-	// Read NVS
-	size_t ssid_size = SSID_SIZE;
-	char ssid[SSID_SIZE];
-	read_string(SSID_HANDLE, ssid, &ssid_size);
+			// The AP found by the scan, with the cached PMK if there is one
+			target = NULL;
+			if (candidates[i].channel != 0) {
+				memset(&hint, 0, sizeof(hint));
+				memcpy(hint.bssid, candidates[i].bssid, sizeof(hint.bssid));
+				hint.channel = candidates[i].channel;
+				if (entry.has_hint && entry.hint.has_pmk) {
+					hint.has_pmk = 1;
+					memcpy(hint.pmk, entry.hint.pmk, sizeof(hint.pmk));
+				}
+				target = &hint;
+			} else if (entry.has_hint) {
+				hint = entry.hint;
+				target = &hint;
+			}
 
-	size_t pword_size = PWORD_SIZE;
-	char pword[PWORD_SIZE];
-	read_string(PWORD_HANDLE, pword, &pword_size);
+			err = connect_to_known(&entry, target, &saved_ap_policy);
+			if (err != ESP_OK) {
+				cred_store_record_result(entry.ssid, err, NULL);
 
-	if (connect_to_ap(ssid, pword) == ESP_OK) {
-		ESP_LOGI("connect_to_saved_ap", "Connection to saved AP successful");
+				// A forgotten network moves those after it down the table
+				if (err == ESP_ERR_WIFI_PASSWORD) {
+					for (int j = i + 1; j < count; j++) {
+						if (candidates[j].entry > candidates[i].entry) {
+							candidates[j].entry--;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	int64_t now = esp_timer_get_time();
+
+	if (err == ESP_OK) {
+		// Deriving the PMK takes a moment, so it is only done if there is none cached
+		if (target != NULL && target->has_pmk && entry.has_hint) {
+			cred_store_record_result(entry.ssid, ESP_OK, target);
+		} else {
+			cred_store_record_result(entry.ssid, ESP_OK,
+					(get_ap_hint(entry.ssid, entry.pword, &hint) == ESP_OK) ? &hint : NULL);
+		}
+
+		ESP_LOGI(CONNECT_TO_SAVED_AP_TAG, "Connected to %s (%s): took %d ms, %d ms since boot",
+				entry.ssid, method, (int)((now - start) / 1000), (int)(now / 1000));
 		return ESP_OK;
 	} else {
-		ESP_LOGE("connect_to_saved_ap", "Could not connect to saved AP");
-		return ESP_FAIL;
+		ESP_LOGE(CONNECT_TO_SAVED_AP_TAG, "Could not connect to a known network after %d ms: %s",
+				(int)((now - start) / 1000), esp_err_to_name(err));
+		return err;
 	}
 }
 
+/*
+ * @brief Move the connection test to a new state, wake any waiting request and tell the listener
+ */
+static void set_connection_test_state(connection_test_state_t state) {
+	connection_test_state = state;
+	xEventGroupSetBits(connection_test_events, CONNECTION_TEST_CHANGED_BIT);
+	ESP_LOGI(CONNECTION_TEST_TAG, "State: %s", connection_test_state_name(state));
+
+	// No lock means no listener has ever been set
+	if (listener_lock != NULL) {
+		xSemaphoreTake(listener_lock, portMAX_DELAY);
+		if (connection_test_listener != NULL) {
+			connection_test_listener(state, connection_test_listener_arg);
+		}
+		xSemaphoreGive(listener_lock);
+	}
+}
+
+/*
+ * @brief Task which runs one connection attempt, so that the httpd worker is never blocked by it
+ */
+static void connection_test_task(void *pvParameters) {
+	ap_hint_t hint;
+	esp_err_t err;
+
+	xSemaphoreTake(station_lock, portMAX_DELAY);
+	set_connection_test_state(CONNECTION_TEST_ASSOCIATING);
+
+	// The station needs the radio to itself while it connects
+	scanner_pause();
+	err = connect_to_ap(test_ssid, test_pword);
+	scanner_resume();
+	xSemaphoreGive(station_lock);
+
+	// Only credentials that work are remembered, before the user is told they do
+	if (err == ESP_OK) {
+		err = cred_store_add(test_ssid, test_pword, CRED_PRIORITY_DEFAULT);
+	}
+	if (err == ESP_OK) {
+		cred_store_record_result(test_ssid, ESP_OK,
+				(get_ap_hint(test_ssid, test_pword, &hint) == ESP_OK) ? &hint : NULL);
+	}
+
+	if (err == ESP_OK) {
+		set_connection_test_state(CONNECTION_TEST_GOT_IP);
+	} else {
+		set_connection_test_state(CONNECTION_TEST_FAILED);
+	}
+
+	vTaskDelete(NULL);
+}
+
+esp_err_t start_connection_test(const char *ssid, const char *pword) {
+	if (connection_test_events == NULL) {
+		connection_test_events = xEventGroupCreate();
+	}
+
+	if (connection_test_state == CONNECTION_TEST_QUEUED || connection_test_state == CONNECTION_TEST_ASSOCIATING) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	snprintf(test_ssid, sizeof(test_ssid), "%s", ssid);
+	snprintf(test_pword, sizeof(test_pword), "%s", pword);
+
+	set_connection_test_state(CONNECTION_TEST_QUEUED);
+
+	if (xTaskCreate(connection_test_task, "connection_test", CONNECTION_TEST_STACK_SIZE, NULL,
+			CONNECTION_TEST_PRIORITY, NULL) != pdPASS) {
+		set_connection_test_state(CONNECTION_TEST_FAILED);
+		return ESP_ERR_NO_MEM;
+	}
+
+	return ESP_OK;
+}
+
+connection_test_state_t wait_connection_test_state(connection_test_state_t known, uint32_t timeout_ms) {
+	if (connection_test_events == NULL || timeout_ms == 0) {
+		return connection_test_state;
+	}
+
+	/* Clear before checking, so a change between the check and the wait is not missed */
+	xEventGroupClearBits(connection_test_events, CONNECTION_TEST_CHANGED_BIT);
+	if (connection_test_state == known) {
+		xEventGroupWaitBits(connection_test_events, CONNECTION_TEST_CHANGED_BIT, pdTRUE, pdFALSE,
+				timeout_ms/portTICK_PERIOD_MS);
+	}
+
+	return connection_test_state;
+}
+
+void set_connection_test_listener(connection_test_listener_t listener, void *arg) {
+	if (listener_lock == NULL) {
+		listener_lock = xSemaphoreCreateMutexStatic(&listener_lock_buffer);
+	}
+
+	xSemaphoreTake(listener_lock, portMAX_DELAY);
+	connection_test_listener = listener;
+	connection_test_listener_arg = arg;
+	xSemaphoreGive(listener_lock);
+}
+
+const char *connection_test_state_name(connection_test_state_t state) {
+	switch (state) {
+	case	CONNECTION_TEST_IDLE:        return "idle";
+	case	CONNECTION_TEST_QUEUED:      return "queued";
+	case	CONNECTION_TEST_ASSOCIATING: return "associating";
+	case	CONNECTION_TEST_GOT_IP:      return "got-ip";
+	case	CONNECTION_TEST_FAILED:      return "failed";
+	}
+	return "unknown";
+}
+
 void identifty_network() {
 
 	identify_wifi_state_t state;
@@ -86,12 +370,10 @@ void identifty_network() {
 	state = SCAN;
 
 	while(1) {
+		timeline_record(TIMELINE_IDENTIFY_STEP, state);
 		switch(state) {
 		case	SCAN:
-			// Initialise WiFi
-			init_wifi();          //TODO: move this into other wifi functions?
-
-			// Scan for nearby APs
+			// Scan for nearby APs. Starts WiFi, or reuses it if a connect has already started it.
 			scan_aps();
 
 			state = SETUP_APSTA;
@@ -104,12 +386,95 @@ void identifty_network() {
 			state = IDENTIFY_NETWORK;
 			break;
 		case	IDENTIFY_NETWORK:
+			if (station_lock == NULL) {
+				station_lock = xSemaphoreCreateMutexStatic(&station_lock_buffer);
+			}
+
 			// Start webserver to allow for user interaction
-			captive_portal_init();
-			start_webserver();
+			captive_portal_start();
+			portal_server = start_webserver(PORTAL_SERVER_PROFILE);
+
+			// Keep the network list fresh while the user chooses
+			scanner_start(&portal_scanner_config);
 			return;
 		}
 	}
 
 }
 
+esp_err_t retry_saved_ap_in_portal() {
+	connection_test_state_t state = connection_test_state;
+	esp_err_t err;
+
+	// A test that has connected holds the station for the handover
+	if (state == CONNECTION_TEST_QUEUED || state == CONNECTION_TEST_ASSOCIATING || state == CONNECTION_TEST_GOT_IP ||
+			station_lock == NULL || xSemaphoreTake(station_lock, 0) != pdTRUE) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	scanner_pause();
+	err = connect_to_saved_ap();
+	scanner_resume();
+	xSemaphoreGive(station_lock);
+
+	return err;
+}
+
+esp_err_t end_provisioning() {
+	vTaskDelay(HANDOVER_GRACE_MS/portTICK_PERIOD_MS);
+
+	// Stop everything that serves the portal, in the reverse of the order it was started
+	esp_err_t scanner_err = scanner_stop();
+	stop_webserver(portal_server);
+	portal_server = NULL;
+	esp_err_t portal_err = captive_portal_stop();
+
+	// Not running is as good as stopped. A scanner that did not stop may still be writing the scan list.
+	if (scanner_err != ESP_OK && scanner_err != ESP_ERR_INVALID_STATE) {
+		ESP_LOGE(END_PROVISIONING_TAG, "Scanner did not stop, scan list kept: %s", esp_err_to_name(scanner_err));
+		return scanner_err;
+	}
+	scan_store_release();
+
+	if (portal_err != ESP_OK && portal_err != ESP_ERR_INVALID_STATE) {
+		ESP_LOGE(END_PROVISIONING_TAG, "DNS server did not stop: %s", esp_err_to_name(portal_err));
+		return portal_err;
+	}
+
+	// The station link made by the connection test is kept for the app
+	esp_err_t err = wifi_manager_release_ap();
+	if (err != ESP_OK) {
+		return err;
+	}
+
+	return get_connection_status() ? ESP_OK : ESP_ERR_WIFI_NOT_CONNECT;
+}
+
+uint32_t estimate_restart_cost_ms() {
+	timeline_entry_t entry;
+	uint32_t nvs_ready_ms = 0;
+	uint32_t connect_ms = 0;
+	uint32_t connect_start_ms = 0;
+	int count = timeline_count();
+
+	if (count == 0 || timeline_get(count - 1, &entry) != 0) {
+		return 0;
+	}
+	uint16_t boot = entry.boot;
+
+	// Boot up to NVS, then the last association and DHCP, as a restart repeats both
+	for (int i = 0; timeline_get(i, &entry) == 0; i++) {
+		if (entry.boot != boot) {
+			continue;
+		}
+		if (entry.event == TIMELINE_NVS_READY && nvs_ready_ms == 0) {
+			nvs_ready_ms = entry.time_ms;
+		} else if (entry.event == TIMELINE_CONNECT) {
+			connect_start_ms = entry.time_ms;
+		} else if (entry.event == TIMELINE_GOT_IP && connect_start_ms != 0) {
+			connect_ms = entry.time_ms - connect_start_ms;
+		}
+	}
+
+	return nvs_ready_ms + connect_ms;
+}
@@ -16,6 +16,8 @@
 #include <stdint.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
@@ -27,6 +29,9 @@
 #include "memory.h"
 #include "server.h"
 #include "captive_portal.h"
+#include "scanner.h"
+#include "cred_store.h"
+#include "timeline.h"
 
 /**
  * @brief Opportunity for user to reset device by clearing NVS
@@ -34,22 +39,95 @@
 void init();
 
 /**
- * @brief check if memory contains valid network details to connect
+ * @brief check if any networks are known. The credential store must be loaded.
  * @return true if network details exist. false otherwise.
  */
 bool valid_network_details_stored(bool verbose);
 
 /**
- * @brief Connect to ap whose details are stored in NVS
- * @return ESP_OK on successful connection. Error code otherwise.
+ * @brief Connect to the best known network in range. A quick scan finds which known networks
+ * are in range, and they are tried in turn, best ranked first. With only one network known, its
+ * last AP is tried directly before scanning.
+ * @return ESP_OK on successful connection.
+ *         ESP_ERR_WIFI_PASSWORD if the last network tried rejected its credentials. It is forgotten.
+ *         ESP_ERR_TIMEOUT if the last network tried could not be reached.
+ *         ESP_ERR_NOT_FOUND if no networks are known.
  */
 esp_err_t connect_to_saved_ap();
 
+/** Progress of a background connection test */
+typedef enum {
+	CONNECTION_TEST_IDLE = 0,
+	CONNECTION_TEST_QUEUED = 1,
+	CONNECTION_TEST_ASSOCIATING = 2,
+	CONNECTION_TEST_GOT_IP = 3,
+	CONNECTION_TEST_FAILED = 4
+} connection_test_state_t;
+
+/** Callback told about each change of the connection test state. Called from the task making the change. */
+typedef void (*connection_test_listener_t)(connection_test_state_t state, void *arg);
+
+/**
+ * @brief Start a background attempt to connect to a network. The network is added to the credential
+ * store if the attempt succeeds. Returns immediately - progress is read with wait_connection_test_state().
+ * @param ssid SSID of network
+ * @param pword Password of network. Empty for an open network.
+ * @return ESP_OK if a test was started. ESP_ERR_INVALID_STATE if one is already running.
+ */
+esp_err_t start_connection_test(const char *ssid, const char *pword);
+
+/**
+ * @brief Get the state of the connection test, waiting for it to change.
+ * @param known State the caller already knows about
+ * @param timeout_ms Maximum time to wait for the state to differ from known. 0 to return immediately.
+ * @return Current state
+ */
+connection_test_state_t wait_connection_test_state(connection_test_state_t known, uint32_t timeout_ms);
+
+/**
+ * @brief Set the listener told about connection test state changes. Replaces any previous listener.
+ * A test reaches CONNECTION_TEST_GOT_IP only once its network has been saved. Waits for a call
+ * to the previous listener to finish, so that once a listener is removed it is never called again.
+ * Must not be called from the listener.
+ * @param listener Callback, or NULL to remove the listener
+ * @param arg Argument passed to the callback
+ */
+void set_connection_test_listener(connection_test_listener_t listener, void *arg);
+
+/**
+ * @brief Get a short name for a connection test state, for use in the portal
+ */
+const char *connection_test_state_name(connection_test_state_t state);
+
 /**
  * @brief Allow for user to select network to connect to
  */
 void identifty_network();
 
+/**
+ * @brief Try the known networks again while the portal is open, in case they were only out of reach
+ * at boot. Skipped while a connection test is using the station, or has connected it.
+ * @return ESP_OK if connected to a known network - the portal can then be shut down as after a test.
+ *         ESP_ERR_INVALID_STATE if skipped. Otherwise as connect_to_saved_ap().
+ */
+esp_err_t retry_saved_ap_in_portal();
+
+/**
+ * @brief Shut down the portal started by identifty_network() and free what it used: the webserver,
+ * DNS server, background scanner, scan list and ESP32 AP. The station connection is kept.
+ * @return ESP_OK if the station is still connected. ESP_ERR_WIFI_NOT_CONNECT if it is not, or
+ *         an error from stopping the scanner or DNS server or switching off the AP. If the scanner
+ *         did not stop, the scan list is not freed.
+ */
+esp_err_t end_provisioning();
+
+/**
+ * @brief Estimate how long restarting and reconnecting would take, from this boot's timeline:
+ * the time to get as far as NVS, plus the time the last connection took.
+ * @return Estimate in ms. 0 if the timeline does not cover this boot.
+ */
+uint32_t estimate_restart_cost_ms();
+
 
 
 #endif /* MAIN_FIRST_BOOT_H_ */
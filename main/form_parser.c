@@ -0,0 +1,418 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Form Parser
+ * Incremental parser for the bodies of portal POST
+ * requests. Accepts application/x-www-form-urlencoded
+ * and flat JSON objects, fed in pieces as they are
+ * received, and decodes each value straight into a
+ * fixed-size buffer supplied by the caller.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <string.h>
+
+#include "form_parser.h"
+
+/* States of the urlencoded parser */
+enum {
+	URL_KEY = 0,
+	URL_VALUE
+};
+
+/* States of the JSON parser */
+enum {
+	JSON_START = 0,      /* Before the opening brace */
+	JSON_BEFORE_KEY,     /* After the opening brace or a comma */
+	JSON_KEY,            /* Inside a quoted name */
+	JSON_AFTER_KEY,      /* Expecting a colon */
+	JSON_BEFORE_VALUE,
+	JSON_STRING,         /* Inside a quoted value */
+	JSON_BARE,           /* Inside a number, true, false or null */
+	JSON_AFTER_VALUE,    /* Expecting a comma or the closing brace */
+	JSON_END
+};
+
+/*
+ * @brief Value of a hex digit
+ * @return 0-15, or -1 if c is not a hex digit
+ */
+static int hex_value(char c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+static bool is_json_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/*
+ * @brief Start a new name
+ */
+static void begin_key(form_parser_t *parser) {
+	parser->key_length = 0;
+	parser->key_overflow = false;
+}
+
+/*
+ * @brief Append a decoded byte to the current name. Names too long to match any field are
+ * marked rather than rejected, so that unknown fields are skipped.
+ */
+static void put_key(form_parser_t *parser, char c) {
+	if (parser->key_length < FORM_KEY_SIZE - 1) {
+		parser->key[parser->key_length++] = c;
+	} else {
+		parser->key_overflow = true;
+	}
+}
+
+/*
+ * @brief Select the field named by the current name as the destination of the value that follows
+ */
+static void begin_value(form_parser_t *parser) {
+	parser->current = NULL;
+	if (parser->key_overflow) {
+		return;
+	}
+	parser->key[parser->key_length] = '\0';
+
+	for (size_t i = 0; i < parser->count; i++) {
+		if (strcmp(parser->key, parser->fields[i].name) == 0) {
+			form_field_t *field = &parser->fields[i];
+
+			// A repeated field takes the last value given
+			field->length = 0;
+			field->value[0] = '\0';
+			field->present = true;
+			parser->current = field;
+			return;
+		}
+	}
+}
+
+/*
+ * @brief Append a decoded byte to the current value
+ * @return ESP_OK, or ESP_ERR_INVALID_SIZE if the value no longer fits in its field
+ */
+static esp_err_t put_value(form_parser_t *parser, char c) {
+	form_field_t *field = parser->current;
+
+	if (field == NULL) {
+		return ESP_OK;
+	}
+	if (field->length + 1 >= field->size) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	field->value[field->length++] = c;
+	field->value[field->length] = '\0';
+
+	return ESP_OK;
+}
+
+/*
+ * @brief Append a decoded byte to the current name or value
+ */
+static esp_err_t put_char(form_parser_t *parser, bool in_key, char c) {
+	if (in_key) {
+		put_key(parser, c);
+		return ESP_OK;
+	}
+	return put_value(parser, c);
+}
+
+/*
+ * @brief Append a code point from a \u escape as UTF-8
+ */
+static esp_err_t put_code_point(form_parser_t *parser, bool in_key, uint32_t cp) {
+	char utf8[3];
+	size_t len;
+	esp_err_t err;
+
+	// Surrogate pairs are not supported - WiFi credentials are expected to lie in the BMP
+	if (cp >= 0xD800 && cp <= 0xDFFF) {
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+
+	if (cp < 0x80) {
+		utf8[0] = cp;
+		len = 1;
+	} else if (cp < 0x800) {
+		utf8[0] = 0xC0 | (cp >> 6);
+		utf8[1] = 0x80 | (cp & 0x3F);
+		len = 2;
+	} else {
+		utf8[0] = 0xE0 | (cp >> 12);
+		utf8[1] = 0x80 | ((cp >> 6) & 0x3F);
+		utf8[2] = 0x80 | (cp & 0x3F);
+		len = 3;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		if ((err = put_char(parser, in_key, utf8[i])) != ESP_OK) {
+			return err;
+		}
+	}
+
+	return ESP_OK;
+}
+
+/*
+ * @brief Parse one byte of an application/x-www-form-urlencoded body
+ */
+static esp_err_t feed_urlencoded(form_parser_t *parser, char c) {
+	bool in_key = (parser->state == URL_KEY);
+
+	// Inside a %XX escape
+	if (parser->escape_digits > 0) {
+		int digit = hex_value(c);
+		if (digit < 0) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		parser->escape_value = (parser->escape_value << 4) | digit;
+		if (--parser->escape_digits > 0) {
+			return ESP_OK;
+		}
+		return put_char(parser, in_key, (char)parser->escape_value);
+	}
+
+	switch (c) {
+	case	'%':
+		parser->escape_digits = 2;
+		parser->escape_value = 0;
+		return ESP_OK;
+	case	'+':
+		return put_char(parser, in_key, ' ');
+	case	'=':
+		if (in_key) {
+			begin_value(parser);
+			parser->state = URL_VALUE;
+			return ESP_OK;
+		}
+		// '=' within a value is taken literally
+		return put_value(parser, c);
+	case	'&':
+		// A name with no '=' is a field with an empty value
+		if (in_key && parser->key_length > 0) {
+			begin_value(parser);
+		}
+		parser->current = NULL;
+		begin_key(parser);
+		parser->state = URL_KEY;
+		return ESP_OK;
+	default:
+		return put_char(parser, in_key, c);
+	}
+}
+
+/*
+ * @brief Parse one byte inside a JSON string, handling escapes
+ */
+static esp_err_t feed_json_string(form_parser_t *parser, char c, bool in_key) {
+	// Inside a \uXXXX escape
+	if (parser->escape_digits > 0 && parser->escape_digits <= 4) {
+		int digit = hex_value(c);
+		if (digit < 0) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		parser->escape_value = (parser->escape_value << 4) | digit;
+		if (--parser->escape_digits > 0) {
+			return ESP_OK;
+		}
+		return put_code_point(parser, in_key, parser->escape_value);
+	}
+
+	// After a backslash - marked by a digit count beyond that of any \u escape
+	if (parser->escape_digits > 4) {
+		parser->escape_digits = 0;
+		switch (c) {
+		case	'"':
+		case	'\\':
+		case	'/':
+			return put_char(parser, in_key, c);
+		case	'b':
+			return put_char(parser, in_key, '\b');
+		case	'f':
+			return put_char(parser, in_key, '\f');
+		case	'n':
+			return put_char(parser, in_key, '\n');
+		case	'r':
+			return put_char(parser, in_key, '\r');
+		case	't':
+			return put_char(parser, in_key, '\t');
+		case	'u':
+			parser->escape_digits = 4;
+			parser->escape_value = 0;
+			return ESP_OK;
+		default:
+			return ESP_ERR_INVALID_ARG;
+		}
+	}
+
+	if (c == '\\') {
+		parser->escape_digits = 5;
+		return ESP_OK;
+	}
+	if (c == '"') {
+		if (in_key) {
+			parser->state = JSON_AFTER_KEY;
+		} else {
+			parser->current = NULL;
+			parser->state = JSON_AFTER_VALUE;
+		}
+		return ESP_OK;
+	}
+	// Control characters must be escaped
+	if ((unsigned char)c < 0x20) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	return put_char(parser, in_key, c);
+}
+
+/*
+ * @brief Parse one byte of a flat JSON object body
+ */
+static esp_err_t feed_json(form_parser_t *parser, char c) {
+	switch (parser->state) {
+	case	JSON_START:
+		if (c == '{') {
+			parser->state = JSON_BEFORE_KEY;
+		} else if (!is_json_space(c)) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		return ESP_OK;
+
+	case	JSON_BEFORE_KEY:
+		if (c == '"') {
+			begin_key(parser);
+			parser->state = JSON_KEY;
+		} else if (c == '}') {
+			parser->state = JSON_END;
+		} else if (!is_json_space(c)) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		return ESP_OK;
+
+	case	JSON_KEY:
+		return feed_json_string(parser, c, true);
+
+	case	JSON_AFTER_KEY:
+		if (c == ':') {
+			begin_value(parser);
+			parser->state = JSON_BEFORE_VALUE;
+		} else if (!is_json_space(c)) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		return ESP_OK;
+
+	case	JSON_BEFORE_VALUE:
+		if (c == '"') {
+			parser->state = JSON_STRING;
+			return ESP_OK;
+		}
+		if (c == '{' || c == '[') {
+			return ESP_ERR_NOT_SUPPORTED;
+		}
+		if (c == ',' || c == '}' || c == ':') {
+			return ESP_ERR_INVALID_ARG;
+		}
+		if (is_json_space(c)) {
+			return ESP_OK;
+		}
+		// Numbers and literals are stored as their text
+		parser->state = JSON_BARE;
+		return put_value(parser, c);
+
+	case	JSON_STRING:
+		return feed_json_string(parser, c, false);
+
+	case	JSON_BARE:
+		if (c == ',' || c == '}' || is_json_space(c)) {
+			parser->current = NULL;
+			parser->state = JSON_AFTER_VALUE;
+			return feed_json(parser, c);
+		}
+		if (c == '{' || c == '[' || c == '"' || c == ':') {
+			return ESP_ERR_INVALID_ARG;
+		}
+		return put_value(parser, c);
+
+	case	JSON_AFTER_VALUE:
+		if (c == ',') {
+			parser->state = JSON_BEFORE_KEY;
+		} else if (c == '}') {
+			parser->state = JSON_END;
+		} else if (!is_json_space(c)) {
+			return ESP_ERR_INVALID_ARG;
+		}
+		return ESP_OK;
+
+	case	JSON_END:
+		return is_json_space(c) ? ESP_OK : ESP_ERR_INVALID_ARG;
+	}
+
+	return ESP_ERR_INVALID_ARG;
+}
+
+void form_parser_init(form_parser_t *parser, form_type_t type, form_field_t *fields, size_t count) {
+	memset(parser, 0, sizeof(form_parser_t));
+	parser->type = type;
+	parser->fields = fields;
+	parser->count = count;
+	parser->state = (type == FORM_JSON) ? JSON_START : URL_KEY;
+
+	for (size_t i = 0; i < count; i++) {
+		fields[i].length = 0;
+		fields[i].present = false;
+		if (fields[i].size > 0) {
+			fields[i].value[0] = '\0';
+		}
+	}
+}
+
+esp_err_t form_parser_feed(form_parser_t *parser, const char *data, size_t len) {
+	esp_err_t err;
+
+	for (size_t i = 0; i < len; i++) {
+		if (parser->type == FORM_JSON) {
+			err = feed_json(parser, data[i]);
+		} else {
+			err = feed_urlencoded(parser, data[i]);
+		}
+		if (err != ESP_OK) {
+			return err;
+		}
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t form_parser_finish(form_parser_t *parser) {
+	// Body ended part way through an escape
+	if (parser->escape_digits > 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	if (parser->type == FORM_JSON) {
+		return (parser->state == JSON_END) ? ESP_OK : ESP_ERR_INVALID_ARG;
+	}
+
+	// Trailing name with no '='
+	if (parser->state == URL_KEY && parser->key_length > 0) {
+		begin_value(parser);
+	}
+	parser->current = NULL;
+
+	return ESP_OK;
+}
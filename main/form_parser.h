@@ -0,0 +1,84 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Form Parser
+ * Incremental parser for the bodies of portal POST
+ * requests. Accepts application/x-www-form-urlencoded
+ * and flat JSON objects, fed in pieces as they are
+ * received, and decodes each value straight into a
+ * fixed-size buffer supplied by the caller.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MAIN_FORM_PARSER_H_
+#define MAIN_FORM_PARSER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/* Longest field name that can be matched. Longer names are skipped. */
+#define FORM_KEY_SIZE 32
+
+/** Encoding of the body being parsed */
+typedef enum {
+	FORM_URLENCODED = 0,
+	FORM_JSON = 1
+} form_type_t;
+
+/** A field the caller wants from the body */
+typedef struct {
+	const char *name;
+	char *value;       /* Output buffer - always null terminated */
+	size_t size;       /* Size of value, including the null terminator */
+	size_t length;     /* Decoded length of value */
+	bool present;      /* Set if the field appeared in the body */
+} form_field_t;
+
+/** Parser state. Fields are private to form_parser.c. */
+typedef struct {
+	form_type_t type;
+	form_field_t *fields;
+	size_t count;
+	form_field_t *current;     /* Field whose value is being decoded, NULL if skipping */
+	char key[FORM_KEY_SIZE];
+	size_t key_length;
+	bool key_overflow;
+	int state;
+	int escape_digits;         /* Hex digits still expected in a %XX or \uXXXX escape */
+	uint32_t escape_value;
+} form_parser_t;
+
+/**
+ * @brief Prepare a parser for a new body.
+ * @param parser Parser to initialise
+ * @param type Encoding of the body
+ * @param fields Fields to extract. Values are cleared.
+ * @param count Number of fields
+ */
+void form_parser_init(form_parser_t *parser, form_type_t type, form_field_t *fields, size_t count);
+
+/**
+ * @brief Parse the next piece of the body.
+ * @param parser Parser
+ * @param data Piece of body. Need not be null terminated.
+ * @param len Length of data
+ * @return ESP_OK on success.
+ *         ESP_ERR_INVALID_SIZE if a value is longer than its field allows.
+ *         ESP_ERR_INVALID_ARG if the body is malformed.
+ *         ESP_ERR_NOT_SUPPORTED if a JSON body holds nested values.
+ */
+esp_err_t form_parser_feed(form_parser_t *parser, const char *data, size_t len);
+
+/**
+ * @brief Complete parsing once the whole body has been fed.
+ * @param parser Parser
+ * @return ESP_OK if the body ended cleanly. ESP_ERR_INVALID_ARG otherwise.
+ */
+esp_err_t form_parser_finish(form_parser_t *parser);
+
+#endif /* MAIN_FORM_PARSER_H_ */
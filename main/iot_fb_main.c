@@ -29,6 +29,7 @@
 #include "esp_event.h"
 #include "esp_http_server.h"
 #include "esp_http_client.h"
+#include "esp_timer.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "nvs.h"
@@ -43,11 +44,24 @@
 #include "server.h"
 #include "first_boot.h"
 #include "captive_portal.h"
+#include "app_events.h"
+#include "timeline.h"
 
 #include "example_secondary_app.h"
 
 #define FIRST_BOOT_NAMESPACE "first_boot"
 
+/* Pause before trying an unreachable AP again */
+#define STA_RETRY_DELAY_MS 30000
+
+/* Rounds of CONNECT_AS_STA that reach no known network before the portal is opened, so that a
+ * device moved to a new site can be given a new network. The known networks are kept. */
+#define STA_ROUNDS_BEFORE_PORTAL 3
+
+/* Pause between retries of the known networks while the portal is open. Longer than
+ * STA_RETRY_DELAY_MS, as each retry takes the radio away from the portal's clients. */
+#define PORTAL_RETRY_DELAY_MS 120000
+
 /* Program runs as a state machine with the below functions */
 typedef enum {
 	INIT = 0,
@@ -55,7 +69,8 @@ typedef enum {
 	IDENTIFY_NET = 2,
 	WAIT_FOR_DETAILS = 3,
 	RESTART_DEVICE = 4,
-	LAUNCH_APP = 5
+	LAUNCH_APP = 5,
+	HANDOVER = 6
 } top_level_state_t;
 
 typedef	void (*app_func_pt_t)(void);
@@ -66,10 +81,19 @@ app_func_pt_t     pt2secondaryAPP = log_to_thingspeak;
 /* The function app_main is called by ESP32 on boot */
 void app_main(void) {
 	top_level_state_t state;
+	esp_err_t err;
+	app_event_t event;
+	size_t heap_before;
+	int64_t start;
+	int64_t next_retry;
+	int failed_rounds = 0;
 
+	timeline_init();
 	state = INIT;
+	app_events_init();
 
 	while(1) {
+		timeline_record(TIMELINE_STATE, state);
 
 		switch(state) {
 		/* Gives option to erase ESP32 memory on boot.
@@ -79,41 +103,88 @@ void app_main(void) {
 			ESP_LOGI("STATE", "INIT");
 			init();
 			init_memory(FIRST_BOOT_NAMESPACE);
+			timeline_record(TIMELINE_NVS_READY, 0);
+			cred_store_load();
 			if ( valid_network_details_stored(true) == true) {
 				state = CONNECT_AS_STA;
 			} else {
 				state = IDENTIFY_NET;
 			}
 			break;
-			/* Attempt to connect to the last WiFi network used. If unsuccessful, start
-			 * first boot application in IDENTIFY_NET state */
+			/* Attempt to connect to the best known WiFi network in range. Networks whose AP rejects
+			 * the stored details are forgotten. If none are left, start first boot application in
+			 * IDENTIFY_NET state. If no known network can be reached, keep the details and try again
+			 * later, opening the portal alongside after STA_ROUNDS_BEFORE_PORTAL rounds. */
 		case	CONNECT_AS_STA:
 			ESP_LOGI("STATE", "CONNECT_AS_STA");
-			if ( connect_to_saved_ap() == ESP_OK) {
+			err = connect_to_saved_ap();
+			if (err == ESP_OK) {
 				state = LAUNCH_APP;
 			}
-			else {
-				ESP_LOGE("Connection to STA", "Connection failed. Erasing stored network details.");
-				clear_namespace();  // Clear incorrect network details
+			else if (valid_network_details_stored(false) == false) {
+				ESP_LOGE("Connection to STA", "No known networks left.");
 				state = IDENTIFY_NET;
-				break;
 			}
-			ESP_LOGI("Connection to STA", "Passed through 'if' statement");
+			else if (++failed_rounds >= STA_ROUNDS_BEFORE_PORTAL) {
+				// The networks may be gone for good - let the user give a new one, and keep trying the old
+				ESP_LOGW("Connection to STA", "No known network reachable after %d rounds. Opening the portal.",
+						failed_rounds);
+				state = IDENTIFY_NET;
+			}
+			else {
+				// APs may only be out of reach for now - keep the details and try again
+				ESP_LOGW("Connection to STA", "No known network reachable. Retrying in %d s.", STA_RETRY_DELAY_MS/1000);
+				vTaskDelay(STA_RETRY_DELAY_MS/portTICK_PERIOD_MS);
+			}
 			break;
-			/* Run first boot application to identify network to connect.
-			 * Waits in loop, checking every 100ms if network has been selected. */
+			/* Run first boot application to identify network to connect. */
 		case	IDENTIFY_NET:
 			ESP_LOGI("STATE", "IDENTIFY_NET");
 			identifty_network();
 			state = WAIT_FOR_DETAILS;
 			break;
-			/* Wait for user to input details of network to be connected to. */
+			/* Wait for user to input details of network to be connected to.
+			 * Sleeps until the portal posts an event, rather than polling. Any known networks
+			 * are retried every PORTAL_RETRY_DELAY_MS, and the portal is ended if one is reached. */
 		case    WAIT_FOR_DETAILS:
 			ESP_LOGI("STATE", "WAIT_FOR_DETAILS");
-			while (get_user_informed() == 0) {
-				vTaskDelay(300/portTICK_PERIOD_MS);
+			next_retry = esp_timer_get_time() + (int64_t)PORTAL_RETRY_DELAY_MS * 1000;
+			while (1) {
+				int64_t wait_ms = (next_retry - esp_timer_get_time()) / 1000;
+				bool retrying = valid_network_details_stored(false);
+
+				err = app_events_wait(&event, !retrying ? APP_EVENTS_WAIT_FOREVER : (wait_ms > 0) ? wait_ms : 0);
+				if (err == ESP_OK) {
+					ESP_LOGI("WAIT_FOR_DETAILS", "Event %d (%d)", event.type, (int)event.data);
+					if (event.type == APP_EVENT_USER_INFORMED) {
+						break;
+					}
+				} else if (retry_saved_ap_in_portal() == ESP_OK) {
+					ESP_LOGI("WAIT_FOR_DETAILS", "Known network is back");
+					break;
+				} else {
+					next_retry = esp_timer_get_time() + (int64_t)PORTAL_RETRY_DELAY_MS * 1000;
+				}
+			}
+			state = HANDOVER;
+			break;
+			/* Shut the portal down and hand the connection made by the connection test to the app,
+			 * saving a restart. If the connection was lost, restart instead. */
+		case	HANDOVER:
+			ESP_LOGI("STATE", "HANDOVER");
+			heap_before = esp_get_free_heap_size();
+			start = esp_timer_get_time();
+			err = end_provisioning();
+			if (err == ESP_OK) {
+				int handover_ms = (esp_timer_get_time() - start) / 1000;
+				ESP_LOGI("HANDOVER", "Freed %d bytes of heap in %d ms. Saved about %d ms over a restart.",
+						(int)esp_get_free_heap_size() - (int)heap_before, handover_ms,
+						(int)estimate_restart_cost_ms() - handover_ms);
+				state = LAUNCH_APP;
+			} else {
+				ESP_LOGE("HANDOVER", "Could not keep connection: %s", esp_err_to_name(err));
+				state = RESTART_DEVICE;
 			}
-			state = RESTART_DEVICE;
 			break;
 		case    RESTART_DEVICE:
 			ESP_LOGI("STATE", "RESTART_DEVICE");
@@ -124,6 +195,7 @@ void app_main(void) {
 		case	LAUNCH_APP:
 			ESP_LOGI("STATE", "LAUNCH_APP");
 			deinit_memory();
+			timeline_dump();
 
 			(*pt2secondaryAPP)();
 			// should never get here!
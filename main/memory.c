@@ -116,6 +116,37 @@ esp_err_t write_uint8(char *key, uint8_t value) {
 	return err;
 }
 
+esp_err_t read_blob(char *key, void *value, size_t *length) {
+	esp_err_t err = nvs_get_blob(MEMORY_HANDLE, key, value, length);
+
+	if (err != ESP_OK) handle_err("read_blob", err);
+	else ESP_LOGI("read_blob", "Got %u bytes for %s", (unsigned)*length, key);
+
+	return err;
+}
+
+esp_err_t write_blob(char *key, const void *value, size_t length) {
+	esp_err_t err = nvs_set_blob(MEMORY_HANDLE, key, value, length);
+
+	if (err != ESP_OK) handle_err("write_blob", err);
+	else ESP_LOGI("write_blob", "Wrote %u bytes to %s", (unsigned)length, key);
+
+	nvs_commit(MEMORY_HANDLE);
+
+	return err;
+}
+
+esp_err_t erase_key(char *key) {
+	esp_err_t err = nvs_erase_key(MEMORY_HANDLE, key);
+
+	if (err != ESP_OK) handle_err("erase_key", err);
+	else ESP_LOGI("erase_key", "Erased %s", key);
+
+	nvs_commit(MEMORY_HANDLE);
+
+	return err;
+}
+
 void clear_namespace() {
 	esp_err_t err = nvs_erase_all(MEMORY_HANDLE);
 	ESP_LOGI("clear_namespace", "Partition erased with error code: %s", esp_err_to_name(err));
@@ -92,6 +92,31 @@ esp_err_t read_uint8(char *key, uint8_t *value);
  */
 esp_err_t write_uint8(char *key, uint8_t value);
 
+/**
+ * @brief Read a blob from memory.
+ * @param key Key for blob
+ * @param value Output buffer, or NULL to get the size only
+ * @param length Size of value. Output length of blob.
+ * @return ESP_OK on success
+ */
+esp_err_t read_blob(char *key, void *value, size_t *length);
+
+/**
+ * @brief Write a blob to memory.
+ * @param key Key for blob
+ * @param value Blob to be written
+ * @param length Length of blob
+ * @return ESP_OK on success
+ */
+esp_err_t write_blob(char *key, const void *value, size_t length);
+
+/**
+ * @brief Erase a key from memory.
+ * @param key Key to be erased
+ * @return ESP_OK on success. ESP_ERR_NVS_NOT_FOUND if the key does not exist.
+ */
+esp_err_t erase_key(char *key);
+
 /**
  * @brief Clear memory in a specified namespace
  */
@@ -0,0 +1,335 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Scan Store
+ * Fixed-capacity list of the networks found by a WiFi
+ * scan. Holds one entry per SSID - the strongest BSSID
+ * seen - sorted by signal strength. Storage is
+ * allocated once and reused for every scan, and
+ * single-channel scans can be merged in.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_wifi.h"
+#include "esp_log.h"
+
+#include "scan_store.h"
+
+#define SCAN_STORE_TAG "scan_store"
+
+/* Size of the SSID hash index. Power of two, at least twice the capacity. */
+#define HASH_INDEX_SIZE 64
+#define HASH_INDEX_EMPTY 0xFF
+
+/* Channel scans in a row a network may be missing from before it is removed */
+#define SCAN_STORE_MAX_MISSES 2
+
+/* A network and the bookkeeping used to merge scans into it */
+typedef struct {
+	ap_details_t ap;
+	uint32_t hash;       /* Hash of ap.ssid */
+	uint8_t misses;      /* Scans of its channel since it was last seen */
+	bool seen;           /* Seen in the scan being merged */
+} store_entry_t;
+
+/* Entries, sorted strongest first */
+static store_entry_t *entries;
+static int entry_count;
+static uint32_t generation;
+
+/* Records fetched from the driver. Kept between scans to avoid reallocating. */
+static wifi_ap_record_t *records;
+
+/* Guards entries against readers in other tasks while an update is in progress */
+static SemaphoreHandle_t store_lock;
+static StaticSemaphore_t store_lock_buffer;
+
+/*
+ * @brief FNV-1a hash of an SSID
+ */
+static uint32_t ssid_hash(const char *ssid) {
+	uint32_t hash = 2166136261u;
+
+	for (const uint8_t *c = (const uint8_t *)ssid; *c; c++) {
+		hash ^= *c;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*
+ * @brief Index the current entries by SSID hash
+ */
+static void build_index(uint8_t *index) {
+	memset(index, HASH_INDEX_EMPTY, HASH_INDEX_SIZE);
+
+	for (int i = 0; i < entry_count; i++) {
+		uint32_t slot = entries[i].hash & (HASH_INDEX_SIZE - 1);
+		while (index[slot] != HASH_INDEX_EMPTY) {
+			slot = (slot + 1) & (HASH_INDEX_SIZE - 1);
+		}
+		index[slot] = i;
+	}
+}
+
+/*
+ * @brief Copy the details of a scan record into a network
+ */
+static void set_from_record(ap_details_t *ap, const wifi_ap_record_t *record) {
+	memcpy(ap->bssid, record->bssid, sizeof(ap->bssid));
+	ap->authmode = record->authmode;
+	ap->rssi = record->rssi;
+	ap->channel = record->primary;
+}
+
+/*
+ * @brief Merge a scan record into the entries
+ * @param index Hash index of the entries
+ * @return true if the list of networks changed, false if only signal details did
+ */
+static bool merge_record(uint8_t *index, const wifi_ap_record_t *record) {
+	const char *ssid = (const char *)record->ssid;
+	uint32_t hash = ssid_hash(ssid);
+	uint32_t slot = hash & (HASH_INDEX_SIZE - 1);
+
+	// Linear probe for an entry with the same SSID, or a free slot
+	while (index[slot] != HASH_INDEX_EMPTY) {
+		store_entry_t *entry = &entries[index[slot]];
+
+		if (entry->hash == hash && strcmp(entry->ap.ssid, ssid) == 0) {
+			bool changed = (entry->ap.authmode != record->authmode);
+
+			// Same network seen through another BSSID - keep the strongest. A BSSID seen
+			// earlier in this scan beats a stronger reading left over from a previous one.
+			if (!entry->seen || record->rssi > entry->ap.rssi ||
+					memcmp(entry->ap.bssid, record->bssid, sizeof(entry->ap.bssid)) == 0) {
+				set_from_record(&entry->ap, record);
+			}
+			entry->seen = true;
+			entry->misses = 0;
+			return changed;
+		}
+		slot = (slot + 1) & (HASH_INDEX_SIZE - 1);
+	}
+
+	if (entry_count == SCAN_STORE_CAPACITY) {
+		return false;
+	}
+
+	store_entry_t *entry = &entries[entry_count];
+	memcpy(entry->ap.ssid, record->ssid, sizeof(entry->ap.ssid));
+	entry->ap.ssid[sizeof(entry->ap.ssid) - 1] = '\0';
+	set_from_record(&entry->ap, record);
+	entry->hash = hash;
+	entry->misses = 0;
+	entry->seen = true;
+
+	index[slot] = entry_count;
+	entry_count++;
+
+	return true;
+}
+
+/*
+ * @brief Sort entries strongest first. Insertion sort, as the list is short.
+ */
+static void sort_entries() {
+	for (int i = 1; i < entry_count; i++) {
+		store_entry_t entry = entries[i];
+		int j = i - 1;
+
+		while (j >= 0 && entries[j].ap.rssi < entry.ap.rssi) {
+			entries[j + 1] = entries[j];
+			j--;
+		}
+		entries[j + 1] = entry;
+	}
+}
+
+/*
+ * @brief Fetch the records of the scan that has just completed from the driver
+ * @param number Output number of records
+ */
+static esp_err_t fetch_records(uint16_t *number) {
+	*number = SCAN_STORE_CAPACITY;
+
+	// Always fetch, so that the driver frees its list even if it is empty
+	esp_err_t err = esp_wifi_scan_get_ap_records(number, records);
+	if (err != ESP_OK) {
+		ESP_LOGE(SCAN_STORE_TAG, "Could not get scan records: %s", esp_err_to_name(err));
+	}
+
+	return err;
+}
+
+esp_err_t scan_store_init() {
+	if (store_lock == NULL) {
+		store_lock = xSemaphoreCreateMutexStatic(&store_lock_buffer);
+	}
+
+	if (entries != NULL) {
+		return ESP_OK;
+	}
+
+	entries = calloc(SCAN_STORE_CAPACITY, sizeof(store_entry_t));
+	records = malloc(SCAN_STORE_CAPACITY * sizeof(wifi_ap_record_t));
+	if (entries == NULL || records == NULL) {
+		scan_store_release();
+		return ESP_ERR_NO_MEM;
+	}
+
+	return ESP_OK;
+}
+
+void scan_store_release() {
+	if (store_lock == NULL) {
+		return;
+	}
+
+	xSemaphoreTake(store_lock, portMAX_DELAY);
+	free(entries);
+	free(records);
+	entries = NULL;
+	records = NULL;
+	entry_count = 0;
+	generation++;
+	xSemaphoreGive(store_lock);
+}
+
+esp_err_t scan_store_update() {
+	uint8_t index[HASH_INDEX_SIZE];
+	uint16_t number;
+
+	if (entries == NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	esp_err_t err = fetch_records(&number);
+	if (err != ESP_OK) {
+		return err;
+	}
+
+	xSemaphoreTake(store_lock, portMAX_DELAY);
+	entry_count = 0;
+	build_index(index);
+	for (int i = 0; i < number; i++) {
+		if (records[i].ssid[0] != '\0') {
+			merge_record(index, &records[i]);
+		}
+	}
+	sort_entries();
+	generation++;
+	xSemaphoreGive(store_lock);
+
+	ESP_LOGI(SCAN_STORE_TAG, "%d records, %d networks", number, entry_count);
+
+	return ESP_OK;
+}
+
+esp_err_t scan_store_merge_channel(uint8_t channel) {
+	uint8_t index[HASH_INDEX_SIZE];
+	uint16_t number;
+	bool changed = false;
+
+	if (entries == NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	esp_err_t err = fetch_records(&number);
+	if (err != ESP_OK) {
+		return err;
+	}
+
+	xSemaphoreTake(store_lock, portMAX_DELAY);
+	for (int i = 0; i < entry_count; i++) {
+		entries[i].seen = false;
+	}
+	build_index(index);
+	for (int i = 0; i < number; i++) {
+		if (records[i].ssid[0] != '\0' && merge_record(index, &records[i])) {
+			changed = true;
+		}
+	}
+
+	// Age out networks on this channel that have not been heard for a while
+	int count = 0;
+	for (int i = 0; i < entry_count; i++) {
+		store_entry_t *entry = &entries[i];
+
+		if (!entry->seen && entry->ap.channel == channel && ++entry->misses >= SCAN_STORE_MAX_MISSES) {
+			changed = true;
+			continue;
+		}
+		entries[count++] = *entry;
+	}
+	entry_count = count;
+
+	// Networks keep their place, and so their index, until the list itself changes
+	if (changed) {
+		sort_entries();
+		generation++;
+	}
+	xSemaphoreGive(store_lock);
+
+	if (changed) {
+		ESP_LOGI(SCAN_STORE_TAG, "Channel %u: %d records, %d networks", channel, number, entry_count);
+	}
+
+	return ESP_OK;
+}
+
+int scan_store_count() {
+	return entry_count;
+}
+
+esp_err_t scan_store_get(int index, ap_details_t *out) {
+	esp_err_t err = ESP_ERR_INVALID_ARG;
+
+	memset(out, 0, sizeof(ap_details_t));
+	if (store_lock == NULL) {
+		return err;
+	}
+
+	xSemaphoreTake(store_lock, portMAX_DELAY);
+	if (index >= 0 && index < entry_count) {
+		*out = entries[index].ap;
+		err = ESP_OK;
+	}
+	xSemaphoreGive(store_lock);
+
+	return err;
+}
+
+esp_err_t scan_store_find(const char *ssid, ap_details_t *out) {
+	esp_err_t err = ESP_ERR_NOT_FOUND;
+
+	memset(out, 0, sizeof(ap_details_t));
+	if (store_lock == NULL) {
+		return err;
+	}
+
+	xSemaphoreTake(store_lock, portMAX_DELAY);
+	for (int i = 0; i < entry_count && err != ESP_OK; i++) {
+		if (strcmp(entries[i].ap.ssid, ssid) == 0) {
+			*out = entries[i].ap;
+			err = ESP_OK;
+		}
+	}
+	xSemaphoreGive(store_lock);
+
+	return err;
+}
+
+uint32_t scan_store_generation() {
+	return generation;
+}
@@ -0,0 +1,90 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Scan Store
+ * Fixed-capacity list of the networks found by a WiFi
+ * scan. Holds one entry per SSID - the strongest BSSID
+ * seen - sorted by signal strength. Storage is
+ * allocated once and reused for every scan, and
+ * single-channel scans can be merged in.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MAIN_SCAN_STORE_H_
+#define MAIN_SCAN_STORE_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_wifi_types.h"
+
+/* Maximum number of scan records taken from the driver, and of networks held */
+#define SCAN_STORE_CAPACITY 32
+
+/** Struct to hold info about scanned APs */
+typedef struct {
+	char ssid[33];
+	uint8_t bssid[6];    /* Strongest BSSID seen for this SSID */
+	int authmode;
+	int8_t rssi;
+	uint8_t channel;
+} ap_details_t;
+
+/**
+ * @brief Allocate the store. Does nothing if it is already allocated.
+ * @return ESP_OK on success. ESP_ERR_NO_MEM if storage could not be allocated.
+ */
+esp_err_t scan_store_init();
+
+/**
+ * @brief Free the store. Entries read afterwards are empty.
+ */
+void scan_store_release();
+
+/**
+ * @brief Replace the contents of the store with the results of the scan that has just completed.
+ * Fetches the records from the WiFi driver, which frees its own copy. Networks with hidden SSIDs are
+ * skipped. Entries sharing an SSID are merged, keeping the strongest.
+ * @return ESP_OK on success. ESP_ERR_INVALID_STATE if the store is not allocated.
+ */
+esp_err_t scan_store_update();
+
+/**
+ * @brief Merge the results of a scan of a single channel into the store.
+ * New networks are added and known ones refreshed. Networks on that channel missing from
+ * several scans in a row are removed. The generation only changes, and networks only move,
+ * if a network was added or removed, or its auth mode changed.
+ * @param channel Channel that was scanned
+ * @return ESP_OK on success. ESP_ERR_INVALID_STATE if the store is not allocated.
+ */
+esp_err_t scan_store_merge_channel(uint8_t channel);
+
+/**
+ * @brief Get the number of networks held
+ */
+int scan_store_count();
+
+/**
+ * @brief Get a network. Networks are ordered strongest first.
+ * @param index Index of network
+ * @param out Copy of network. Zeroed if index is out of range.
+ * @return ESP_OK on success. ESP_ERR_INVALID_ARG if index is out of range.
+ */
+esp_err_t scan_store_get(int index, ap_details_t *out);
+
+/**
+ * @brief Find a network by SSID
+ * @param ssid SSID of network
+ * @param out Copy of network. Zeroed if it is not held.
+ * @return ESP_OK on success. ESP_ERR_NOT_FOUND if no network has that SSID.
+ */
+esp_err_t scan_store_find(const char *ssid, ap_details_t *out);
+
+/**
+ * @brief Get the number of updates made to the store. Changes whenever the network list changes.
+ */
+uint32_t scan_store_generation();
+
+#endif /* MAIN_SCAN_STORE_H_ */
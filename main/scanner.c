@@ -0,0 +1,175 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Scanner
+ * Background task that keeps the scan list current
+ * while the portal is running. Channels are scanned a
+ * few at a time, with pauses in between for the AP to
+ * serve its clients, and merged into the scan store.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_wifi.h"
+#include "esp_log.h"
+
+#include "scanner.h"
+#include "wifi.h"
+
+/* Scanning blocks on the driver, so needs little stack. Runs below the DNS server. */
+#define SCANNER_STACK_SIZE 2048
+#define SCANNER_PRIORITY 2
+#define SCANNER_STOP_TIMEOUT_MS 3000
+#define SCANNER_REAP_POLL_MS 10
+
+/* Shortest useful time on a channel - enough for a probe response */
+#define SCANNER_MIN_DWELL_MS 20
+
+#define SCANNER_STOP_BIT BIT0
+
+#define SCANNER_TAG "scanner"
+
+static scanner_config_t scanner_config;
+
+/* Time on each channel, worked out from the config when the scanner starts */
+static uint32_t dwell_ms;
+
+static TaskHandle_t task;
+static StaticTask_t task_buffer;
+static StackType_t task_stack[SCANNER_STACK_SIZE];
+
+static EventGroupHandle_t scanner_events;
+static StaticEventGroup_t scanner_events_buffer;
+static SemaphoreHandle_t stopped;
+static StaticSemaphore_t stopped_buffer;
+
+/* Held for the duration of each slice, so that pausing can wait for one to finish */
+static SemaphoreHandle_t slice_lock;
+static StaticSemaphore_t slice_lock_buffer;
+static volatile bool paused;
+
+/*
+ * @brief Scan one slice of channels, starting at *channel. Moves *channel on past the slice.
+ */
+static void scan_slice(uint8_t *channel, uint8_t first, uint8_t last) {
+	for (int i = 0; i < scanner_config.channels_per_slice; i++) {
+		esp_err_t err = scan_channel(*channel, dwell_ms);
+		if (err != ESP_OK) {
+			ESP_LOGW(SCANNER_TAG, "Scan of channel %u failed: %s", *channel, esp_err_to_name(err));
+		}
+		*channel = (*channel >= last) ? first : *channel + 1;
+	}
+}
+
+static void scanner_task(void *pvParameters) {
+	wifi_country_t country;
+	uint8_t first = 1;
+	uint8_t last = 11;
+
+	// Only channels allowed in the configured country are scanned
+	if (esp_wifi_get_country(&country) == ESP_OK && country.nchan > 0) {
+		first = country.schan;
+		last = country.schan + country.nchan - 1;
+	}
+	uint8_t channel = first;
+
+	while ((xEventGroupWaitBits(scanner_events, SCANNER_STOP_BIT, pdFALSE, pdFALSE,
+			scanner_config.slice_interval_ms/portTICK_PERIOD_MS) & SCANNER_STOP_BIT) == 0) {
+		xSemaphoreTake(slice_lock, portMAX_DELAY);
+		if (!paused) {
+			scan_slice(&channel, first, last);
+		}
+		xSemaphoreGive(slice_lock);
+	}
+
+	xSemaphoreGive(stopped);
+	vTaskDelete(NULL);
+}
+
+/*
+ * @brief Wait for the task to finish deleting itself. It signals that it has stopped just
+ * before it deletes itself, and its stack and TCB must not be reused until it has gone.
+ */
+static void reap_task() {
+	while (eTaskGetState(task) != eDeleted) {
+		vTaskDelay(SCANNER_REAP_POLL_MS/portTICK_PERIOD_MS);
+	}
+	task = NULL;
+}
+
+esp_err_t scanner_start(const scanner_config_t *config) {
+	if (task != NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	if (config->slice_off_channel_ms < SCANNER_MIN_DWELL_MS) {
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// A slice that cannot give each channel SCANNER_MIN_DWELL_MS scans fewer channels, so that it
+	// never spends longer than slice_off_channel_ms away from the AP's channel
+	scanner_config = *config;
+	if (scanner_config.channels_per_slice == 0) {
+		scanner_config.channels_per_slice = 1;
+	}
+	if (scanner_config.channels_per_slice > scanner_config.slice_off_channel_ms / SCANNER_MIN_DWELL_MS) {
+		scanner_config.channels_per_slice = scanner_config.slice_off_channel_ms / SCANNER_MIN_DWELL_MS;
+	}
+	dwell_ms = scanner_config.slice_off_channel_ms / scanner_config.channels_per_slice;
+
+	if (scanner_events == NULL) {
+		scanner_events = xEventGroupCreateStatic(&scanner_events_buffer);
+		stopped = xSemaphoreCreateBinaryStatic(&stopped_buffer);
+		slice_lock = xSemaphoreCreateMutexStatic(&slice_lock_buffer);
+	}
+	xEventGroupClearBits(scanner_events, SCANNER_STOP_BIT);
+	paused = false;
+
+	task = xTaskCreateStatic(scanner_task, "scanner_task", SCANNER_STACK_SIZE,
+			NULL, SCANNER_PRIORITY, task_stack, &task_buffer);
+
+	ESP_LOGI(SCANNER_TAG, "Started: %u channels per slice, %u ms each, every %u ms",
+			scanner_config.channels_per_slice, dwell_ms, scanner_config.slice_interval_ms);
+
+	return ESP_OK;
+}
+
+esp_err_t scanner_stop() {
+	if (task == NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	xEventGroupSetBits(scanner_events, SCANNER_STOP_BIT);
+
+	if (xSemaphoreTake(stopped, SCANNER_STOP_TIMEOUT_MS/portTICK_PERIOD_MS) != pdTRUE) {
+		ESP_LOGE(SCANNER_TAG, "Scanner did not stop");
+		return ESP_ERR_TIMEOUT;
+	}
+	reap_task();
+
+	ESP_LOGI(SCANNER_TAG, "Stopped");
+
+	return ESP_OK;
+}
+
+void scanner_pause() {
+	paused = true;
+
+	// Wait out any slice already under way
+	if (slice_lock != NULL) {
+		xSemaphoreTake(slice_lock, portMAX_DELAY);
+		xSemaphoreGive(slice_lock);
+	}
+}
+
+void scanner_resume() {
+	paused = false;
+}
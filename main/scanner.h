@@ -0,0 +1,59 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Scanner
+ * Background task that keeps the scan list current
+ * while the portal is running. Channels are scanned a
+ * few at a time, with pauses in between for the AP to
+ * serve its clients, and merged into the scan store.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MAIN_SCANNER_H_
+#define MAIN_SCANNER_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/** How the background scanner shares the radio with the AP */
+typedef struct {
+	uint8_t channels_per_slice;      /* Channels scanned back to back in each slice. Fewer if they do not fit in slice_off_channel_ms. */
+	uint16_t slice_off_channel_ms;   /* Longest the radio may spend away from the AP's channel in one slice */
+	uint32_t slice_interval_ms;      /* Pause between slices */
+} scanner_config_t;
+
+#define SCANNER_CONFIG_DEFAULT() {  \
+	.channels_per_slice = 2,        \
+	.slice_off_channel_ms = 120,    \
+	.slice_interval_ms = 2000       \
+}
+
+/**
+ * @brief Start the background scanner. WiFi must be running in APSTA mode.
+ * The scan list generation changes whenever a slice adds or removes a network.
+ * @param config Scanner settings
+ * @return ESP_OK on success. ESP_ERR_INVALID_STATE if already running.
+ *         ESP_ERR_INVALID_ARG if slice_off_channel_ms is too short to scan even one channel.
+ */
+esp_err_t scanner_start(const scanner_config_t *config);
+
+/**
+ * @brief Stop the background scanner, waiting for any slice in progress to finish.
+ * @return ESP_OK on success. ESP_ERR_INVALID_STATE if not running.
+ */
+esp_err_t scanner_stop();
+
+/**
+ * @brief Hold off scanning, for example while the station connects. Waits for any slice in progress.
+ */
+void scanner_pause();
+
+/**
+ * @brief Carry on scanning after scanner_pause().
+ */
+void scanner_resume();
+
+#endif /* MAIN_SCANNER_H_ */
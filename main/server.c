@@ -11,8 +11,88 @@
  * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "server.h"
+#include "assets.h"
+#include "form_parser.h"
+#include "captive_portal.h"
+#include "app_events.h"
+#include "timeline.h"
 
-int USER_INFORMED;
+/* Largest form body accepted by the POST endpoints */
+#define FORM_BODY_SIZE 1024
+
+/* Bytes of a form body received at a time */
+#define FORM_CHUNK_SIZE 64
+
+/* Worst case JSON size of one AP in the scan list */
+#define SCAN_JSON_ENTRY_SIZE (6*SSID_SIZE + 80)
+
+/* HTML size of one AP button, apart from its SSID, which is both its value and its label */
+#define SCAN_HTML_ENTRY_SIZE 64
+
+/* Rendered template content is sent in chunks of up to this size */
+#define TEMPLATE_CHUNK_SIZE 512
+
+/* Longest a status request may wait for the connection test to change state. The waiting request
+ * holds the single httpd worker, so other clients are served up to this much later. Only pages
+ * without /ws long-poll, and the window is kept under the shortest profile timeout so that the
+ * requests queued behind it are not timed out. */
+#define STATUS_MAX_WAIT_MS 2000
+
+/* Large enough for a short list of ETags */
+#define IF_NONE_MATCH_SIZE 64
+
+/* Accept-Encoding header kept. Browsers send well under this, and a longer one is still searched for gzip. */
+#define ACCEPT_ENCODING_SIZE 64
+
+/* Open WebSocket connections that receive pushed events - two pages per station */
+#define WS_MAX_CLIENTS (2*MAX_STA_CONN)
+
+/* Largest frame accepted from a WebSocket client. Clients are not expected to send anything. */
+#define WS_RECV_SIZE 32
+
+/* Sockets httpd holds for itself - listener and control socket - plus the one it keeps spare */
+#define HTTPD_INTERNAL_SOCKETS 3
+
+/* Sockets kept back for an uplink client */
+#define UPLINK_SOCKETS 1
+
+/* Client sockets the webserver may use without starving anything else of lwIP sockets */
+#define SERVER_SOCKET_BUDGET (CONFIG_LWIP_MAX_SOCKETS - HTTPD_INTERNAL_SOCKETS - CAPTIVE_PORTAL_SOCKETS - UPLINK_SOCKETS)
+
+/* WiFi runs on core 0, so on dual core chips the busiest worker is kept on core 1. Unicore builds have no core 1. */
+#define HIGH_CONCURRENCY_CORE ((portNUM_PROCESSORS > 1) ? 1 : tskNO_AFFINITY)
+
+/* Settings applied to the default httpd configuration for each profile */
+typedef struct {
+	const char *name;
+	uint16_t max_open_sockets;
+	uint16_t backlog_conn;
+	uint16_t timeout_s;          /* recv and send timeout */
+	BaseType_t core_id;
+	unsigned task_priority;
+} server_profile_config_t;
+
+static const server_profile_config_t server_profiles[] = {
+		[SERVER_PROFILE_LOW_MEMORY]       = { "low-memory",       3,  2, 3, tskNO_AFFINITY, tskIDLE_PRIORITY+5 },
+		[SERVER_PROFILE_BALANCED]         = { "balanced",         6,  5, 5, tskNO_AFFINITY, tskIDLE_PRIORITY+5 },
+		[SERVER_PROFILE_HIGH_CONCURRENCY] = { "high-concurrency", SERVER_SOCKET_BUDGET, 8, 3, HIGH_CONCURRENCY_CORE, tskIDLE_PRIORITY+6 },
+};
+
+/* Set once the user has been told the device is connected. Only touched by the httpd task. */
+static bool user_informed;
+
+static httpd_handle_t server_handle;
+
+/* Sockets of WebSocket clients. Only touched from the httpd task. */
+static int ws_clients[WS_MAX_CLIENTS];
+static int ws_client_count;
+
+/* Scan list serialised as JSON, reused until the scan generation changes */
+static char *scan_json;
+static size_t scan_json_size;
+static size_t scan_json_length;
+static uint32_t scan_json_generation;
+static char scan_json_etag[24];
 
 esp_err_t _http_event_handle(esp_http_client_event_t *evt)
 {
@@ -47,179 +127,808 @@ esp_err_t _http_event_handle(esp_http_client_event_t *evt)
 	return ESP_OK;
 }
 
-esp_err_t get_handler(httpd_req_t *req) {
+/* Page URIs used by the portal, and the asset served for each */
+typedef struct {
+	const char *uri;
+	const char *asset;
+} page_route_t;
+
+static const page_route_t page_routes[] = {
+		{ "/network-details",  "/network_details.html" },
+		{ "/connection-check", "/connection_check.html" },
+};
+
+/* Page served for any URI that is not an asset, so that the captive portal catches all requests */
+#define DEFAULT_PAGE "/network_select.html"
+
+/* URLs fetched by operating systems to detect a captive portal. Each is answered with a
+ * redirect to the portal rather than a page, which is enough to raise the sign-in sheet. */
+static const char *probe_paths[] = {
+		"/generate_204",                /* Android, ChromeOS */
+		"/gen_204",
+		"/hotspot-detect.html",         /* Apple */
+		"/library/test/success.html",
+		"/connecttest.txt",             /* Windows */
+		"/ncsi.txt",
+		"/redirect",
+		"/success.txt",                 /* Firefox */
+		"/canonical.html",              /* Firefox, Ubuntu */
+		"/check_network_status.txt",    /* Kindle */
+};
+
+/* Target of probe redirects, e.g. "http://192.168.4.1/" */
+static char portal_location[32];
+
+static portal_hit_stats_t portal_hits;
+
+/* Network chosen by the user. Held until a connection test proves it, then kept by the credential store. */
+static char chosen_ssid[SSID_SIZE];
+static char chosen_pword[PWORD_SIZE];
+
+/*
+ * @brief Append a string to an HTML buffer, escaping characters with meaning in markup
+ * @param out Output buffer
+ * @param pos Current position in out
+ * @param value String to append
+ * @return New position in out
+ */
+static size_t append_html_string(char *out, size_t pos, const char *value) {
+	for (const char *c = value; *c; c++) {
+		switch (*c) {
+		case	'&':
+			pos += sprintf(&out[pos], "&amp;");
+			break;
+		case	'<':
+			pos += sprintf(&out[pos], "&lt;");
+			break;
+		case	'>':
+			pos += sprintf(&out[pos], "&gt;");
+			break;
+		case	'"':
+			pos += sprintf(&out[pos], "&quot;");
+			break;
+		case	'\'':
+			pos += sprintf(&out[pos], "&#39;");
+			break;
+		default:
+			out[pos++] = *c;
+		}
+	}
 
+	return pos;
+}
 
-	if (strstr(req->uri, "/network-details") == &req->uri[0]) {
-		/* Get handle to embedded html */
-		extern const unsigned char network_details_start[] asm("_binary_network_details_html_start");
-		extern const unsigned char network_details_end[]   asm("_binary_network_details_html_end");
-		const size_t network_details_size = (network_details_end - network_details_start);
+/*
+ * @brief Get the length of a string once escaped by append_html_string()
+ */
+static size_t html_string_length(const char *value) {
+	size_t length = 0;
+
+	for (const char *c = value; *c; c++) {
+		switch (*c) {
+		case	'&':  length += 5; break;
+		case	'<':
+		case	'>':  length += 4; break;
+		case	'"':  length += 6; break;
+		case	'\'': length += 5; break;
+		default:    length += 1;
+		}
+	}
 
-		/* Send html page */
-		httpd_resp_send(req, (const char *)network_details_start, network_details_size);
-	} else if (strstr(req->uri, "/connection-check") == &req->uri[0]) {
-		/* Get handle to embedded html */
-		extern const unsigned char connection_check_start[] asm("_binary_connection_check_html_start");
-		extern const unsigned char connection_check_end[]   asm("_binary_connection_check_html_end");
-		const size_t connection_check_size = (connection_check_end - connection_check_start);
+	return length;
+}
 
-		/* Send html page */
-		httpd_resp_send(req, (const char *)connection_check_start, connection_check_size);
-	} else {
+/*
+ * @brief Render the scanned APs as buttons of the network selection form.
+ * Buttons are built in a stack buffer and sent a chunk at a time.
+ */
+static esp_err_t render_network_list(httpd_req_t *req) {
+	char html[TEMPLATE_CHUNK_SIZE];
+	size_t pos = 0;
+	int apCount = get_ap_count();
+
+	for (int i = 0; i < apCount; i++) {
+		ap_details_t ap = get_ap_details(i);
+
+		if (pos + SCAN_HTML_ENTRY_SIZE + 2*html_string_length(ap.ssid) > sizeof(html)) {
+			if (httpd_resp_send_chunk(req, html, pos) != ESP_OK) {
+				return ESP_FAIL;
+			}
+			pos = 0;
+		}
 
-		//TODO: Is it possible to redirect request to network-selection?
+		pos += sprintf(&html[pos], "<button name=\"AccessPoint\" type=\"submit\" value=\"");
+		pos = append_html_string(html, pos, ap.ssid);
+		pos += sprintf(&html[pos], "\">");
+		pos = append_html_string(html, pos, ap.ssid);
+		pos += sprintf(&html[pos], "</button>\n");
+	}
 
-		/* Get handle to embedded html */
-		extern const unsigned char network_select_start[] asm("_binary_network_select_html_start");
-		extern const unsigned char network_select_end[]   asm("_binary_network_select_html_end");
-		const size_t network_select_size = (network_select_end - network_select_start);
+	if (pos > 0) {
+		return httpd_resp_send_chunk(req, html, pos);
+	}
+	return ESP_OK;
+}
 
-		/* Send html page */
-		httpd_resp_send(req, (const char *)network_select_start, network_select_size);
+/* Renderer for each template slot, and the generation counter of the data it renders */
+typedef struct {
+	const char *slot;
+	esp_err_t (*render)(httpd_req_t *req);
+	uint32_t (*generation)(void);
+} slot_renderer_t;
+
+static const slot_renderer_t slot_renderers[] = {
+		{ "networks", render_network_list, get_scan_generation },
+};
+
+/*
+ * @brief Send a template asset with its slot rendered, or 304 if the client already holds it.
+ * The static parts either side of the slot are sent straight from flash.
+ * @param req Request being answered
+ * @param asset Template to send
+ * @return ESP_OK on success
+ */
+static esp_err_t send_template(httpd_req_t *req, const portal_asset_t *asset) {
+	char if_none_match[IF_NONE_MATCH_SIZE];
+	char etag[40];
+	const slot_renderer_t *renderer = NULL;
+
+	for (int i = 0; i < sizeof(slot_renderers)/sizeof(slot_renderers[0]); i++) {
+		if (strcmp(asset->slot, slot_renderers[i].slot) == 0) {
+			renderer = &slot_renderers[i];
+			break;
+		}
+	}
+	if (renderer == NULL) {
+		return httpd_resp_send_500(req);
 	}
 
-	return ESP_OK;
+	/* Page changes with either the template or the data rendered into it */
+	snprintf(etag, sizeof(etag), "%.*s-%u\"", (int)strlen(asset->etag) - 1, asset->etag, renderer->generation());
+	httpd_resp_set_hdr(req, "ETag", etag);
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+	if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+			strstr(if_none_match, etag) != NULL) {
+		httpd_resp_set_status(req, "304 Not Modified");
+		return httpd_resp_send(req, NULL, 0);
+	}
+
+	httpd_resp_set_type(req, asset->mime_type);
+
+	if (httpd_resp_send_chunk(req, (const char *)asset->data, asset->slot_offset) != ESP_OK ||
+			renderer->render(req) != ESP_OK ||
+			httpd_resp_send_chunk(req, (const char *)&asset->data[asset->slot_offset],
+					asset->length - asset->slot_offset) != ESP_OK) {
+		return ESP_FAIL;
+	}
+
+	/* Empty chunk ends the response */
+	return httpd_resp_send_chunk(req, NULL, 0);
 }
 
-esp_err_t post_handler(httpd_req_t *req) {
+/*
+ * @brief Check whether the client takes gzip encoded responses, from its Accept-Encoding header
+ * @param req Request being answered
+ * @return true if gzip is listed and not refused with q=0
+ */
+static bool accepts_gzip(httpd_req_t *req) {
+	char accept_encoding[ACCEPT_ENCODING_SIZE];
+	esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept_encoding, sizeof(accept_encoding));
+	const char *gzip;
+	const char *p;
+
+	if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+		return false;
+	}
 
-	/* Destination buffer for content of HTTP POST request.
-	 * httpd_req_recv() accepts char* only, but content could
-	 * as well be any binary data (needs type casting).
-	 * In case of string data, null termination will be absent, and
-	 * content length would give length of string */
-	char content[1000];
+	gzip = strstr(accept_encoding, "gzip");
+	if (gzip == NULL) {
+		return false;
+	}
 
-	/* Truncate if content length larger than the buffer */
-	size_t recv_size = fmin(req->content_len, sizeof(content));
+	/* A weight of zero, e.g. "gzip;q=0", means the client will not take it */
+	for (p = gzip + 4; *p == ' '; p++);
+	if (*p == ';') {
+		for (p++; *p == ' '; p++);
+		if (strncmp(p, "q=", 2) == 0 && strtod(p + 2, NULL) <= 0) {
+			return false;
+		}
+	}
+	return true;
+}
 
-	int ret = httpd_req_recv(req, content, recv_size);
-	if (ret <= 0) { /* 0 return value indicates connection closed */
-		/* Check if timeout occurred */
-		if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-			/* In case of timeout one can choose to retry calling
-			 * httpd_req_recv(), but to keep it simple, here we
-			 * respond with an HTTP 408 (Request Timeout) error */
-			httpd_resp_send_408(req);
+/*
+ * @brief Send an embedded asset, or 304 if the client already holds it.
+ * Gzipped assets are sent uncompressed to clients that do not accept gzip.
+ * @param req Request being answered
+ * @param asset Asset to send
+ * @return ESP_OK on success
+ */
+static esp_err_t send_asset(httpd_req_t *req, const portal_asset_t *asset) {
+	char if_none_match[IF_NONE_MATCH_SIZE];
+	const uint8_t *data = asset->data;
+	size_t length = asset->length;
+	const char *encoding = asset->encoding;
+	const char *etag = asset->etag;
+
+	if (asset->slot != NULL) {
+		return send_template(req, asset);
+	}
+
+	if (asset->plain != NULL) {
+		httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+		if (!accepts_gzip(req)) {
+			data = asset->plain;
+			length = asset->plain_length;
+			encoding = NULL;
+			etag = asset->plain_etag;
 		}
-		/* In case of error, returning ESP_FAIL will
-		 * ensure that the underlying socket is closed */
-		return ESP_FAIL;
 	}
 
-	content[req->content_len] = '\0';
+	httpd_resp_set_hdr(req, "ETag", etag);
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+	/* Client revalidating a copy it already has - no need to read the asset from flash */
+	if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+			strstr(if_none_match, etag) != NULL) {
+		httpd_resp_set_status(req, "304 Not Modified");
+		return httpd_resp_send(req, NULL, 0);
+	}
 
-	/* Check if on network selection page */
-	if (strstr(content, "network-selection") == &content[0]) {
-		int apCount = get_ap_count();
-		if (apCount == 0) {
-			//TODO: NO APs
-			ESP_LOGI("Post Handler", "No APs");
-			return ESP_OK;
+	httpd_resp_set_type(req, asset->mime_type);
+	if (encoding != NULL) {
+		httpd_resp_set_hdr(req, "Content-Encoding", encoding);
+	}
+	return httpd_resp_send(req, (const char *)data, length);
+}
+
+/*
+ * @brief Check whether a request is a connectivity probe rather than a browser navigation.
+ * Known probe URLs always are. Other requests are if they do not accept HTML.
+ * @param req Request being answered
+ * @param path URI path, excluding any query string
+ * @param path_len Length of path
+ * @return 1 if the request is a probe, 0 otherwise
+ */
+static int is_probe(httpd_req_t *req, const char *path, size_t path_len) {
+	char accept[64];
+
+	for (int i = 0; i < sizeof(probe_paths)/sizeof(probe_paths[0]); i++) {
+		if (strlen(probe_paths[i]) == path_len && strncmp(path, probe_paths[i], path_len) == 0) {
+			return 1;
 		}
-		ESP_LOGI("Post Handler", "Discovered %d APs", apCount);
+	}
+
+	/* Browsers list text/html first, so a truncated header is still enough to tell */
+	esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+	if ((err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC) && strstr(accept, "text/html") != NULL) {
+		return 0;
+	}
+
+	return 1;
+}
+
+/* GET of any other URI - embedded assets and pages */
+static esp_err_t get_handler(httpd_req_t *req) {
+	const portal_asset_t *asset = NULL;
+
+	/* Path excludes any query string */
+	size_t path_len = strcspn(req->uri, "?");
+
+	for (int i = 0; i < sizeof(page_routes)/sizeof(page_routes[0]); i++) {
+		if (strncmp(req->uri, page_routes[i].uri, strlen(page_routes[i].uri)) == 0) {
+			asset = find_asset(page_routes[i].asset, strlen(page_routes[i].asset));
+			break;
+		}
+	}
+
+	if (asset == NULL) {
+		asset = find_asset(req->uri, path_len);
+	}
 
-		char key[14];
-		char ssid_string[33];
+	if (asset != NULL) {
+		return send_asset(req, asset);
+	}
+
+	/* Connectivity probes only need to see that they are being intercepted - a bodiless redirect will do */
+	if (is_probe(req, req->uri, path_len)) {
+		portal_hits.probe_redirects++;
+		httpd_resp_set_status(req, "302 Found");
+		httpd_resp_set_hdr(req, "Location", portal_location);
+		httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+		return httpd_resp_send(req, NULL, 0);
+	}
 
-		for (int i = 0; i < apCount; i++) {
-			sprintf(key, "AP%d", i);
-			sprintf(ssid_string, "%s", (char *)get_ap_details(i).ssid);
+	/* Browser navigation to any other URI gets the portal itself */
+	portal_hits.page_hits++;
+	return send_asset(req, find_asset(DEFAULT_PAGE, strlen(DEFAULT_PAGE)));
+}
+
+/*
+ * @brief Receive the body of a POST request in pieces and decode the wanted fields from it.
+ * Bodies may be urlencoded or, if the Content-Type says so, a flat JSON object.
+ * On failure an error response has already been sent.
+ * @param req Request being answered
+ * @param fields Fields to extract
+ * @param count Number of fields
+ * @return ESP_OK on success. ESP_FAIL if the request was rejected and the connection should be closed.
+ */
+static esp_err_t parse_form_body(httpd_req_t *req, form_field_t *fields, size_t count) {
+	char chunk[FORM_CHUNK_SIZE];
+	char content_type[32];
+	form_parser_t parser;
+	form_type_t type = FORM_URLENCODED;
+	size_t remaining = req->content_len;
+	esp_err_t err = ESP_OK;
+
+	if (remaining > FORM_BODY_SIZE) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Body too large");
+		return ESP_FAIL;
+	}
 
-			httpd_resp_sendstr_chunk(req, key);
-			httpd_resp_sendstr_chunk(req, ",");
-			httpd_resp_sendstr_chunk(req, ssid_string);
-			if(i != apCount-1) {
-				httpd_resp_sendstr_chunk(req, ",");
+	/* Header may be truncated if it carries parameters, but the media type comes first */
+	esp_err_t hdr = httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type));
+	if ((hdr == ESP_OK || hdr == ESP_ERR_HTTPD_RESULT_TRUNC) &&
+			strncmp(content_type, "application/json", strlen("application/json")) == 0) {
+		type = FORM_JSON;
+	}
+
+	form_parser_init(&parser, type, fields, count);
+
+	while (remaining > 0 && err == ESP_OK) {
+		int ret = httpd_req_recv(req, chunk, (remaining < sizeof(chunk)) ? remaining : sizeof(chunk));
+		if (ret <= 0) { /* 0 return value indicates connection closed */
+			/* Check if timeout occurred */
+			if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+				httpd_resp_send_408(req);
 			}
+			/* In case of error, returning ESP_FAIL will
+			 * ensure that the underlying socket is closed */
+			return ESP_FAIL;
+		}
+
+		err = form_parser_feed(&parser, chunk, ret);
+		remaining -= ret;
+	}
+
+	if (err == ESP_OK) {
+		err = form_parser_finish(&parser);
+	}
+
+	if (err == ESP_ERR_INVALID_SIZE) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Field too long");
+		return ESP_FAIL;
+	}
+	if (err != ESP_OK) {
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Malformed body");
+		return ESP_FAIL;
+	}
+
+	return ESP_OK;
+}
+
+/*
+ * @brief Send a 303 redirect to another page
+ */
+static esp_err_t redirect(httpd_req_t *req, const char *location) {
+	httpd_resp_set_status(req, "303 See Other");
+	httpd_resp_set_hdr(req, "Location", location);
+	return httpd_resp_send(req, NULL, 0);  // Response body can be empty
+}
+
+/*
+ * @brief Append a string to a JSON buffer as a quoted, escaped JSON string
+ * @param out Output buffer
+ * @param pos Current position in out
+ * @param value String to append
+ * @return New position in out
+ */
+static size_t append_json_string(char *out, size_t pos, const char *value) {
+	out[pos++] = '"';
+	for (const unsigned char *c = (const unsigned char *)value; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			out[pos++] = '\\';
+			out[pos++] = *c;
+		} else if (*c < 0x20) {
+			pos += sprintf(&out[pos], "\\u%04x", *c);
+		} else {
+			out[pos++] = *c;
 		}
+	}
+	out[pos++] = '"';
+
+	return pos;
+}
 
-		httpd_resp_send_chunk(req, "", 0);
+/*
+ * @brief Serialise the scan list as JSON into scan_json, unless it is already up to date
+ * @return ESP_OK on success. ESP_ERR_NO_MEM if the buffer could not be allocated.
+ */
+static esp_err_t update_scan_json() {
+	uint32_t generation = get_scan_generation();
+	int apCount = get_ap_count();
+
+	if (scan_json != NULL && scan_json_generation == generation) {
 		return ESP_OK;
+	}
+
+	/* Worst case, every SSID byte is escaped as \u00XX */
+	size_t size = 2 + apCount * SCAN_JSON_ENTRY_SIZE;
+	if (size > scan_json_size) {
+		char *buf = realloc(scan_json, size);
+		if (buf == NULL) {
+			return ESP_ERR_NO_MEM;
+		}
+		scan_json = buf;
+		scan_json_size = size;
+	}
+
+	size_t pos = 0;
+	scan_json[pos++] = '[';
+	for (int i = 0; i < apCount; i++) {
+		ap_details_t ap = get_ap_details(i);
+
+		pos += sprintf(&scan_json[pos], "%s{\"id\":%d,\"ssid\":", (i == 0) ? "" : ",", i);
+		pos = append_json_string(scan_json, pos, ap.ssid);
+		pos += sprintf(&scan_json[pos], ",\"rssi\":%d,\"channel\":%u,\"auth\":%d}",
+				ap.rssi, ap.channel, ap.authmode);
+	}
+	scan_json[pos++] = ']';
+	scan_json_length = pos;
+
+	snprintf(scan_json_etag, sizeof(scan_json_etag), "\"scan-%u\"", generation);
+	scan_json_generation = generation;
 
+	return ESP_OK;
+}
+
+/* GET /api/networks - list of scanned APs as JSON, cached until the next scan completes */
+static esp_err_t networks_handler(httpd_req_t *req) {
+	char if_none_match[IF_NONE_MATCH_SIZE];
+
+	if (update_scan_json() != ESP_OK) {
+		return httpd_resp_send_500(req);
 	}
-	/* Check if AP selected */
-	else if (strstr(content, "AccessPoint") == &content[0]) {
-		int chosenAP;
-		sscanf(content, "AccessPoint=AP%d", &chosenAP);
 
-		char ssid[33];
-		sprintf(ssid, "%s", (char *)get_ap_details(chosenAP).ssid);
+	httpd_resp_set_hdr(req, "ETag", scan_json_etag);
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
 
-		write_string("ssid_handle", ssid);
+	if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+			strstr(if_none_match, scan_json_etag) != NULL) {
+		httpd_resp_set_status(req, "304 Not Modified");
+		return httpd_resp_send(req, NULL, 0);
+	}
+
+	/* Whole list in a single write */
+	httpd_resp_set_type(req, "application/json");
+	return httpd_resp_send(req, scan_json, scan_json_length);
+}
 
-		// AUTHMODE
-		int authmode = get_ap_details(chosenAP).authmode;
-		if (authmode == WIFI_AUTH_OPEN) {
+/* GET /api/timeline - boot and provisioning timeline, one step per line, oldest first */
+static esp_err_t timeline_handler(httpd_req_t *req) {
+	char chunk[TEMPLATE_CHUNK_SIZE];
+	timeline_entry_t entry;
+	size_t pos;
 
-			write_string("pword_handle", "");
+	httpd_resp_set_type(req, "text/plain");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-store");
 
-			httpd_resp_set_status(req, "303 See Other");
-			httpd_resp_set_hdr(req, "Location", "/connection-check");
-			httpd_resp_send(req, NULL, 0);  // Response body can be empty
+	pos = sprintf(chunk, "# boot ms step arg\n");
 
-			return ESP_OK;
+	/* Lines are batched, so that the report goes in a few writes */
+	for (int i = 0; timeline_get(i, &entry) == 0; i++) {
+		if (pos + TIMELINE_LINE_SIZE > sizeof(chunk)) {
+			if (httpd_resp_send_chunk(req, chunk, pos) != ESP_OK) {
+				return ESP_FAIL;
+			}
+			pos = 0;
 		}
+		pos += timeline_format_entry(&entry, &chunk[pos], sizeof(chunk) - pos);
+	}
 
-		httpd_resp_set_status(req, "303 See Other");
-		httpd_resp_set_hdr(req, "Location", "/network-details");
-		httpd_resp_send(req, NULL, 0);  // Response body can be empty
+	if (httpd_resp_send_chunk(req, chunk, pos) != ESP_OK) {
+		return ESP_FAIL;
+	}
+	return httpd_resp_send_chunk(req, NULL, 0);
+}
 
-		return ESP_OK;
+/* POST /api/select - AP chosen from network selection page.
+ * Buttons carry the SSID rather than a position, as background scans reorder the list. */
+static esp_err_t select_handler(httpd_req_t *req) {
+	char choice[SSID_SIZE];
+	ap_details_t ap;
+	form_field_t fields[] = {
+			{ .name = "AccessPoint", .value = choice, .size = sizeof(choice) },
+	};
+
+	if (parse_form_body(req, fields, 1) != ESP_OK) {
+		return ESP_FAIL;
 	}
-	/* Check request for chosen AP */
-	else if (strstr(content, "chosen-ap") == &content[0]) {
-		// Read NVS
-		size_t ssid_size = SSID_SIZE;
-		char ssid[SSID_SIZE];
-		read_string(SSID_HANDLE, ssid, &ssid_size);
 
-		httpd_resp_sendstr_chunk(req, ssid);
+	/* Network has gone since the page was rendered - show the list as it is now */
+	if (find_ap_details(choice, &ap) != ESP_OK) {
+		return redirect(req, DEFAULT_PAGE "?gone");
+	}
 
-		httpd_resp_send_chunk(req, "", 0);
-		return ESP_OK;
+	sprintf(chosen_ssid, "%s", ap.ssid);
+	chosen_pword[0] = '\0';
+
+	// AUTHMODE
+	if (ap.authmode == WIFI_AUTH_OPEN) {
+		return redirect(req, "/connection-check");
 	}
-	/* Check if password entered */
-	else if (strstr(content, "password") == &content[0]) {
-		char pword[req->content_len];
-		sscanf(content, "password=%s", pword);
-		pword[req->content_len] = '\0';
 
-		write_string("pword_handle", pword);
+	return redirect(req, "/network-details");
+}
 
-		httpd_resp_set_status(req, "303 See Other");
-		httpd_resp_set_hdr(req, "Location", "/connection-check");
-		httpd_resp_send(req, NULL, 0);  // Response body can be empty
+/* GET /api/selected - SSID of chosen AP */
+static esp_err_t selected_handler(httpd_req_t *req) {
+	return httpd_resp_sendstr(req, chosen_ssid);
+}
 
-		return ESP_OK;
+/* POST /api/credentials - password for chosen AP */
+static esp_err_t credentials_handler(httpd_req_t *req) {
+	char pword[PWORD_SIZE];
+	form_field_t fields[] = {
+			{ .name = "password", .value = pword, .size = sizeof(pword) },
+	};
+
+	/* Missing password is taken as empty. Anything longer than a WPA passphrase is rejected. */
+	if (parse_form_body(req, fields, 1) != ESP_OK) {
+		return ESP_FAIL;
 	}
-	/* Otherwise, connection check */
-	else {
-		/* Add file upload form and script which on execution sends a POST request to /upload */
-		connect_to_saved_ap();
-		if (is_sta_connected() == 1) {
-			httpd_resp_sendstr(req, "1");
-			USER_INFORMED = 1;
-		} else {
-			httpd_resp_sendstr(req, "0");
+
+	sprintf(chosen_pword, "%s", pword);
+
+	return redirect(req, "/connection-check");
+}
+
+/*
+ * @brief Tell the state machine the user knows the device is connected. Posted once per portal session.
+ */
+static void set_user_informed() {
+	if (!user_informed) {
+		user_informed = true;
+		app_events_post(APP_EVENT_USER_INFORMED, 0);
+	}
+}
+
+/*
+ * @brief Send the connection test state as JSON
+ */
+static esp_err_t send_connection_state(httpd_req_t *req, connection_test_state_t state) {
+	char json[32];
+
+	snprintf(json, sizeof(json), "{\"state\":\"%s\"}", connection_test_state_name(state));
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+	esp_err_t err = httpd_resp_sendstr(req, json);
+
+	/* User has now been told the device is connected. Only posted once sent, as the portal
+	 * is shut down as soon as the state machine hears of it. */
+	if (err == ESP_OK && state == CONNECTION_TEST_GOT_IP) {
+		set_user_informed();
+	}
+
+	return err;
+}
+
+/* POST /api/connect - start a background connection attempt to the chosen AP */
+static esp_err_t connect_handler(httpd_req_t *req) {
+	esp_err_t err = start_connection_test(chosen_ssid, chosen_pword);
+
+	if (err == ESP_ERR_NO_MEM) {
+		return httpd_resp_send_500(req);
+	}
+	/* If a test is already running, report its progress rather than starting another */
+	if (err == ESP_OK) {
+		httpd_resp_set_status(req, "202 Accepted");
+	}
+
+	return send_connection_state(req, wait_connection_test_state(CONNECTION_TEST_IDLE, 0));
+}
+
+/* GET /api/status?known=<state>&wait=<ms> - connection test state.
+ * Waits up to STATUS_MAX_WAIT_MS for the state to differ from known. No wait is the default. */
+static esp_err_t status_handler(httpd_req_t *req) {
+	char query[48];
+	char value[16];
+	connection_test_state_t known = CONNECTION_TEST_IDLE;
+	uint32_t wait_ms = 0;
+
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+		if (httpd_query_key_value(query, "wait", value, sizeof(value)) == ESP_OK) {
+			wait_ms = atoi(value);
+			if (wait_ms > STATUS_MAX_WAIT_MS) {
+				wait_ms = STATUS_MAX_WAIT_MS;
+			}
 		}
+		if (httpd_query_key_value(query, "known", value, sizeof(value)) == ESP_OK) {
+			for (connection_test_state_t state = CONNECTION_TEST_IDLE; state <= CONNECTION_TEST_FAILED; state++) {
+				if (strcmp(value, connection_test_state_name(state)) == 0) {
+					known = state;
+				}
+			}
+		}
+	}
 
-		return ESP_OK;
+	return send_connection_state(req, wait_connection_test_state(known, wait_ms));
+}
+
+/*
+ * @brief Add a socket to the WebSocket clients, dropping any that have since closed
+ * @return ESP_OK, or ESP_ERR_NO_MEM if there are already too many clients
+ */
+static esp_err_t add_ws_client(int fd) {
+	int count = 0;
+
+	for (int i = 0; i < ws_client_count; i++) {
+		if (ws_clients[i] != fd && httpd_ws_get_fd_info(server_handle, ws_clients[i]) == HTTPD_WS_CLIENT_WEBSOCKET) {
+			ws_clients[count++] = ws_clients[i];
+		}
+	}
+	ws_client_count = count;
+
+	if (ws_client_count == WS_MAX_CLIENTS) {
+		return ESP_ERR_NO_MEM;
+	}
+	ws_clients[ws_client_count++] = fd;
+
+	return ESP_OK;
+}
+
+/* GET /ws - WebSocket over which scan and connection events are pushed */
+static esp_err_t ws_handler(httpd_req_t *req) {
+	uint8_t payload[WS_RECV_SIZE];
+	httpd_ws_frame_t frame = { .payload = payload };
+
+	/* Handshake has completed - start pushing events to this client */
+	if (req->method == HTTP_GET) {
+		return add_ws_client(httpd_req_to_sockfd(req));
+	}
+
+	/* Nothing is expected from clients, so any data frame is read and dropped */
+	return httpd_ws_recv_frame(req, &frame, sizeof(payload));
+}
+
+/*
+ * @brief Send a text frame to every WebSocket client. Runs in the httpd task.
+ * @return Number of clients it was delivered to
+ */
+static int ws_send_all(const char *json) {
+	int delivered = 0;
+	httpd_ws_frame_t frame = {
+			.final = true,
+			.type = HTTPD_WS_TYPE_TEXT,
+			.payload = (uint8_t *)json,
+			.len = strlen(json)
+	};
+
+	for (int i = 0; i < ws_client_count; i++) {
+		if (httpd_ws_get_fd_info(server_handle, ws_clients[i]) == HTTPD_WS_CLIENT_WEBSOCKET &&
+				httpd_ws_send_frame_async(server_handle, ws_clients[i], &frame) == ESP_OK) {
+			delivered++;
+		}
+	}
+
+	return delivered;
+}
+
+/*
+ * @brief Send a new AP list generation to every WebSocket client. Runs in the httpd task.
+ */
+static void ws_broadcast_scan(void *arg) {
+	char json[48];
+
+	snprintf(json, sizeof(json), "{\"event\":\"scan-done\",\"generation\":%u}", get_scan_generation());
+	ws_send_all(json);
+}
+
+/*
+ * @brief Send a connection test state to every WebSocket client. Runs in the httpd task.
+ */
+static void ws_broadcast_state(void *arg) {
+	connection_test_state_t state = (connection_test_state_t)(intptr_t)arg;
+	char json[48];
+
+	snprintf(json, sizeof(json), "{\"event\":\"state\",\"state\":\"%s\"}", connection_test_state_name(state));
+
+	/* User has now been told the device is connected, and its network is saved */
+	if (ws_send_all(json) > 0 && state == CONNECTION_TEST_GOT_IP) {
+		set_user_informed();
+	}
+}
+
+/*
+ * @brief WiFi listener - hands new scan results to the httpd task, which owns the client sockets.
+ * Connection progress is pushed from the connection test instead, which knows when the network is saved.
+ */
+static void wifi_event_listener(wifi_notification_t notification, void *arg) {
+	httpd_handle_t server = (httpd_handle_t)arg;
+
+	if (notification == WIFI_NOTIFY_SCAN_DONE && httpd_queue_work(server, ws_broadcast_scan, NULL) != ESP_OK) {
+		ESP_LOGW("WebSocket", "Could not queue scan results");
 	}
 }
 
+/*
+ * @brief Connection test listener - hands state changes to the httpd task
+ */
+static void connection_test_listener(connection_test_state_t state, void *arg) {
+	httpd_handle_t server = (httpd_handle_t)arg;
+
+	if (httpd_queue_work(server, ws_broadcast_state, (void *)(intptr_t)state) != ESP_OK) {
+		ESP_LOGW("WebSocket", "Could not queue state %s", connection_test_state_name(state));
+	}
+}
+
+/* Every URI served, in order of matching. The asset handler must come last, as it matches all URIs. */
+static endpoint_t endpoints[] = {
+		{ .uri = "/api/networks",    .method = HTTP_GET,  .handler = networks_handler },
+		{ .uri = "/api/select",      .method = HTTP_POST, .handler = select_handler },
+		{ .uri = "/api/selected",    .method = HTTP_GET,  .handler = selected_handler },
+		{ .uri = "/api/credentials", .method = HTTP_POST, .handler = credentials_handler },
+		{ .uri = "/api/connect",     .method = HTTP_POST, .handler = connect_handler },
+		{ .uri = "/api/status",      .method = HTTP_GET,  .handler = status_handler },
+		{ .uri = "/api/timeline",    .method = HTTP_GET,  .handler = timeline_handler },
+		{ .uri = "/ws",              .method = HTTP_GET,  .handler = ws_handler, .is_websocket = true },
+		{ .uri = "/*",               .method = HTTP_GET,  .handler = get_handler },
+};
+#define ENDPOINT_COUNT (sizeof(endpoints)/sizeof(endpoints[0]))
+
+/*
+ * @brief Run the handler of an endpoint and record how long it took
+ */
+static esp_err_t timed_handler(httpd_req_t *req) {
+	endpoint_t *endpoint = (endpoint_t *)req->user_ctx;
+	int64_t start = esp_timer_get_time();
+
+	esp_err_t err = endpoint->handler(req);
+
+	uint32_t elapsed = esp_timer_get_time() - start;
+	endpoint->stats.count++;
+	endpoint->stats.total_us += elapsed;
+	if (elapsed > endpoint->stats.max_us) {
+		endpoint->stats.max_us = elapsed;
+	}
+	if (err != ESP_OK) {
+		endpoint->stats.errors++;
+	}
+
+	return err;
+}
+
 /* Function for starting the webserver */
-httpd_handle_t start_webserver(void) {
+httpd_handle_t start_webserver(server_profile_t profile) {
+	const server_profile_config_t *settings = &server_profiles[profile];
+
 	/* Generate default configuration */
 	httpd_config_t config = HTTPD_DEFAULT_CONFIG();
 
-	USER_INFORMED = 0;
+	/* Apply profile */
+	config.max_open_sockets = (settings->max_open_sockets < SERVER_SOCKET_BUDGET) ?
+			settings->max_open_sockets : SERVER_SOCKET_BUDGET;
+	config.backlog_conn = settings->backlog_conn;
+	config.lru_purge_enable = true;
+	config.recv_wait_timeout = settings->timeout_s;
+	config.send_wait_timeout = settings->timeout_s;
+	config.core_id = settings->core_id;
+	config.task_priority = settings->task_priority;
+
+	ESP_LOGI("start_webserver", "Profile %s: %u sockets, backlog %u, timeout %u s",
+			settings->name, config.max_open_sockets, config.backlog_conn, settings->timeout_s);
+
+	user_informed = false;
 
-	/* Use the URI wildcard matching function in order to
-	 * allow the same handler to respond to multiple different
-	 * target URIs which match the wildcard scheme */
+	esp_ip4_addr_t ap_ip = { .addr = get_ap_ip_address() };
+	snprintf(portal_location, sizeof(portal_location), "http://" IPSTR "/", IP2STR(&ap_ip));
+	memset(&portal_hits, 0, sizeof(portal_hits));
+
+	/* Each endpoint is matched exactly, apart from the asset handler,
+	 * which uses a wildcard to catch every other URI */
 	config.uri_match_fn = httpd_uri_match_wildcard;
+	config.max_uri_handlers = ENDPOINT_COUNT;
 
 	/* Empty handle to esp_http_server */
 	httpd_handle_t server = NULL;
@@ -230,37 +939,60 @@ httpd_handle_t start_webserver(void) {
 		return server;
 	}
 
-	/* URI handler for getting first page */
-	httpd_uri_t get_network_selection = {
-			.uri       = "/*",  // Match all URIs
-			.method    = HTTP_GET,
-			.handler   = get_handler,
-			.user_ctx  = NULL
-	};
-	httpd_register_uri_handler(server, &get_network_selection);
-
-	/* URI handler for network selection */
-	httpd_uri_t post_network_selection = {
-			.uri       = "/*",   // Match all URIs of type /upload/path/to/file /network-selection
-			.method    = HTTP_POST,
-			.handler   = post_handler,
-			.user_ctx  = NULL    // Pass server data as context
-	};
-	httpd_register_uri_handler(server, &post_network_selection);
+	for (int i = 0; i < ENDPOINT_COUNT; i++) {
+		httpd_uri_t uri = {
+				.uri       = endpoints[i].uri,
+				.method    = endpoints[i].method,
+				.handler   = timed_handler,
+				.user_ctx  = &endpoints[i],
+				.is_websocket = endpoints[i].is_websocket
+		};
+		memset(&endpoints[i].stats, 0, sizeof(endpoint_stats_t));
+		httpd_register_uri_handler(server, &uri);
+	}
+
+	server_handle = server;
+	ws_client_count = 0;
+	set_wifi_listener(wifi_event_listener, server);
+	set_connection_test_listener(connection_test_listener, server);
 
 	return server;
 }
 
+void log_endpoint_stats() {
+	for (int i = 0; i < ENDPOINT_COUNT; i++) {
+		endpoint_stats_t *stats = &endpoints[i].stats;
+		ESP_LOGI("Endpoint Stats", "%-18s %s count: %u errors: %u mean: %u us max: %u us",
+				endpoints[i].uri, (endpoints[i].method == HTTP_GET) ? "GET " : "POST",
+				stats->count, stats->errors,
+				stats->count ? (uint32_t)(stats->total_us / stats->count) : 0, stats->max_us);
+	}
+	ESP_LOGI("Endpoint Stats", "probe redirects: %u portal page hits: %u",
+			portal_hits.probe_redirects, portal_hits.page_hits);
+}
+
+void get_portal_hit_stats(portal_hit_stats_t *out) {
+	*out = portal_hits;
+}
+
 /* Function for stopping the webserver */
 void stop_webserver(httpd_handle_t server) {
 	if (server) {
+		set_wifi_listener(NULL, NULL);
+		set_connection_test_listener(NULL, NULL);
+		log_endpoint_stats();
+
 		/* Stop the httpd server */
 		httpd_stop(server);
+		server_handle = NULL;
+		ws_client_count = 0;
+
+		/* The cached network list is only wanted while the portal runs */
+		free(scan_json);
+		scan_json = NULL;
+		scan_json_size = 0;
+		scan_json_length = 0;
 	}
 }
 
-int get_user_informed() {
-	return USER_INFORMED;
-}
-
 
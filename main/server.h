@@ -16,7 +16,6 @@
 #include "esp_err.h"
 #include "esp_netif.h"
 #include <string.h>
-#include <math.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -26,6 +25,7 @@
 #include "esp_log.h"
 #include "esp_http_server.h"
 #include "esp_http_client.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 
 #include "lwip/err.h"
@@ -34,15 +34,55 @@
 #include "first_boot.h"
 #include "memory.h"
 #include "wifi.h"
+#include "cred_store.h"
 
-#define SSID_SIZE 33
-#define PWORD_SIZE 64
+/** Latency counters kept for each endpoint */
+typedef struct {
+	uint32_t count;
+	uint32_t errors;
+	uint64_t total_us;
+	uint32_t max_us;
+} endpoint_stats_t;
+
+/** Requests for URIs other than assets, split by how they were answered */
+typedef struct {
+	uint32_t probe_redirects;   /* Connectivity probes redirected to the portal */
+	uint32_t page_hits;         /* Browser navigations served the portal page */
+} portal_hit_stats_t;
+
+/** A URI served by the webserver, with its own handler and counters */
+typedef struct {
+	const char *uri;
+	httpd_method_t method;
+	esp_err_t (*handler)(httpd_req_t *req);
+	bool is_websocket;
+	endpoint_stats_t stats;
+} endpoint_t;
+
+/**
+ * Resource profiles for the webserver.
+ *
+ * Sockets come from the lwIP pool (CONFIG_LWIP_MAX_SOCKETS), which is shared with
+ * httpd's own listening and control sockets, the captive portal DNS server and any
+ * uplink client. Each profile's socket count is capped to what is left of that pool.
+ *
+ * Connections are kept alive between requests, as browsers and OS probes reuse them.
+ * httpd has no idle timeout, so with LRU purge on, a new connection arriving while all
+ * sockets are in use closes the least recently used one instead of being refused.
+ * The recv/send timeouts bound how long a stalled client can hold the single worker.
+ */
+typedef enum {
+	SERVER_PROFILE_LOW_MEMORY = 0,       /* Fewest sockets and smallest backlog. One client at a time. */
+	SERVER_PROFILE_BALANCED = 1,         /* Enough sockets for a phone loading a page in parallel */
+	SERVER_PROFILE_HIGH_CONCURRENCY = 2  /* Every socket left in the pool. Worker pinned away from WiFi. */
+} server_profile_t;
 
 /**
  * @brief Start HTTP webserver
+ * @param profile Resource profile to run the webserver with
  * @return Handle of webserver
  */
-httpd_handle_t start_webserver(void);
+httpd_handle_t start_webserver(server_profile_t profile);
 
 /**
  * @brief Stop HTTP webserver
@@ -51,8 +91,14 @@ httpd_handle_t start_webserver(void);
 void stop_webserver(httpd_handle_t server);
 
 /**
- * @breif Returns whether user has been informed of positive connection
+ * @brief Log request count and latency of every endpoint
+ */
+void log_endpoint_stats();
+
+/**
+ * @brief Get counts of probe redirects and portal page hits
+ * @param out Copy of counters since the webserver was started
  */
-int get_user_informed();
+void get_portal_hit_stats(portal_hit_stats_t *out);
 
 #endif /* MAIN_SERVER_H_ */
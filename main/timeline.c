@@ -0,0 +1,123 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Timeline
+ * Timestamps of the steps from power-on to launching
+ * the app, kept in a ring buffer in RTC memory so that
+ * they survive a restart. Read back as a short text
+ * report over serial or from the portal.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "timeline.h"
+
+/* Marks RTC memory as holding a timeline. Changed whenever the layout of timeline_t changes. */
+#define TIMELINE_MAGIC 0x544C0001
+
+/* Ring buffer. Not initialised at startup, so that it survives a restart. */
+typedef struct {
+	uint32_t magic;
+	uint16_t boot;
+	uint16_t head;       /* Index of the next entry to write */
+	uint16_t count;
+	timeline_entry_t entries[TIMELINE_CAPACITY];
+} timeline_t;
+
+static RTC_NOINIT_ATTR timeline_t timeline;
+
+static portMUX_TYPE timeline_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const event_names[] = {
+		[TIMELINE_BOOT] = "boot",
+		[TIMELINE_STATE] = "state",
+		[TIMELINE_IDENTIFY_STEP] = "identify",
+		[TIMELINE_NVS_READY] = "nvs",
+		[TIMELINE_WIFI_START] = "wifi-start",
+		[TIMELINE_SCAN_START] = "scan-start",
+		[TIMELINE_SCAN_DONE] = "scan-done",
+		[TIMELINE_CONNECT] = "connect",
+		[TIMELINE_ASSOCIATED] = "associated",
+		[TIMELINE_GOT_IP] = "got-ip",
+		[TIMELINE_DISCONNECTED] = "disconnected",
+};
+#define EVENT_NAME_COUNT (sizeof(event_names)/sizeof(event_names[0]))
+
+void timeline_init() {
+	esp_reset_reason_t reason = esp_reset_reason();
+
+	// After a power-on, RTC memory holds whatever it powered up with
+	if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT || timeline.magic != TIMELINE_MAGIC ||
+			timeline.head >= TIMELINE_CAPACITY || timeline.count > TIMELINE_CAPACITY) {
+		memset(&timeline, 0, sizeof(timeline));
+		timeline.magic = TIMELINE_MAGIC;
+	}
+	timeline.boot++;
+
+	timeline_record(TIMELINE_BOOT, reason);
+}
+
+void timeline_record(timeline_event_t event, uint32_t arg) {
+	timeline_entry_t entry = {
+			.time_ms = esp_timer_get_time() / 1000,
+			.boot = timeline.boot,
+			.event = event,
+			.arg = (arg > UINT8_MAX) ? UINT8_MAX : arg
+	};
+
+	portENTER_CRITICAL(&timeline_lock);
+	timeline.entries[timeline.head] = entry;
+	timeline.head = (timeline.head + 1) % TIMELINE_CAPACITY;
+	if (timeline.count < TIMELINE_CAPACITY) {
+		timeline.count++;
+	}
+	portEXIT_CRITICAL(&timeline_lock);
+}
+
+int timeline_count() {
+	return timeline.count;
+}
+
+int timeline_get(int index, timeline_entry_t *out) {
+	int result = -1;
+
+	portENTER_CRITICAL(&timeline_lock);
+	if (index >= 0 && index < timeline.count) {
+		*out = timeline.entries[(timeline.head + TIMELINE_CAPACITY - timeline.count + index) % TIMELINE_CAPACITY];
+		result = 0;
+	}
+	portEXIT_CRITICAL(&timeline_lock);
+
+	return result;
+}
+
+int timeline_format_entry(const timeline_entry_t *entry, char *line, size_t size) {
+	const char *name = (entry->event < EVENT_NAME_COUNT) ? event_names[entry->event] : "unknown";
+
+	int length = snprintf(line, size, "%u %u %s %u\n",
+			(unsigned)entry->boot, (unsigned)entry->time_ms, name, (unsigned)entry->arg);
+
+	return (length < (int)size) ? length : (int)size - 1;
+}
+
+void timeline_dump() {
+	timeline_entry_t entry;
+	char line[TIMELINE_LINE_SIZE];
+
+	printf("# timeline: boot ms step arg\n");
+	for (int i = 0; timeline_get(i, &entry) == 0; i++) {
+		timeline_format_entry(&entry, line, sizeof(line));
+		fputs(line, stdout);
+	}
+	printf("# end of timeline\n");
+}
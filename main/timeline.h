@@ -0,0 +1,90 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Timeline
+ * Timestamps of the steps from power-on to launching
+ * the app, kept in a ring buffer in RTC memory so that
+ * they survive a restart. Read back as a short text
+ * report over serial or from the portal.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef MAIN_TIMELINE_H_
+#define MAIN_TIMELINE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Number of entries kept. The oldest are overwritten first. */
+#define TIMELINE_CAPACITY 64
+
+/* Longest line written by timeline_format_entry(), including the terminator */
+#define TIMELINE_LINE_SIZE 40
+
+/** Steps recorded */
+typedef enum {
+	TIMELINE_BOOT = 0,            /* app_main() entered. Arg is the reset reason. */
+	TIMELINE_STATE = 1,           /* Top level state entered. Arg is the state. */
+	TIMELINE_IDENTIFY_STEP = 2,   /* Step of identifying a network entered. Arg is the step. */
+	TIMELINE_NVS_READY = 3,       /* NVS initialised and opened */
+	TIMELINE_WIFI_START = 4,      /* WiFi driver started. Arg is the mode. */
+	TIMELINE_SCAN_START = 5,      /* Scan of all channels started */
+	TIMELINE_SCAN_DONE = 6,       /* Scan of all channels done. Arg is the number of APs found, up to 255. */
+	TIMELINE_CONNECT = 7,         /* Connection attempt started. Arg is the attempt number. */
+	TIMELINE_ASSOCIATED = 8,      /* Station associated with an AP */
+	TIMELINE_GOT_IP = 9,          /* Station got an IP address from DHCP */
+	TIMELINE_DISCONNECTED = 10    /* Station lost its AP, or an attempt failed. Arg is the reason. */
+} timeline_event_t;
+
+/** A recorded step */
+typedef struct {
+	uint32_t time_ms;    /* Time since boot */
+	uint16_t boot;       /* Boot the entry was recorded in. Counts up from 1 after a power-on. */
+	uint8_t event;       /* timeline_event_t */
+	uint8_t arg;
+} timeline_entry_t;
+
+/**
+ * @brief Start recording for this boot. Keeps the entries of earlier boots, unless this is a
+ * power-on, when RTC memory holds nothing useful. Records a TIMELINE_BOOT entry.
+ */
+void timeline_init();
+
+/**
+ * @brief Record a step. Cheap enough to call from the WiFi event handler. Safe from any task.
+ * @param event Step reached
+ * @param arg Detail of the step, truncated to 8 bits
+ */
+void timeline_record(timeline_event_t event, uint32_t arg);
+
+/**
+ * @brief Get the number of entries held
+ */
+int timeline_count();
+
+/**
+ * @brief Get an entry, oldest first
+ * @param index Index of entry
+ * @param out Copy of entry
+ * @return 0 on success. -1 if index is out of range.
+ */
+int timeline_get(int index, timeline_entry_t *out);
+
+/**
+ * @brief Write an entry as one line of the report: boot, time in ms, step name and arg, space separated
+ * @param entry Entry to format
+ * @param line Output line, ending in a newline
+ * @param size Size of line. TIMELINE_LINE_SIZE is always enough.
+ * @return Length of the line
+ */
+int timeline_format_entry(const timeline_entry_t *entry, char *line, size_t size);
+
+/**
+ * @brief Print the report to the serial console
+ */
+void timeline_dump();
+
+#endif /* MAIN_TIMELINE_H_ */
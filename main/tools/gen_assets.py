@@ -0,0 +1,182 @@
+#!/usr/bin/env python
+#
+# INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+#
+# Generate Assets
+# Turns every file under the portal asset directory into a
+# constant table in portal_assets.c, sorted by path so that
+# the server can look an asset up with a binary search.
+# Text assets are minified, and any asset that gets smaller
+# is stored gzipped, along with the uncompressed copy for
+# clients that do not accept gzip. Each copy gets a strong
+# ETag taken from a hash of its content.
+#
+# An HTML asset may hold one slot marker, <!--@name-->, where
+# the server renders dynamic content. The marker is removed
+# and its offset recorded, and the asset is stored as-is so
+# that the server can send the parts either side of it.
+#
+# Usage: gen_assets.py ASSET_DIR OUTPUT_DIR
+#
+
+from __future__ import print_function
+
+import gzip
+import hashlib
+import io
+import os
+import re
+import sys
+
+MIME_TYPES = {
+    '.html': 'text/html',
+    '.css':  'text/css',
+    '.js':   'application/javascript',
+    '.json': 'application/json',
+    '.txt':  'text/plain',
+    '.svg':  'image/svg+xml',
+    '.png':  'image/png',
+    '.jpg':  'image/jpeg',
+    '.gif':  'image/gif',
+    '.ico':  'image/x-icon',
+}
+
+TEXT_TYPES = ('.html', '.css', '.js', '.json', '.txt', '.svg')
+
+SLOT_MARKER = re.compile(br'<!--@(\w+)-->')
+
+
+def minify(text):
+    # Only leading/trailing whitespace and blank lines are removed. Line breaks are
+    # kept so that '//' comments in scripts stay intact.
+    lines = (line.strip() for line in text.splitlines())
+    return '\n'.join(line for line in lines if line) + '\n'
+
+
+def compress(data):
+    # mtime is fixed so that the output, and therefore the ETag, is reproducible
+    buf = io.BytesIO()
+    with gzip.GzipFile(filename='', mode='wb', compresslevel=9, fileobj=buf, mtime=0) as f:
+        f.write(data)
+    return buf.getvalue()
+
+
+def load_asset(root, path):
+    ext = os.path.splitext(path)[1].lower()
+
+    with open(os.path.join(root, path), 'rb') as f:
+        data = f.read()
+    if ext in TEXT_TYPES:
+        data = minify(data.decode('utf-8')).encode('utf-8')
+
+    slot = None
+    slot_offset = 0
+    markers = list(SLOT_MARKER.finditer(data)) if ext == '.html' else []
+    if len(markers) > 1:
+        raise ValueError('%s: only one slot marker is supported' % path)
+    if markers:
+        slot = markers[0].group(1).decode('ascii')
+        slot_offset = markers[0].start()
+        data = data[:markers[0].start()] + data[markers[0].end():]
+
+    # Templates are spliced at runtime, so they cannot be compressed
+    encoding = None
+    plain = None
+    packed = compress(data)
+    if slot is None and len(packed) < len(data):
+        plain = data
+        data = packed
+        encoding = 'gzip'
+
+    return {
+        'path': '/' + path.replace(os.sep, '/'),
+        'data': bytearray(data),
+        'mime': MIME_TYPES.get(ext, 'application/octet-stream'),
+        'encoding': encoding,
+        'etag': hashlib.sha256(data).hexdigest()[:16],
+        'slot': slot,
+        'slot_offset': slot_offset,
+        'plain': bytearray(plain) if plain is not None else None,
+        'plain_etag': hashlib.sha256(plain).hexdigest()[:16] if plain is not None else None,
+    }
+
+
+def c_string(value):
+    if value is None:
+        return 'NULL'
+    return '"%s"' % value.replace('\\', '\\\\').replace('"', '\\"')
+
+
+def c_array(name, data):
+    lines = ['static const uint8_t %s[] = {' % name]
+    for j in range(0, len(data), 16):
+        lines.append('\t' + ' '.join('0x%02x,' % b for b in data[j:j + 16]))
+    lines.append('};')
+    return lines
+
+
+def write_source(assets, out_path):
+    lines = [
+        '/* Generated by gen_assets.py - do not edit */',
+        '',
+        '#include "assets.h"',
+        '',
+    ]
+
+    for i, asset in enumerate(assets):
+        lines.append('/* %s */' % asset['path'])
+        lines.extend(c_array('asset_%d' % i, asset['data']))
+        lines.append('')
+        if asset['plain'] is not None:
+            lines.append('/* %s, uncompressed */' % asset['path'])
+            lines.extend(c_array('asset_%d_plain' % i, asset['plain']))
+            lines.append('')
+
+    lines.append('const portal_asset_t portal_assets[] = {')
+    for i, asset in enumerate(assets):
+        if asset['plain'] is not None:
+            plain = 'asset_%d_plain, sizeof(asset_%d_plain), %s' % (i, i, c_string('"%s"' % asset['plain_etag']))
+        else:
+            plain = 'NULL, 0, NULL'
+        lines.append('\t{ %s, asset_%d, sizeof(asset_%d), %s, %s, %s, %s, %d, %s },' % (
+            c_string(asset['path']), i, i, c_string(asset['mime']),
+            c_string(asset['encoding']), c_string('"%s"' % asset['etag']),
+            c_string(asset['slot']), asset['slot_offset'], plain))
+    lines.append('};')
+    lines.append('')
+    lines.append('const size_t portal_asset_count = %d;' % len(assets))
+    lines.append('')
+
+    content = '\n'.join(lines)
+
+    # Only rewrite the source when it changes, to avoid needless rebuilds
+    if os.path.exists(out_path):
+        with open(out_path, 'r') as f:
+            if f.read() == content:
+                return
+    with open(out_path, 'w') as f:
+        f.write(content)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print('Usage: %s ASSET_DIR OUTPUT_DIR' % sys.argv[0], file=sys.stderr)
+        return 1
+
+    root = sys.argv[1]
+    out_dir = sys.argv[2]
+
+    paths = []
+    for dirpath, _, filenames in os.walk(root):
+        for name in filenames:
+            paths.append(os.path.relpath(os.path.join(dirpath, name), root))
+
+    # Sorted by byte value to match the strncmp() used by the lookup
+    assets = sorted((load_asset(root, path) for path in paths), key=lambda a: a['path'].encode('utf-8'))
+    write_source(assets, os.path.join(out_dir, 'portal_assets.c'))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -9,12 +9,21 @@
  *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+#include "mbedtls/md.h"
+#include "mbedtls/pkcs5.h"
+
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
 #include "wifi.h"
+#include "app_events.h"
+#include "timeline.h"
 
 // Debug Tags
 #define AP_STA_SETUP_TAG "ap_sta_setup"
 #define SCAN_APS_TAG "scan_aps"
 #define CONNECT_TO_AP_TAG "connect_to_ap"
+#define WIFI_MANAGER_TAG "wifi_manager"
 
 #define MAC_LEN 6
 
@@ -26,40 +35,87 @@ static EventGroupHandle_t s_wifi_event_group;
 #define WIFI_FAIL_BIT      BIT1
 #define STA_MODE_BIT       BIT2
 #define AP_MODE_BIT        BIT3
+#define SCAN_MERGED_BIT    BIT4
+#define STA_UP_BIT         BIT5    /* Station has an IP address. Unlike WIFI_CONNECTED_BIT, not consumed by waits. */
 
-/* Number of unsuccessful reconnect attempts before stop */
-#define WIFI_MAXIMUM_RETRY 1
+/* Longest wait for the event handler to take the results of a single channel scan */
+#define SCAN_MERGE_TIMEOUT_MS 1000
 
 /* Temporary AP Details */
 #define ESP_WIFI_SSID      "ESP_WIFI"
 #define ESP_WIFI_PASS      "password"
-#define MAX_STA_CONN       4
 
-static int s_retry_num = 0;
-int connected = 0;
+/* Set while connect_to_ap_directed() is making attempts, which it retries itself */
+static volatile bool connecting;
+static volatile uint8_t last_disconnect_reason;
+
+static connect_policy_t connect_policy = CONNECT_POLICY_DEFAULT();
+
+/* Set from losing the link until it is back. Attempts after the first are paced by the
+ * connect policy's backoff, and go on until the link is back or a connect takes over. */
+static volatile bool relinking;
+static connect_retry_t relink_retry;
+static esp_timer_handle_t relink_timer;
+
+/* Channel of the scan in progress, or 0 for a scan of all channels */
+static volatile uint8_t scan_channel_pending;
+
 
-ap_details_t *ap_details;
-uint16_t apCount;
+/* WiFi manager. Each part of WiFi is set up the first time it is needed, and kept until
+ * wifi_manager_deinit(), so that changing mode only reconfigures the driver. */
+static struct {
+	wifi_manager_mode_t mode;
+	bool netif_ready;                             /* esp_netif_init() done */
+	bool loop_ready;                              /* Default event loop exists */
+	esp_netif_t *sta_netif;
+	esp_netif_t *ap_netif;
+	esp_event_handler_instance_t wifi_handler;
+	esp_event_handler_instance_t ip_handler;
+	StaticEventGroup_t events_buffer;
+} wifi_manager;
 
-esp_netif_t *ap_netif;
-esp_netif_t *sta_netif;
+static wifi_listener_t wifi_listener;
+static void *wifi_listener_arg;
+
+/* Held while the listener is changed or called, so that it is never called with the argument
+ * of another, and never called once it has been removed */
+static SemaphoreHandle_t listener_lock;
+static StaticSemaphore_t listener_lock_buffer;
 
 /*
- * Check if a particular ssid exists in list up to the current index
- * This is to prevent duplicate SSIDs occuring in the list
+ * Pass an event on to the listener, if there is one
  */
-int ssid_exists(char *ssid, ap_details_t *list, int index) {
-	if (index == 0) {
-		ESP_LOGI("Check SSID Exists", "List is empty - SSID does not exist");
-		return 0;
+static void notify(wifi_notification_t notification) {
+	// No lock means no listener has ever been set
+	if (listener_lock == NULL) {
+		return;
 	}
-	for (int i = 0; i < index; i++) {
-		if (strcmp(ssid, list[i].ssid) == 0) {
-			ESP_LOGI("Check SSID Exists", "List contains SSID %s", ssid);
-			return 1;
-		}
+
+	xSemaphoreTake(listener_lock, portMAX_DELAY);
+	if (wifi_listener != NULL) {
+		wifi_listener(notification, wifi_listener_arg);
+	}
+	xSemaphoreGive(listener_lock);
+}
+
+/*
+ * Stop reconnecting a lost link
+ */
+static void stop_relink() {
+	relinking = false;
+	if (relink_timer != NULL) {
+		esp_timer_stop(relink_timer);
+	}
+}
+
+/*
+ * Timer callback - make the next attempt to reconnect a lost link
+ */
+static void relink_timer_callback(void *arg) {
+	if (relinking && !connecting) {
+		timeline_record(TIMELINE_CONNECT, 0);
+		esp_wifi_connect();
 	}
-	return 0;
 }
 
 /*
@@ -77,55 +133,48 @@ static void event_handler(void* arg, esp_event_base_t event_base, int32_t event_
 		xEventGroupClearBits(s_wifi_event_group, AP_MODE_BIT);
 	else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_SCAN_DONE) {
 		ESP_LOGI("WiFi Scan Complete", "Found %d APs", ((wifi_event_sta_scan_done_t *) event_data)->number);
-
-		apCount = ((wifi_event_sta_scan_done_t *) event_data)->number;
-		if (apCount == 0) {
-			return;
+		if (scan_channel_pending == 0) {
+			timeline_record(TIMELINE_SCAN_DONE, ((wifi_event_sta_scan_done_t *) event_data)->number);
 		}
 
-		wifi_ap_record_t *list = (wifi_ap_record_t *) malloc(
-				sizeof(wifi_ap_record_t) * apCount);
-		ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&apCount, list));
-
-		ap_details = (ap_details_t *) malloc (sizeof(ap_details_t) * apCount);
-
-		int index = 0;
-
-		for (int i = 0; i < apCount; i++) {
-			if (strlen((char *)list[i].ssid) == 0) {
-				ESP_LOGI("Scan Complete", "Not including SSID as length is 0");
-				continue;
-			} else if (ssid_exists((char *)list[i].ssid, ap_details, index)) {
-				ESP_LOGI("Scan Complete", "Not including SSID %s as it is already included in list", list[i].ssid);
-				continue;
-			}
-
-			memcpy(ap_details[index].ssid, list[i].ssid, sizeof(list[i].ssid)/sizeof(char));
-			ESP_LOGI("Scan Complete", "%s added to list", (char *)ap_details[index].ssid);
-			ap_details[index].authmode = list[i].authmode;
-			index++;
+		uint32_t generation = scan_store_generation();
+		esp_err_t err = (scan_channel_pending == 0) ? scan_store_update() : scan_store_merge_channel(scan_channel_pending);
+		if (err == ESP_OK && scan_store_generation() != generation) {
+			notify(WIFI_NOTIFY_SCAN_DONE);
 		}
-		apCount = index;
-		free(list);
+		xEventGroupSetBits(s_wifi_event_group, SCAN_MERGED_BIT);
+	}
+	else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+		timeline_record(TIMELINE_ASSOCIATED, 0);
+		notify(WIFI_NOTIFY_ASSOCIATED);
 	}
 	else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-		if (s_retry_num < WIFI_MAXIMUM_RETRY) {
+		last_disconnect_reason = ((wifi_event_sta_disconnected_t *) event_data)->reason;
+		ESP_LOGI("Event Handler", "Disconnected from AP, reason %d", last_disconnect_reason);
+		timeline_record(TIMELINE_DISCONNECTED, last_disconnect_reason);
+
+		// A lost connection is re-established straight away, then retried with backoff until it is back.
+		// Failed attempts of connect_to_ap_directed() are retried by it, according to the connect policy.
+		EventBits_t bits = xEventGroupClearBits(s_wifi_event_group, STA_UP_BIT);
+		if (!connecting && (bits & STA_UP_BIT)) {
+			connect_retry_init(&relink_retry, &connect_policy);
+			relinking = true;
 			esp_wifi_connect();
-			ESP_LOGI("Event Handler", "Retry to connect to the AP: attempt %d", s_retry_num);
-			s_retry_num++;
-			ESP_LOGI("Event Handler", "retry to connect to the AP");
-		} else {
-			ESP_LOGI("Event Handler", "Maximum retry reached. Fail bit set.");
-			xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-			connected = 0;
+		} else if (!connecting && relinking) {
+			uint32_t delay_ms = connect_retry_next_delay_ms(&relink_retry, esp_random());
+			ESP_LOGI("Event Handler", "Link still down, retrying in %u ms", delay_ms);
+			esp_timer_start_once(relink_timer, (uint64_t)delay_ms * 1000);
 		}
-		ESP_LOGI("Event Handler","connect to the AP fail");
+		xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+		app_events_post(APP_EVENT_STA_DISCONNECTED, last_disconnect_reason);
 	} else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
 		ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
 		ESP_LOGI("Event Handler", "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-		s_retry_num = 0;
-		connected = 1;
-		xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+		timeline_record(TIMELINE_GOT_IP, 0);
+		stop_relink();
+		xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT | STA_UP_BIT);
+		notify(WIFI_NOTIFY_GOT_IP);
+		app_events_post(APP_EVENT_STA_GOT_IP, 0);
 	} else if (event_id == WIFI_EVENT_AP_STACONNECTED) {
 		wifi_event_ap_staconnected_t* event =
 				(wifi_event_ap_staconnected_t*) event_data;
@@ -139,26 +188,68 @@ static void event_handler(void* arg, esp_event_base_t event_base, int32_t event_
 	}
 }
 
-esp_err_t init_wifi() {
-	s_wifi_event_group = xEventGroupCreate();
+/*
+ * Name of a manager mode, for logging
+ */
+static const char *mode_name(wifi_manager_mode_t mode) {
+	switch (mode) {
+	case	WIFI_MANAGER_UNINIT: return "uninit";
+	case	WIFI_MANAGER_STA:    return "STA";
+	case	WIFI_MANAGER_AP:     return "AP";
+	case	WIFI_MANAGER_APSTA:  return "APSTA";
+	}
+	return "unknown";
+}
 
-	ESP_ERROR_CHECK(esp_netif_init());
+/*
+ * Set up the parts of WiFi shared by every mode: the driver, and the handlers for its events.
+ * The netif stack and default event loop cannot be torn down, so are only ever set up once.
+ */
+static esp_err_t init_wifi() {
+	if (s_wifi_event_group == NULL) {
+		s_wifi_event_group = xEventGroupCreateStatic(&wifi_manager.events_buffer);
+	}
+
+	if (!wifi_manager.netif_ready) {
+		ESP_ERROR_CHECK(esp_netif_init());
+		wifi_manager.netif_ready = true;
+	}
+
+	if (relink_timer == NULL) {
+		esp_timer_create_args_t relink_timer_args = {
+				.callback = relink_timer_callback,
+				.name = "relink"
+		};
+		ESP_ERROR_CHECK(esp_timer_create(&relink_timer_args, &relink_timer));
+	}
 
-	ESP_ERROR_CHECK(esp_event_loop_create_default());
+	if (!wifi_manager.loop_ready) {
+		// Another component may have created the default loop already
+		esp_err_t err = esp_event_loop_create_default();
+		if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+			return err;
+		}
+		wifi_manager.loop_ready = true;
+	}
 
 	wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
 	ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+	ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
 
-	ESP_LOGI("init_wifi", "ESP wifi initialised");
+	ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL,
+			&wifi_manager.wifi_handler));
+	ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL,
+			&wifi_manager.ip_handler));
 
-	return ESP_OK;
-}
+	ESP_LOGI(WIFI_MANAGER_TAG, "ESP wifi initialised");
 
-esp_err_t deinit_wifi() {
-	return esp_netif_deinit();
+	return ESP_OK;
 }
 
-esp_err_t ap_sta_setup() {
+/*
+ * Set the configuration of the ESP32's own AP. SSID is made unique with the MAC address.
+ */
+static void configure_ap() {
 	unsigned char mac[MAC_LEN];
 	char ssid[2*MAC_LEN + strlen(ESP_WIFI_SSID) + 7];
 	char *esp_ssid = ESP_WIFI_SSID;
@@ -167,8 +258,6 @@ esp_err_t ap_sta_setup() {
 
 	printf("Using \"0x%x, 0x%x, 0x%x, 0x%x, 0x%x, 0x%x\" as MAC address\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
 
-	ap_netif = esp_netif_create_default_wifi_ap();
-
 	sprintf(ssid, "%s-%02x:%02x:%02x:%02x:%02x:%02x", esp_ssid, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
 
 	// Set AP configuration
@@ -187,56 +276,140 @@ esp_err_t ap_sta_setup() {
 
 	strcpy((char*)wifi_ap_config.ap.ssid, ssid);
 
-	wifi_config_t wifi_sta_config = {
-			.sta = {
-					.ssid = "",
-					.password = ""
-			}
-	};
-
 	ESP_LOGI(AP_STA_SETUP_TAG, "Set WiFi AP Config");
 
-	ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
-	ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
 	ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_AP, &wifi_ap_config));
-	ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_sta_config));
-	ESP_ERROR_CHECK(esp_wifi_start());
 
-	ESP_LOGI(AP_STA_SETUP_TAG, "Started WiFi as AP. SSID:%s password:%s",
+	ESP_LOGI(AP_STA_SETUP_TAG, "AP SSID:%s password:%s",
 			ssid, ESP_WIFI_PASS);                 //TODO: Remove this?
+}
+
+esp_err_t wifi_manager_set_mode(wifi_manager_mode_t mode) {
+	wifi_manager_mode_t previous = wifi_manager.mode;
 
-//	// Initialise mDNS
-//	esp_err_t err = mdns_init();
-//	if (err) {
-//		ESP_LOGI(AP_STA_SETUP_TAG, "Failed to init mdns: %d", err);
-//	}
-//
-//	mdns_hostname_set("esp32");
-//	mdns_instance_name_set("first boot of esp32");
-//
-//	mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0);
+	if (mode == previous) {
+		return ESP_OK;
+	}
+	if (mode == WIFI_MANAGER_UNINIT) {
+		return wifi_manager_deinit();
+	}
+
+	if (previous == WIFI_MANAGER_UNINIT) {
+		esp_err_t err = init_wifi();
+		if (err != ESP_OK) {
+			return err;
+		}
+	}
+
+	bool sta = (mode == WIFI_MANAGER_STA || mode == WIFI_MANAGER_APSTA);
+	bool ap = (mode == WIFI_MANAGER_AP || mode == WIFI_MANAGER_APSTA);
+	bool had_ap = (previous == WIFI_MANAGER_AP || previous == WIFI_MANAGER_APSTA);
+
+	// Each netif is made the first time its interface is used, and kept when the interface is switched off
+	if (sta && wifi_manager.sta_netif == NULL) {
+		wifi_manager.sta_netif = esp_netif_create_default_wifi_sta();
+	}
+	if (ap && wifi_manager.ap_netif == NULL) {
+		wifi_manager.ap_netif = esp_netif_create_default_wifi_ap();
+	}
+
+	// The driver switches interfaces on and off itself, so a running driver need not be restarted
+	ESP_ERROR_CHECK(esp_wifi_set_mode((wifi_mode_t)mode));
+	if (ap && !had_ap) {
+		configure_ap();
+	}
+	if (previous == WIFI_MANAGER_UNINIT) {
+		ESP_ERROR_CHECK(esp_wifi_start());
+		timeline_record(TIMELINE_WIFI_START, mode);
+	}
+
+	wifi_manager.mode = mode;
+	ESP_LOGI(WIFI_MANAGER_TAG, "Mode %s -> %s", mode_name(previous), mode_name(mode));
 
 	return ESP_OK;
 }
 
-esp_err_t disable_wifi() {
-	ESP_ERROR_CHECK(esp_wifi_stop());
-	ESP_LOGI("disable_wifi", "Complete");
+wifi_manager_mode_t wifi_manager_get_mode() {
+	return wifi_manager.mode;
+}
+
+esp_err_t wifi_manager_deinit() {
+	if (wifi_manager.mode == WIFI_MANAGER_UNINIT) {
+		return ESP_OK;
+	}
+
+	esp_wifi_stop();
+
+	esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_manager.wifi_handler);
+	esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_manager.ip_handler);
+	stop_relink();
+
+	ESP_ERROR_CHECK(esp_wifi_deinit());
+
+	esp_netif_t **netifs[] = { &wifi_manager.sta_netif, &wifi_manager.ap_netif };
+	for (int i = 0; i < sizeof(netifs)/sizeof(netifs[0]); i++) {
+		if (*netifs[i] != NULL) {
+			esp_wifi_clear_default_wifi_driver_and_handlers(*netifs[i]);
+			esp_netif_destroy(*netifs[i]);
+			*netifs[i] = NULL;
+		}
+	}
+
+	xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT | STA_MODE_BIT | AP_MODE_BIT | STA_UP_BIT);
+
+	ESP_LOGI(WIFI_MANAGER_TAG, "Mode %s -> %s", mode_name(wifi_manager.mode), mode_name(WIFI_MANAGER_UNINIT));
+	wifi_manager.mode = WIFI_MANAGER_UNINIT;
 
 	return ESP_OK;
 }
 
-esp_err_t scan_aps() {
-	sta_netif = esp_netif_create_default_wifi_sta();
+esp_err_t wifi_manager_release_ap() {
+	if (wifi_manager.mode != WIFI_MANAGER_STA && wifi_manager.mode != WIFI_MANAGER_APSTA) {
+		return ESP_ERR_INVALID_STATE;
+	}
 
-	ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
-	ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL));
+	// Switching off the AP interface leaves the station and its connection untouched
+	esp_err_t err = wifi_manager_set_mode(WIFI_MANAGER_STA);
+	if (err != ESP_OK) {
+		return err;
+	}
 
-	ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
-	ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
-	ESP_ERROR_CHECK(esp_wifi_start());
+	if (wifi_manager.ap_netif != NULL) {
+		esp_wifi_clear_default_wifi_driver_and_handlers(wifi_manager.ap_netif);
+		esp_netif_destroy(wifi_manager.ap_netif);
+		wifi_manager.ap_netif = NULL;
+		ESP_LOGI(WIFI_MANAGER_TAG, "AP netif freed");
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t ap_sta_setup() {
+	return wifi_manager_set_mode(WIFI_MANAGER_APSTA);
+}
+
+/*
+ * Make sure WiFi is running in a station mode, adding the station to a running AP
+ */
+static esp_err_t start_sta() {
+	switch (wifi_manager.mode) {
+	case	WIFI_MANAGER_STA:
+	case	WIFI_MANAGER_APSTA:
+		return ESP_OK;
+	case	WIFI_MANAGER_AP:
+		return wifi_manager_set_mode(WIFI_MANAGER_APSTA);
+	default:
+		return wifi_manager_set_mode(WIFI_MANAGER_STA);
+	}
+}
+
+esp_err_t scan_aps() {
+	ESP_ERROR_CHECK(scan_store_init());
+	ESP_ERROR_CHECK(start_sta());
 
-	ESP_LOGI(SCAN_APS_TAG, "ESP configured as wifi station/AP");
+	xEventGroupClearBits(s_wifi_event_group, SCAN_MERGED_BIT);
+	scan_channel_pending = 0;
+	timeline_record(TIMELINE_SCAN_START, 0);
 
 	wifi_scan_config_t scanConf = {
 			.ssid = NULL,
@@ -246,110 +419,274 @@ esp_err_t scan_aps() {
 	};
 	ESP_ERROR_CHECK(esp_wifi_scan_start(&scanConf, true));
 
-	ESP_LOGI(SCAN_APS_TAG, "Finished Scan");
+	/* The blocking scan returns before the event handler has moved its results into the store */
+	EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group, SCAN_MERGED_BIT, pdTRUE, pdFALSE,
+			SCAN_MERGE_TIMEOUT_MS/portTICK_PERIOD_MS);
+	if (!(bits & SCAN_MERGED_BIT)) {
+		ESP_LOGW(SCAN_APS_TAG, "Scan results not stored within %d ms", SCAN_MERGE_TIMEOUT_MS);
+		return ESP_ERR_TIMEOUT;
+	}
+
+	ESP_LOGI(SCAN_APS_TAG, "Finished Scan, %d networks stored", scan_store_count());
 
 	return ESP_OK;
 }
 
+esp_err_t scan_channel(uint8_t channel, uint32_t dwell_ms) {
+	wifi_scan_config_t scanConf = {
+			.ssid = NULL,
+			.bssid = NULL,
+			.channel = channel,
+			.show_hidden = false,
+			.scan_type = WIFI_SCAN_TYPE_ACTIVE,
+			.scan_time = {
+					.active = { .min = 0, .max = dwell_ms }
+			}
+	};
+
+	// Results are taken by the event handler, which must be done before another scan starts
+	xEventGroupClearBits(s_wifi_event_group, SCAN_MERGED_BIT);
+	scan_channel_pending = channel;
+	esp_err_t err = esp_wifi_scan_start(&scanConf, true);
+	if (err == ESP_OK) {
+		xEventGroupWaitBits(s_wifi_event_group, SCAN_MERGED_BIT, pdTRUE, pdFALSE,
+				SCAN_MERGE_TIMEOUT_MS/portTICK_PERIOD_MS);
+	}
+
+	return err;
+}
+
+esp_err_t scan_aps_quick(uint32_t dwell_ms) {
+	esp_err_t err = scan_store_init();
+	if (err != ESP_OK) {
+		return err;
+	}
+
+	err = start_sta();
+	if (err != ESP_OK) {
+		return err;
+	}
+
+	wifi_scan_config_t scanConf = {
+			.ssid = NULL,
+			.bssid = NULL,
+			.channel = 0,
+			.show_hidden = false,
+			.scan_type = WIFI_SCAN_TYPE_ACTIVE,
+			.scan_time = {
+					.active = { .min = 0, .max = dwell_ms }
+			}
+	};
+
+	xEventGroupClearBits(s_wifi_event_group, SCAN_MERGED_BIT);
+	scan_channel_pending = 0;
+	timeline_record(TIMELINE_SCAN_START, 0);
+	err = esp_wifi_scan_start(&scanConf, true);
+	if (err == ESP_OK) {
+		xEventGroupWaitBits(s_wifi_event_group, SCAN_MERGED_BIT, pdTRUE, pdFALSE,
+				SCAN_MERGE_TIMEOUT_MS/portTICK_PERIOD_MS);
+		ESP_LOGI(SCAN_APS_TAG, "Quick scan found %d networks", scan_store_count());
+	}
+
+	return err;
+}
+
 int is_sta_connected() {
+	int connected = get_connection_status();
 	ESP_LOGI("is_sta_connected", "%d", connected);
 	return connected;
 }
 
-esp_err_t connect_to_ap(char *ssid, char *pword) {
-	wifi_mode_t wifi_mode;
-	esp_err_t wifi_err = esp_wifi_get_mode(&wifi_mode);
-
-	esp_err_t connect_err = ESP_FAIL;
-
-	if (wifi_err == ESP_ERR_WIFI_NOT_INIT) {
-		// Initialise WiFi
-		init_wifi();          //TODO: move this into other wifi functions?
-		wifi_config_t wifi_config = {
-				.sta = {
-						.ssid = "",		//Must initialise ssid and password as empty strings
-						.password = ""  //in order to strcpy later
-				}
-		};
+/*
+ * Make connection attempts with the STA config already set, until one succeeds or the policy gives up
+ * Returns ESP_OK, ESP_ERR_WIFI_PASSWORD, or ESP_ERR_TIMEOUT
+ */
+static esp_err_t connect_with_policy(const connect_policy_t *policy) {
+	int64_t deadline = esp_timer_get_time() + (int64_t)policy->total_timeout_ms * 1000;
+	connect_retry_t retry;
+
+	connect_retry_init(&retry, policy);
+	connecting = true;
+	stop_relink();
+
+	for (int attempt = 1; ; attempt++) {
+		xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+		last_disconnect_reason = 0;
+		timeline_record(TIMELINE_CONNECT, attempt);
+		esp_wifi_connect();
+
+		EventBits_t bits = xEventGroupWaitBits(
+				s_wifi_event_group,
+				WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+				pdTRUE,
+				pdFALSE,
+				policy->attempt_timeout_ms/portTICK_PERIOD_MS);
+
+		if (bits & WIFI_CONNECTED_BIT) {
+			ESP_LOGI(CONNECT_TO_AP_TAG, "Connected on attempt %d", attempt);
+			connecting = false;
+			return ESP_OK;
+		}
 
-		sta_netif = esp_netif_create_default_wifi_sta();
+		if (bits & WIFI_FAIL_BIT) {
+			ESP_LOGW(CONNECT_TO_AP_TAG, "Attempt %d failed, reason %d", attempt, last_disconnect_reason);
+			if (connect_retry_failed(&retry, last_disconnect_reason)) {
+				ESP_LOGE(CONNECT_TO_AP_TAG, "AP rejected credentials %d times", retry.auth_failures);
+				connecting = false;
+				return ESP_ERR_WIFI_PASSWORD;
+			}
+		} else {
+			ESP_LOGW(CONNECT_TO_AP_TAG, "Attempt %d timed out", attempt);
+			connect_retry_failed(&retry, 0);
+			esp_wifi_disconnect();
+		}
 
-		ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
-		ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL));
+		uint32_t delay_ms = connect_retry_next_delay_ms(&retry, esp_random());
+		int64_t remaining_ms = (deadline - esp_timer_get_time()) / 1000;
+		if (remaining_ms < (int64_t)delay_ms + 1) {
+			break;
+		}
+		vTaskDelay(delay_ms/portTICK_PERIOD_MS);
+	}
 
-		strcpy((char*)wifi_config.sta.ssid, ssid);
-		strcpy((char*)wifi_config.sta.password, pword);
+	ESP_LOGE(CONNECT_TO_AP_TAG, "Gave up after %u ms", policy->total_timeout_ms);
+	connecting = false;
+	return ESP_ERR_TIMEOUT;
+}
 
-		ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
-		ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-		ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+esp_err_t connect_to_ap(char *ssid, char *pword) {
+	return connect_to_ap_directed(ssid, pword, NULL, NULL);
+}
 
-		ESP_ERROR_CHECK(esp_wifi_start());
+esp_err_t connect_to_ap_directed(char *ssid, char *pword, const ap_hint_t *hint, const connect_policy_t *policy) {
+	esp_err_t err = start_sta();
+	if (err != ESP_OK) {
+		return err;
+	}
 
-		connect_err = esp_wifi_connect();
+	wifi_config_t wifi_config;
+	memset(&wifi_config, 0, sizeof(wifi_config));
+	strncpy((char*)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
 
-	} else if(wifi_mode == WIFI_MODE_APSTA) {
-		wifi_config_t wifi_config;
+	if (hint != NULL) {
+		// Only the given channel is scanned, and only the given BSSID accepted
+		wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+		wifi_config.sta.bssid_set = true;
+		memcpy(wifi_config.sta.bssid, hint->bssid, sizeof(wifi_config.sta.bssid));
+		wifi_config.sta.channel = hint->channel;
+	} else {
+		wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+		wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+	}
 
-		ESP_ERROR_CHECK(esp_wifi_get_config(WIFI_IF_STA, &wifi_config));
+	if (hint != NULL && hint->has_pmk) {
+		// A 64 hex digit password is taken as the PSK itself, skipping the 4096 round derivation
+		// Filled without a terminator, as the password field holds exactly 64 characters
+		static const char hex[] = "0123456789abcdef";
+		for (int i = 0; i < PMK_LEN; i++) {
+			wifi_config.sta.password[2*i] = hex[hint->pmk[i] >> 4];
+			wifi_config.sta.password[2*i + 1] = hex[hint->pmk[i] & 0xF];
+		}
+	} else {
+		strncpy((char*)wifi_config.sta.password, pword, sizeof(wifi_config.sta.password));
+	}
 
-		strcpy((char*)wifi_config.sta.ssid, ssid);
-		strcpy((char*)wifi_config.sta.password, pword);
+	ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
 
-		ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+	ESP_LOGI(CONNECT_TO_AP_TAG, "Connecting to wifi: ssid: %s, %s", ssid, (hint != NULL) ? "directed" : "full scan");
 
-		connect_err = esp_wifi_connect();
+	err = connect_with_policy((policy != NULL) ? policy : &connect_policy);
+	if (err != ESP_OK) {
+		notify(WIFI_NOTIFY_FAILED);
 	}
-	ESP_LOGI(CONNECT_TO_AP_TAG, "Set up connection to wifi: ssid: %s, pword: %s", ssid, pword);
 
+	return err;
+}
 
-	ESP_LOGI(CONNECT_TO_AP_TAG, "Set up connection to wifi with error code %s", esp_err_to_name(connect_err));
-
-	ESP_LOGI(CONNECT_TO_AP_TAG, "Waiting for connection to be made");
-	xEventGroupWaitBits(
-			s_wifi_event_group,
-			WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-			pdFALSE,
-			pdFALSE,
-			portMAX_DELAY);
+esp_err_t get_ap_hint(const char *ssid, const char *pword, ap_hint_t *hint) {
+	wifi_ap_record_t ap_info;
 
-	xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-	xEventGroupClearBits(s_wifi_event_group, WIFI_FAIL_BIT);
+	esp_err_t err = esp_wifi_sta_get_ap_info(&ap_info);
+	if (err != ESP_OK) {
+		return err;
+	}
 
-	ESP_LOGI(CONNECT_TO_AP_TAG, "Connection or fail made");
+	memset(hint, 0, sizeof(ap_hint_t));
+	memcpy(hint->bssid, ap_info.bssid, sizeof(hint->bssid));
+	hint->channel = ap_info.primary;
 
-	if (is_sta_connected()) {
+	// WPA3 uses SAE, which has no fixed PMK to cache
+	if (ap_info.authmode == WIFI_AUTH_OPEN || ap_info.authmode == WIFI_AUTH_WEP ||
+			ap_info.authmode >= WIFI_AUTH_WPA2_ENTERPRISE) {
 		return ESP_OK;
-	} else {
-		return ESP_FAIL;
 	}
+
+	// PMK = PBKDF2-HMAC-SHA1(passphrase, ssid, 4096, 32), as in IEEE 802.11i
+	mbedtls_md_context_t ctx;
+	mbedtls_md_init(&ctx);
+	if (mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA1), 1) == 0 &&
+			mbedtls_pkcs5_pbkdf2_hmac(&ctx, (const unsigned char *)pword, strlen(pword),
+					(const unsigned char *)ssid, strlen(ssid), 4096, PMK_LEN, hint->pmk) == 0) {
+		hint->has_pmk = 1;
+	}
+	mbedtls_md_free(&ctx);
+
+	return ESP_OK;
 }
 
-ap_details_t get_ap_details(int index) { //TODO: Error check for scan incomplete
-	return ap_details[index];
+ap_details_t get_ap_details(int index) {
+	ap_details_t ap;
+	scan_store_get(index, &ap);
+	return ap;
 }
 
-int get_ap_count() {   //TODO: Error check for scan incomplete
-	return apCount;
+esp_err_t find_ap_details(const char *ssid, ap_details_t *ap) {
+	return scan_store_find(ssid, ap);
+}
+
+int get_ap_count() {
+	return scan_store_count();
+}
+
+uint32_t get_scan_generation() {
+	return scan_store_generation();
 }
 
 esp_netif_t *get_sta_netif() {
-	return sta_netif;
+	return wifi_manager.sta_netif;
 }
 
 esp_netif_t *get_ap_netif() {
-	return ap_netif;
+	return wifi_manager.ap_netif;
 }
 
 uint32_t get_ap_ip_address() {
 
 	esp_netif_ip_info_t ip_info;
 
-	esp_netif_get_ip_info(ap_netif, &ip_info);
+	esp_netif_get_ip_info(wifi_manager.ap_netif, &ip_info);
 
 	return ip_info.ip.addr;
 }
 
+void set_wifi_listener(wifi_listener_t listener, void *arg) {
+	if (listener_lock == NULL) {
+		listener_lock = xSemaphoreCreateMutexStatic(&listener_lock_buffer);
+	}
+
+	xSemaphoreTake(listener_lock, portMAX_DELAY);
+	wifi_listener = listener;
+	wifi_listener_arg = arg;
+	xSemaphoreGive(listener_lock);
+}
+
+void set_connect_policy(const connect_policy_t *policy) {
+	connect_policy = *policy;
+}
+
 int get_connection_status() {
-	return connected;
+	if (s_wifi_event_group == NULL) {
+		return 0;
+	}
+	return (xEventGroupGetBits(s_wifi_event_group) & STA_UP_BIT) ? 1 : 0;
 }
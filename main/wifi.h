@@ -28,63 +28,169 @@
 #include "lwip/sys.h"
 
 #include "memory.h"
+#include "connect_policy.h"
+#include "scan_store.h"
+
+/* Maximum number of stations that may join the ESP32 AP */
+#define MAX_STA_CONN       4
+
+/** WiFi events passed on to a listener */
+typedef enum {
+	WIFI_NOTIFY_SCAN_DONE = 0,     /* Scan complete and AP list updated */
+	WIFI_NOTIFY_ASSOCIATED = 1,    /* Station associated with an AP */
+	WIFI_NOTIFY_GOT_IP = 2,        /* Station got an IP address */
+	WIFI_NOTIFY_FAILED = 3         /* Station gave up connecting */
+} wifi_notification_t;
+
+/** Callback for WiFi events. Runs in the event loop task or a connecting task, so must not block. */
+typedef void (*wifi_listener_t)(wifi_notification_t notification, void *arg);
+
+/** Modes of the WiFi manager. Values match wifi_mode_t. */
+typedef enum {
+	WIFI_MANAGER_UNINIT = 0,    /* Driver not initialised */
+	WIFI_MANAGER_STA = 1,       /* Station only */
+	WIFI_MANAGER_AP = 2,        /* ESP32 AP only */
+	WIFI_MANAGER_APSTA = 3      /* Station and ESP32 AP */
+} wifi_manager_mode_t;
 
-/** Struct to hold info about scanned APs */
-typedef struct {
-	char ssid[33];
-	int authmode;
-} ap_details_t;
+/**
+ * @brief Put WiFi in a mode. The driver, netifs and event handlers are set up the first time they are
+ * needed and kept, so changing between modes only reconfigures the driver. Does nothing if already in the mode.
+ * @param mode Mode to enter. WIFI_MANAGER_UNINIT tears WiFi down, as wifi_manager_deinit().
+ * @return ESP_OK on success
+ */
+esp_err_t wifi_manager_set_mode(wifi_manager_mode_t mode);
 
 /**
- * @brief Initialise ESP32 wifi.
- * @return ESP_OK on wifi successfully initialised
+ * @brief Get the mode of the WiFi manager
  */
-esp_err_t init_wifi();
+wifi_manager_mode_t wifi_manager_get_mode();
 
 /**
- * @brief De-initialise ESP32 wifi.
- * @return ESP_OK on wifi successfully de-initialised
+ * @brief Stop WiFi and free the driver, netifs and event handlers. WiFi can be started again
+ * with wifi_manager_set_mode().
+ * @return ESP_OK on success, including when WiFi was not initialised
  */
-esp_err_t deinit_wifi();
+esp_err_t wifi_manager_deinit();
 
 /**
- * @brief Setup ESP as wifi access point.
+ * @brief Switch off the ESP32 AP and free its netif, keeping the station and any connection it has.
+ * @return ESP_OK on success. ESP_ERR_INVALID_STATE if the station is not running.
+ */
+esp_err_t wifi_manager_release_ap();
+
+/**
+ * @brief Setup ESP as wifi access point, keeping the station running.
  * @return ESP_OK on AP successfully set up
  */
 esp_err_t ap_sta_setup();
 
 /**
- * @brief Disable wifi. Must be performed when switching between AP and STA wifi modes.
- * @return ESP_OK on wifi disabled
+ * @brief Scan for nearby APs. Starts WiFi as a station if it is not running in a station mode.
+ * Returns once the results are in the scan store.
+ * @return ESP_OK on scan complete. ESP_ERR_TIMEOUT if the results were not stored in time.
  */
-esp_err_t disable_wifi();
+esp_err_t scan_aps();
+
+/* Length of a WPA2 pairwise master key */
+#define PMK_LEN 32
+
+/** Details of an AP previously connected to, which let a reconnect skip the scan and key derivation */
+typedef struct {
+	uint8_t bssid[6];
+	uint8_t channel;
+	uint8_t has_pmk;      /* Set if pmk is valid. Not used for open or WPA3 networks. */
+	uint8_t pmk[PMK_LEN];
+} ap_hint_t;
 
 /**
- * @brief Scan for nearby APs.
- * @return ESP_OK on scan complete and wifi disabled.
+ * @brief Set the policy used when connect_to_ap() and connect_to_ap_directed() are not given one.
+ * @param policy Policy to copy
  */
-esp_err_t scan_aps();
+void set_connect_policy(const connect_policy_t *policy);
+
+/**
+ * @brief Scan a single channel, merging the results into the scan list. Blocks until the scan is done.
+ * WiFi must already be started in a station mode.
+ * @param channel Channel to scan
+ * @param dwell_ms Longest time to spend on the channel
+ * @return ESP_OK on success. Error from esp_wifi_scan_start() otherwise.
+ */
+esp_err_t scan_channel(uint8_t channel, uint32_t dwell_ms);
+
+/**
+ * @brief Scan all channels briefly, replacing the scan list. Starts WiFi as a station if it is not
+ * running. Blocks until the scan is done. Networks with hidden SSIDs are not listed.
+ * @param dwell_ms Longest time to spend on each channel
+ * @return ESP_OK on success
+ */
+esp_err_t scan_aps_quick(uint32_t dwell_ms);
 
 /**
- * @brief Connect to a specified AP.
+ * @brief Connect to a specified AP, retrying as set by the connect policy.
  * @param ssid SSID of AP to connect to
  * @param pword Password of AP to connect to
- * @return ESP_OK on successfully connected to AP
+ * @return ESP_OK on successfully connected to AP.
+ *         ESP_ERR_WIFI_PASSWORD if the AP repeatedly rejected the credentials.
+ *         ESP_ERR_TIMEOUT if the AP could not be reached within the policy's deadline.
  */
 esp_err_t connect_to_ap(char *ssid, char *pword);
 
 /**
- * @brief Obtain list of aps scanned by ESP32
- * @return ap_details_t object for specified index.
+ * @brief Connect to a specified AP, going straight to a known BSSID and channel.
+ * @param ssid SSID of AP to connect to
+ * @param pword Password of AP to connect to. Not used if the hint has a PMK.
+ * @param hint Where to find the AP. NULL to scan all channels and pick the strongest AP.
+ * @param policy Retry policy. NULL for the policy set by set_connect_policy().
+ * @return As connect_to_ap()
+ */
+esp_err_t connect_to_ap_directed(char *ssid, char *pword, const ap_hint_t *hint, const connect_policy_t *policy);
+
+/**
+ * @brief Record where the station is connected, for use by a later connect_to_ap_directed().
+ * Derives the PMK from the SSID and password, which takes a few hundred milliseconds.
+ * @param ssid SSID of the AP
+ * @param pword Password of the AP
+ * @param hint Output hint
+ * @return ESP_OK on success. ESP_ERR_WIFI_NOT_CONNECT if the station is not connected.
+ */
+esp_err_t get_ap_hint(const char *ssid, const char *pword, ap_hint_t *hint);
+
+/**
+ * @brief Obtain list of aps scanned by ESP32. APs are ordered strongest first.
+ * @return ap_details_t object for specified index. Zeroed if index is out of range.
  */
 ap_details_t get_ap_details(int index);
 
+/**
+ * @brief Find a scanned AP by SSID
+ * @param ssid SSID of AP
+ * @param ap Details of AP. Zeroed if it is not in the list.
+ * @return ESP_OK on success. ESP_ERR_NOT_FOUND if no AP in the list has that SSID.
+ */
+esp_err_t find_ap_details(const char *ssid, ap_details_t *ap);
+
 /**
  * @brief Get number of aps scanned by ESP32
  * @return number of APs found in scan.
  */
 int get_ap_count();
 
+/**
+ * @brief Get number of scans completed. Changes whenever the AP list changes.
+ * @return Scan generation
+ */
+uint32_t get_scan_generation();
+
+/**
+ * @brief Set the listener told about scan and connection events. Replaces any previous listener.
+ * Waits for a call to the previous listener to finish, so that once a listener is removed it is
+ * never called again. Must not be called from the listener.
+ * @param listener Callback, or NULL to remove the listener
+ * @param arg Argument passed to the callback
+ */
+void set_wifi_listener(wifi_listener_t listener, void *arg);
+
 /**
  * @brief Get connection status of WiFi station
  * @return 1 if connected, 0 otherwise
@@ -0,0 +1,41 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Disconnect Reasons
+ * Every reason code the driver gives for a station
+ * disconnect, and whether it means the AP rejected the
+ * credentials, for the connect policy and WiFi tests.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "esp_wifi_types.h"
+#include "disconnect_reasons.h"
+
+const reason_case_t disconnect_reasons[] = {
+		{ 0, false },
+		{ WIFI_REASON_UNSPECIFIED, false },
+		{ WIFI_REASON_AUTH_EXPIRE, false },            // AP did not answer - weak signal or out of range
+		{ WIFI_REASON_AUTH_LEAVE, false },
+		{ WIFI_REASON_ASSOC_EXPIRE, false },
+		{ WIFI_REASON_ASSOC_TOOMANY, false },
+		{ WIFI_REASON_NOT_AUTHED, false },
+		{ WIFI_REASON_NOT_ASSOCED, false },
+		{ WIFI_REASON_ASSOC_LEAVE, false },
+		{ WIFI_REASON_ASSOC_NOT_AUTHED, false },
+		{ WIFI_REASON_MIC_FAILURE, false },            // TKIP countermeasure
+		{ WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT, true },
+		{ WIFI_REASON_GROUP_KEY_UPDATE_TIMEOUT, false },
+		{ WIFI_REASON_IE_IN_4WAY_DIFFERS, false },
+		{ WIFI_REASON_802_1X_AUTH_FAILED, true },
+		{ WIFI_REASON_BEACON_TIMEOUT, false },
+		{ WIFI_REASON_NO_AP_FOUND, false },
+		{ WIFI_REASON_AUTH_FAIL, true },
+		{ WIFI_REASON_ASSOC_FAIL, false },
+		{ WIFI_REASON_HANDSHAKE_TIMEOUT, true },
+		{ WIFI_REASON_CONNECTION_FAIL, false },
+};
+
+const int disconnect_reason_count = sizeof(disconnect_reasons)/sizeof(disconnect_reasons[0]);
@@ -0,0 +1,29 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Disconnect Reasons
+ * Every reason code the driver gives for a station
+ * disconnect, and whether it means the AP rejected the
+ * credentials, for the connect policy and WiFi tests.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HOST_DISCONNECT_REASONS_H_
+#define HOST_DISCONNECT_REASONS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** A disconnect reason, and whether it means the credentials were rejected */
+typedef struct {
+	uint8_t reason;
+	bool auth_failure;
+} reason_case_t;
+
+extern const reason_case_t disconnect_reasons[];
+extern const int disconnect_reason_count;
+
+#endif /* HOST_DISCONNECT_REASONS_H_ */
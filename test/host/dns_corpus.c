@@ -0,0 +1,119 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * DNS Corpus
+ * Queries of the kind phones and laptops send while
+ * they sit on the captive portal - connectivity-check
+ * hosts, AAAA and HTTPS lookups alongside every A, and
+ * random names - for the DNS tests and benchmarks.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <string.h>
+
+#include "dns_corpus.h"
+
+/* EDNS OPT record: root name, type 41, UDP payload size 1232, no extended flags or options */
+static const uint8_t edns_opt[] = { 0, 0, 41, 0x04, 0xD0, 0, 0, 0, 0, 0, 0 };
+
+/* Lookups made by each kind of client when it joins a network */
+typedef struct {
+	const char *name;
+	uint16_t qtype;
+	bool edns;
+} corpus_entry_t;
+
+static const corpus_entry_t corpus_entries[] = {
+		/* iOS and macOS - A, AAAA and HTTPS for the probe host */
+		{ "captive.apple.com",             QTYPE_A,     false },
+		{ "captive.apple.com",             QTYPE_AAAA,  false },
+		{ "captive.apple.com",             QTYPE_HTTPS, false },
+		{ "www.apple.com",                 QTYPE_A,     false },
+		{ "www.apple.com",                 QTYPE_AAAA,  false },
+		{ "gateway.icloud.com",            QTYPE_A,     false },
+		{ "gateway.icloud.com",            QTYPE_HTTPS, false },
+		{ "mesu.apple.com",                QTYPE_A,     false },
+		/* Android */
+		{ "connectivitycheck.gstatic.com", QTYPE_A,     true },
+		{ "connectivitycheck.gstatic.com", QTYPE_AAAA,  true },
+		{ "www.google.com",                QTYPE_A,     true },
+		{ "www.google.com",                QTYPE_AAAA,  true },
+		{ "time.android.com",              QTYPE_A,     true },
+		{ "mtalk.google.com",              QTYPE_A,     true },
+		{ "play.googleapis.com",           QTYPE_HTTPS, true },
+		/* Windows */
+		{ "www.msftconnecttest.com",       QTYPE_A,     false },
+		{ "www.msftconnecttest.com",       QTYPE_AAAA,  false },
+		{ "dns.msftncsi.com",              QTYPE_A,     false },
+		{ "dns.msftncsi.com",              QTYPE_AAAA,  false },
+		{ "login.live.com",                QTYPE_A,     false },
+		/* Linux laptops */
+		{ "nmcheck.gnome.org",             QTYPE_A,     true },
+		{ "nmcheck.gnome.org",             QTYPE_AAAA,  true },
+		{ "connectivity-check.ubuntu.com", QTYPE_A,     true },
+		{ "detectportal.firefox.com",      QTYPE_A,     true },
+		{ "detectportal.firefox.com",      QTYPE_AAAA,  true },
+		/* Chrome checks for DNS interception with random names */
+		{ "qvxhzkmt",                      QTYPE_A,     false },
+		{ "bnwqlpzeyr",                    QTYPE_A,     false },
+		{ "tjrkxmwvaoq",                   QTYPE_A,     false },
+		/* Browsing that starts before the portal is dismissed */
+		{ "example.com",                   QTYPE_A,     true },
+		{ "fonts.googleapis.com",          QTYPE_A,     true },
+		{ "fonts.googleapis.com",          QTYPE_HTTPS, true },
+		{ "graph.facebook.com",            QTYPE_A,     false },
+};
+#define CORPUS_ENTRY_COUNT (sizeof(corpus_entries)/sizeof(corpus_entries[0]))
+
+size_t dns_encode_query(uint8_t *out, uint16_t id, const char *name, uint16_t qtype, bool edns) {
+	uint8_t *p = out;
+
+	// Header - standard query, RD, one question
+	memset(p, 0, DNS_HEADER_LEN);
+	p[0] = id >> 8;
+	p[1] = id & 0xFF;
+	p[2] = FLAG_RD;
+	p[5] = 1;
+	p[11] = edns ? 1 : 0;
+	p += DNS_HEADER_LEN;
+
+	while (*name) {
+		const char *dot = strchr(name, '.');
+		size_t len = dot ? (size_t)(dot - name) : strlen(name);
+
+		*p++ = len;
+		memcpy(p, name, len);
+		p += len;
+		name += len + (dot ? 1 : 0);
+	}
+	*p++ = 0;
+
+	*p++ = qtype >> 8;
+	*p++ = qtype & 0xFF;
+	*p++ = QCLASS_IN >> 8;
+	*p++ = QCLASS_IN & 0xFF;
+
+	if (edns) {
+		memcpy(p, edns_opt, sizeof(edns_opt));
+		p += sizeof(edns_opt);
+	}
+
+	return p - out;
+}
+
+int dns_corpus_build(dns_corpus_query_t *out) {
+	int count = 0;
+
+	for (int i = 0; i < CORPUS_ENTRY_COUNT && count < DNS_CORPUS_MAX; i++, count++) {
+		const corpus_entry_t *entry = &corpus_entries[i];
+
+		out[count].length = dns_encode_query(out[count].data, 0x1000 + i, entry->name, entry->qtype, entry->edns);
+		out[count].qtype = entry->qtype;
+		out[count].edns = entry->edns;
+	}
+
+	return count;
+}
@@ -0,0 +1,53 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * DNS Corpus
+ * Queries of the kind phones and laptops send while
+ * they sit on the captive portal - connectivity-check
+ * hosts, AAAA and HTTPS lookups alongside every A, and
+ * random names - for the DNS tests and benchmarks.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HOST_DNS_CORPUS_H_
+#define HOST_DNS_CORPUS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "dns.h"
+
+/* Largest number of queries in the corpus */
+#define DNS_CORPUS_MAX 64
+
+/** A query, as received */
+typedef struct {
+	uint8_t data[DNS_LEN];
+	uint16_t length;
+	uint16_t qtype;
+	bool edns;
+} dns_corpus_query_t;
+
+/**
+ * @brief Encode a standard query for a single question, with recursion desired
+ * @param out Output packet of at least DNS_LEN bytes
+ * @param id Query ID
+ * @param name Dotted name, e.g. "captive.apple.com"
+ * @param qtype Type asked for
+ * @param edns Set to add an EDNS OPT record, as many stub resolvers do
+ * @return Length of packet
+ */
+size_t dns_encode_query(uint8_t *out, uint16_t id, const char *name, uint16_t qtype, bool edns);
+
+/**
+ * @brief Build the corpus
+ * @param out Output queries, DNS_CORPUS_MAX of them
+ * @return Number of queries built
+ */
+int dns_corpus_build(dns_corpus_query_t *out);
+
+#endif /* HOST_DNS_CORPUS_H_ */
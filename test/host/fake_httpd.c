@@ -0,0 +1,352 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Fake HTTP Server
+ * Stand-in for esp_http_server that lets a test hand a
+ * request to a handler and read back the response. The
+ * socket writes httpd would make are counted as it
+ * makes them, so responses can be compared by the bytes
+ * and writes they cost on the SoftAP.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_http_client.h"
+
+#include "fake_httpd.h"
+
+/* Socket numbers that can be marked as WebSocket connections */
+#define FAKE_WS_FDS 64
+
+char fake_ws_frame[FAKE_WS_FRAME_SIZE + 1];
+int fake_ws_frames_sent;
+int fake_httpd_work_queued;
+httpd_config_t fake_httpd_config;
+
+static bool ws_open[FAKE_WS_FDS];
+static int server;
+
+/*
+ * @brief Copy a string, truncating it to fit
+ * @return true if it had to be truncated
+ */
+static bool copy_string(char *out, size_t size, const char *value) {
+	size_t length = strlen(value);
+	bool truncated = (length >= size);
+
+	if (truncated) {
+		length = size - 1;
+	}
+	memcpy(out, value, length);
+	out[length] = '\0';
+
+	return truncated;
+}
+
+void fake_request_init(fake_request_t *r, httpd_method_t method, const char *uri) {
+	memset(r, 0, sizeof(fake_request_t));
+	r->req.handle = &server;
+	r->req.method = method;
+	copy_string((char *)r->req.uri, sizeof(r->req.uri), uri);
+	r->fd = 54;
+	strcpy(r->status, "200 OK");
+	strcpy(r->type, "text/html");
+}
+
+void fake_request_add_header(fake_request_t *r, const char *field, const char *value) {
+	copy_string(r->req_headers[r->req_header_count][0], FAKE_HTTPD_HEADER_SIZE, field);
+	copy_string(r->req_headers[r->req_header_count][1], FAKE_HTTPD_HEADER_SIZE, value);
+	r->req_header_count++;
+}
+
+void fake_request_set_body(fake_request_t *r, const char *body) {
+	r->body = body;
+	r->body_read = 0;
+	r->req.content_len = strlen(body);
+}
+
+const char *fake_response_header(const fake_request_t *r, const char *field) {
+	for (int i = 0; i < r->header_count; i++) {
+		if (strcasecmp(r->headers[i][0], field) == 0) {
+			return r->headers[i][1];
+		}
+	}
+	return NULL;
+}
+
+int fake_response_code(const fake_request_t *r) {
+	return atoi(r->status);
+}
+
+void fake_ws_set_open(int fd, bool open) {
+	ws_open[fd % FAKE_WS_FDS] = open;
+}
+
+void fake_httpd_reset() {
+	memset(ws_open, 0, sizeof(ws_open));
+	fake_ws_frame[0] = '\0';
+	fake_ws_frames_sent = 0;
+	fake_httpd_work_queued = 0;
+}
+
+/* Server */
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+	fake_httpd_config = *config;
+	*handle = &server;
+	return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+	return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+	return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(const char *reference_uri, const char *uri_to_match, size_t match_upto) {
+	return false;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+	fake_httpd_work_queued++;
+	work(arg);
+	return ESP_OK;
+}
+
+/* Requests */
+
+int httpd_req_recv(httpd_req_t *req, char *buf, size_t buf_len) {
+	fake_request_t *r = (fake_request_t *)req;
+	size_t remaining = req->content_len - r->body_read;
+	size_t length = (buf_len < remaining) ? buf_len : remaining;
+
+	if (r->recv_piece > 0 && length > r->recv_piece) {
+		length = r->recv_piece;
+	}
+	memcpy(buf, &r->body[r->body_read], length);
+	r->body_read += length;
+
+	return length;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *req) {
+	return ((fake_request_t *)req)->fd;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *req, const char *field, char *val, size_t val_size) {
+	fake_request_t *r = (fake_request_t *)req;
+
+	for (int i = 0; i < r->req_header_count; i++) {
+		if (strcasecmp(r->req_headers[i][0], field) == 0) {
+			return copy_string(val, val_size, r->req_headers[i][1]) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+		}
+	}
+	return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t buf_len) {
+	const char *query = strchr(req->uri, '?');
+
+	if (query == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	return copy_string(buf, buf_len, query + 1) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+	size_t key_length = strlen(key);
+
+	for (const char *p = qry; p != NULL && *p; p = strchr(p, '&') ? strchr(p, '&') + 1 : NULL) {
+		if (strncmp(p, key, key_length) == 0 && p[key_length] == '=') {
+			const char *value = &p[key_length + 1];
+			size_t length = strcspn(value, "&");
+			bool truncated = (length >= val_size);
+
+			if (truncated) {
+				length = val_size - 1;
+			}
+			memcpy(val, value, length);
+			val[length] = '\0';
+			return truncated ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+		}
+	}
+	return ESP_ERR_NOT_FOUND;
+}
+
+/* Responses - written to the socket in the same pieces as httpd writes them */
+
+/*
+ * @brief Count a write to the client socket, keeping the bytes if they are body
+ */
+static void socket_write(fake_request_t *r, const char *data, size_t length, bool body) {
+	r->writes++;
+	r->wire_bytes += length;
+
+	if (body && data != NULL) {
+		size_t space = FAKE_HTTPD_BODY_SIZE - r->response_length;
+		size_t kept = (length < space) ? length : space;
+
+		memcpy(&r->response[r->response_length], data, kept);
+		r->response_length += kept;
+		r->response[r->response_length] = '\0';
+	}
+}
+
+/*
+ * @brief Write the status line and headers: the essential headers in one write, then one
+ * write for each header set by the handler, then the blank line
+ */
+static void send_headers(fake_request_t *r, ssize_t content_length) {
+	char line[160];
+
+	if (r->chunked) {
+		snprintf(line, sizeof(line), "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n",
+				r->status, r->type);
+	} else {
+		snprintf(line, sizeof(line), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n",
+				r->status, r->type, (int)content_length);
+	}
+	socket_write(r, line, strlen(line), false);
+
+	for (int i = 0; i < r->header_count; i++) {
+		snprintf(line, sizeof(line), "%s: %s\r\n", r->headers[i][0], r->headers[i][1]);
+		socket_write(r, line, strlen(line), false);
+	}
+
+	socket_write(r, "\r\n", 2, false);
+	r->headers_sent = true;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *req, const char *status) {
+	copy_string(((fake_request_t *)req)->status, sizeof(((fake_request_t *)req)->status), status);
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *type) {
+	copy_string(((fake_request_t *)req)->type, sizeof(((fake_request_t *)req)->type), type);
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *field, const char *value) {
+	fake_request_t *r = (fake_request_t *)req;
+
+	if (r->header_count == FAKE_HTTPD_HEADERS) {
+		return ESP_ERR_NO_MEM;
+	}
+	copy_string(r->headers[r->header_count][0], FAKE_HTTPD_HEADER_SIZE, field);
+	copy_string(r->headers[r->header_count][1], FAKE_HTTPD_HEADER_SIZE, value);
+	r->header_count++;
+
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *req, const char *buf, ssize_t buf_len) {
+	fake_request_t *r = (fake_request_t *)req;
+
+	if (r->finished || r->headers_sent) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (buf_len == HTTPD_RESP_USE_STRLEN) {
+		buf_len = (buf == NULL) ? 0 : strlen(buf);
+	}
+
+	send_headers(r, buf_len);
+	if (buf != NULL && buf_len > 0) {
+		socket_write(r, buf, buf_len, true);
+	}
+	r->finished = true;
+
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t buf_len) {
+	fake_request_t *r = (fake_request_t *)req;
+	char size_line[16];
+
+	if (r->finished || (r->headers_sent && !r->chunked)) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (buf_len == HTTPD_RESP_USE_STRLEN) {
+		buf_len = (buf == NULL) ? 0 : strlen(buf);
+	}
+	if (!r->headers_sent) {
+		r->chunked = true;
+		send_headers(r, 0);
+	}
+
+	// Each chunk is its size line, its data and a CRLF
+	snprintf(size_line, sizeof(size_line), "%x\r\n", (unsigned)buf_len);
+	socket_write(r, size_line, strlen(size_line), false);
+	if (buf != NULL && buf_len > 0) {
+		socket_write(r, buf, buf_len, true);
+	}
+	socket_write(r, "\r\n", 2, false);
+
+	if (buf == NULL || buf_len == 0) {
+		r->finished = true;
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+	char status[32];
+
+	switch (error) {
+	case	HTTPD_400_BAD_REQUEST:
+		strcpy(status, "400 Bad Request");
+		break;
+	case	HTTPD_404_NOT_FOUND:
+		strcpy(status, "404 Not Found");
+		break;
+	case	HTTPD_408_REQ_TIMEOUT:
+		strcpy(status, "408 Request Timeout");
+		break;
+	default:
+		strcpy(status, "500 Internal Server Error");
+		break;
+	}
+
+	httpd_resp_set_status(req, status);
+	httpd_resp_set_type(req, "text/html");
+	return httpd_resp_send(req, (msg != NULL) ? msg : status, HTTPD_RESP_USE_STRLEN);
+}
+
+/* WebSockets */
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len) {
+	pkt->len = 0;
+	return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame) {
+	if (!ws_open[fd % FAKE_WS_FDS]) {
+		return ESP_FAIL;
+	}
+
+	size_t length = (frame->len < FAKE_WS_FRAME_SIZE) ? frame->len : FAKE_WS_FRAME_SIZE;
+	memcpy(fake_ws_frame, frame->payload, length);
+	fake_ws_frame[length] = '\0';
+	fake_ws_frames_sent++;
+
+	return ESP_OK;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd) {
+	return ws_open[fd % FAKE_WS_FDS] ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_INVALID;
+}
+
+/* HTTP client - only used by the server's client event handler */
+
+bool esp_http_client_is_chunked_response(esp_http_client_handle_t client) {
+	return false;
+}
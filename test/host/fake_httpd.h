@@ -0,0 +1,111 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Fake HTTP Server
+ * Stand-in for esp_http_server that lets a test hand a
+ * request to a handler and read back the response. The
+ * socket writes httpd would make are counted as it
+ * makes them, so responses can be compared by the bytes
+ * and writes they cost on the SoftAP.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HOST_FAKE_HTTPD_H_
+#define HOST_FAKE_HTTPD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_http_server.h"
+
+/* Request headers that can be set, and response headers kept */
+#define FAKE_HTTPD_HEADERS 8
+#define FAKE_HTTPD_HEADER_SIZE 64
+
+/* Largest response body kept. Anything beyond is counted but not stored. */
+#define FAKE_HTTPD_BODY_SIZE 16384
+
+/* Largest WebSocket frame kept */
+#define FAKE_WS_FRAME_SIZE 128
+
+/** A request, and the response the handler gave it */
+typedef struct {
+	httpd_req_t req;          /* Passed to the handler. Must come first. */
+
+	/* Request */
+	char req_headers[FAKE_HTTPD_HEADERS][2][FAKE_HTTPD_HEADER_SIZE];
+	int req_header_count;
+	const char *body;
+	size_t body_read;
+	size_t recv_piece;        /* Most returned by one httpd_req_recv(). 0 for no limit. */
+	int fd;
+
+	/* Response */
+	char status[32];
+	char type[32];
+	char headers[FAKE_HTTPD_HEADERS][2][FAKE_HTTPD_HEADER_SIZE];
+	int header_count;
+	bool headers_sent;
+	bool chunked;
+	bool finished;
+	char response[FAKE_HTTPD_BODY_SIZE + 1];
+	size_t response_length;
+	size_t wire_bytes;        /* Bytes written to the socket, headers and chunk framing included */
+	int writes;               /* Socket writes */
+} fake_request_t;
+
+/* Last WebSocket frame sent, and the number sent since the last reset */
+extern char fake_ws_frame[FAKE_WS_FRAME_SIZE + 1];
+extern int fake_ws_frames_sent;
+
+/* Configuration passed to the last httpd_start() */
+extern httpd_config_t fake_httpd_config;
+
+/* Work queued with httpd_queue_work() is run at once. Number queued since the last reset. */
+extern int fake_httpd_work_queued;
+
+/**
+ * @brief Prepare a request with no headers or body
+ * @param r Request
+ * @param method HTTP_GET or HTTP_POST
+ * @param uri URI, including any query string
+ */
+void fake_request_init(fake_request_t *r, httpd_method_t method, const char *uri);
+
+/**
+ * @brief Add a request header
+ */
+void fake_request_add_header(fake_request_t *r, const char *field, const char *value);
+
+/**
+ * @brief Set the request body
+ * @param r Request
+ * @param body Body. Not copied, so must outlive the request.
+ */
+void fake_request_set_body(fake_request_t *r, const char *body);
+
+/**
+ * @brief Get a header of the response
+ * @return Value of header, or NULL if it was not set
+ */
+const char *fake_response_header(const fake_request_t *r, const char *field);
+
+/**
+ * @brief Get the status code of the response, e.g. 200
+ */
+int fake_response_code(const fake_request_t *r);
+
+/**
+ * @brief Mark a socket as an open WebSocket connection, or as closed
+ */
+void fake_ws_set_open(int fd, bool open);
+
+/**
+ * @brief Close every WebSocket and forget the frames and work sent
+ */
+void fake_httpd_reset();
+
+#endif /* HOST_FAKE_HTTPD_H_ */
@@ -0,0 +1,141 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Fake Portal Services
+ * Stand-ins for the WiFi, first-boot, event queue and
+ * timeline functions called by the webserver, so that
+ * it can be built on the host. The scan list is the
+ * real scan store, filled from the fake WiFi driver.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "fakes.h"
+#include "fake_portal.h"
+
+connection_test_state_t fake_connection_test_state;
+uint32_t fake_connection_test_wait_ms;
+
+char fake_connection_test_ssid[SSID_SIZE];
+char fake_connection_test_pword[PWORD_SIZE];
+
+app_event_type_t fake_app_event;
+int fake_app_events_posted;
+
+static wifi_listener_t listener;
+static void *listener_arg;
+
+static connection_test_listener_t state_listener;
+static void *state_listener_arg;
+
+void fake_portal_scan(const wifi_ap_record_t *records, int count) {
+	fake_wifi_set_scan(records, count);
+	scan_store_init();
+	scan_store_update();
+}
+
+void fake_portal_notify(wifi_notification_t notification) {
+	if (listener != NULL) {
+		listener(notification, listener_arg);
+	}
+}
+
+void fake_portal_set_state(connection_test_state_t state) {
+	fake_connection_test_state = state;
+	if (state_listener != NULL) {
+		state_listener(state, state_listener_arg);
+	}
+}
+
+void fake_portal_reset() {
+	fake_connection_test_state = CONNECTION_TEST_IDLE;
+	fake_connection_test_wait_ms = 0;
+	fake_connection_test_ssid[0] = '\0';
+	fake_connection_test_pword[0] = '\0';
+	fake_app_events_posted = 0;
+}
+
+/* WiFi */
+
+ap_details_t get_ap_details(int index) {
+	ap_details_t ap;
+	scan_store_get(index, &ap);
+	return ap;
+}
+
+esp_err_t find_ap_details(const char *ssid, ap_details_t *ap) {
+	return scan_store_find(ssid, ap);
+}
+
+int get_ap_count() {
+	return scan_store_count();
+}
+
+uint32_t get_scan_generation() {
+	return scan_store_generation();
+}
+
+void set_wifi_listener(wifi_listener_t new_listener, void *arg) {
+	listener = new_listener;
+	listener_arg = arg;
+}
+
+/* First boot */
+
+esp_err_t start_connection_test(const char *ssid, const char *pword) {
+	if (fake_connection_test_state == CONNECTION_TEST_QUEUED ||
+			fake_connection_test_state == CONNECTION_TEST_ASSOCIATING) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	snprintf(fake_connection_test_ssid, sizeof(fake_connection_test_ssid), "%s", ssid);
+	snprintf(fake_connection_test_pword, sizeof(fake_connection_test_pword), "%s", pword);
+	fake_connection_test_state = CONNECTION_TEST_QUEUED;
+
+	return ESP_OK;
+}
+
+connection_test_state_t wait_connection_test_state(connection_test_state_t known, uint32_t timeout_ms) {
+	fake_connection_test_wait_ms = timeout_ms;
+	return fake_connection_test_state;
+}
+
+void set_connection_test_listener(connection_test_listener_t listener, void *arg) {
+	state_listener = listener;
+	state_listener_arg = arg;
+}
+
+const char *connection_test_state_name(connection_test_state_t state) {
+	switch (state) {
+	case	CONNECTION_TEST_IDLE:        return "idle";
+	case	CONNECTION_TEST_QUEUED:      return "queued";
+	case	CONNECTION_TEST_ASSOCIATING: return "associating";
+	case	CONNECTION_TEST_GOT_IP:      return "got-ip";
+	case	CONNECTION_TEST_FAILED:      return "failed";
+	}
+	return "unknown";
+}
+
+/* Event queue */
+
+esp_err_t app_events_post(app_event_type_t type, int32_t data) {
+	fake_app_event = type;
+	fake_app_events_posted++;
+	return ESP_OK;
+}
+
+/* Timeline - empty */
+
+int timeline_get(int index, timeline_entry_t *out) {
+	return -1;
+}
+
+int timeline_format_entry(const timeline_entry_t *entry, char *line, size_t size) {
+	line[0] = '\0';
+	return 0;
+}
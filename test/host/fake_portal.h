@@ -0,0 +1,56 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Fake Portal Services
+ * Stand-ins for the WiFi, first-boot, event queue and
+ * timeline functions called by the webserver, so that
+ * it can be built on the host. The scan list is the
+ * real scan store, filled from the fake WiFi driver.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HOST_FAKE_PORTAL_H_
+#define HOST_FAKE_PORTAL_H_
+
+#include "first_boot.h"
+#include "app_events.h"
+
+/* State reported by wait_connection_test_state(), and the last wait asked for */
+extern connection_test_state_t fake_connection_test_state;
+extern uint32_t fake_connection_test_wait_ms;
+
+/* Network passed to the last start_connection_test() */
+extern char fake_connection_test_ssid[SSID_SIZE];
+extern char fake_connection_test_pword[PWORD_SIZE];
+
+/* Last event posted to the state machine, and the number posted since the last reset */
+extern app_event_type_t fake_app_event;
+extern int fake_app_events_posted;
+
+/**
+ * @brief Fill the scan store as if a full scan had found the given networks
+ * @param records Scan records
+ * @param count Number of records
+ */
+void fake_portal_scan(const wifi_ap_record_t *records, int count);
+
+/**
+ * @brief Pass a WiFi notification to the listener set with set_wifi_listener(), if any
+ */
+void fake_portal_notify(wifi_notification_t notification);
+
+/**
+ * @brief Move the connection test to a new state and tell the listener set with
+ * set_connection_test_listener(), if any
+ */
+void fake_portal_set_state(connection_test_state_t state);
+
+/**
+ * @brief Set the connection test back to idle and forget the events posted
+ */
+void fake_portal_reset();
+
+#endif /* HOST_FAKE_PORTAL_H_ */
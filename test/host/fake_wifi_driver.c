@@ -0,0 +1,406 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Fake WiFi Driver
+ * Stand-ins for the WiFi driver, default event loop,
+ * event groups and timers used by wifi.c, and for the
+ * event queue and timeline it reports to. Events are
+ * queued as the driver would post them, and delivered
+ * whenever the caller waits on an event group, or when
+ * a test asks.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_system.h"
+#include "mbedtls/md.h"
+#include "mbedtls/pkcs5.h"
+
+#include "timeline.h"
+#include "fakes.h"
+#include "fake_wifi_driver.h"
+
+/* Events waiting to be delivered, and the largest data of each */
+#define FAKE_EVENT_QUEUE_SIZE 16
+#define FAKE_EVENT_DATA_SIZE 64
+
+/* Handlers registered, and timers created */
+#define FAKE_HANDLERS 4
+#define FAKE_TIMERS 4
+
+esp_event_base_t WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t IP_EVENT = "IP_EVENT";
+
+int fake_wifi_connects;
+int fake_wifi_scans;
+bool fake_wifi_scan_lost;
+
+app_event_type_t fake_wifi_app_event;
+int32_t fake_wifi_app_event_data;
+int fake_wifi_app_events_posted;
+
+typedef struct {
+	esp_event_base_t base;
+	int32_t id;
+	uint8_t data[FAKE_EVENT_DATA_SIZE];
+} fake_event_t;
+
+static fake_event_t events[FAKE_EVENT_QUEUE_SIZE];
+static int event_head;
+static int event_count;
+
+typedef struct {
+	esp_event_base_t base;
+	int32_t id;
+	esp_event_handler_t handler;
+	void *arg;
+} fake_handler_t;
+
+static fake_handler_t handlers[FAKE_HANDLERS];
+
+struct esp_timer {
+	esp_timer_create_args_t args;
+	bool armed;
+	uint64_t timeout_us;
+};
+
+static struct esp_timer timers[FAKE_TIMERS];
+static int timer_count;
+
+static uint8_t connect_script[FAKE_CONNECT_SCRIPT_SIZE];
+static int connect_script_length;
+static int connect_script_next;
+
+/* Interfaces are only compared by handle */
+static uint8_t sta_netif;
+static uint8_t ap_netif;
+
+/*
+ * @brief Queue an event, as the driver posts to the default loop
+ */
+static void post(esp_event_base_t base, int32_t id, const void *data, size_t size) {
+	if (event_count == FAKE_EVENT_QUEUE_SIZE || size > FAKE_EVENT_DATA_SIZE) {
+		return;
+	}
+
+	fake_event_t *event = &events[(event_head + event_count) % FAKE_EVENT_QUEUE_SIZE];
+	event->base = base;
+	event->id = id;
+	memset(event->data, 0, sizeof(event->data));
+	if (size > 0) {
+		memcpy(event->data, data, size);
+	}
+	event_count++;
+}
+
+void fake_wifi_script_connects(const uint8_t *outcomes, int count) {
+	if (count > FAKE_CONNECT_SCRIPT_SIZE) {
+		count = FAKE_CONNECT_SCRIPT_SIZE;
+	}
+	memcpy(connect_script, outcomes, count);
+	connect_script_length = count;
+	connect_script_next = 0;
+}
+
+void fake_wifi_post_disconnected(uint8_t reason) {
+	wifi_event_sta_disconnected_t disconnected = { .reason = reason };
+
+	post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &disconnected, sizeof(disconnected));
+}
+
+void fake_wifi_post_got_ip() {
+	ip_event_got_ip_t got_ip = { .ip_info = { .ip = { .addr = 0x0A01A8C0 } } };
+
+	post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, NULL, 0);
+	post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip));
+}
+
+int fake_wifi_deliver() {
+	int delivered = 0;
+
+	// Handlers may post more, as a reconnect does
+	while (event_count > 0) {
+		fake_event_t event = events[event_head];
+		event_head = (event_head + 1) % FAKE_EVENT_QUEUE_SIZE;
+		event_count--;
+
+		for (int i = 0; i < FAKE_HANDLERS; i++) {
+			if (handlers[i].handler != NULL && handlers[i].base == event.base &&
+					(handlers[i].id == ESP_EVENT_ANY_ID || handlers[i].id == event.id)) {
+				handlers[i].handler(handlers[i].arg, event.base, event.id, event.data);
+			}
+		}
+		delivered++;
+	}
+
+	return delivered;
+}
+
+bool fake_timer_armed(esp_timer_handle_t timer, uint64_t *timeout_us) {
+	if (timeout_us != NULL) {
+		*timeout_us = timer->timeout_us;
+	}
+	return timer->armed;
+}
+
+bool fake_timer_fire(esp_timer_handle_t timer) {
+	if (!timer->armed) {
+		return false;
+	}
+
+	timer->armed = false;
+	fake_time_us += timer->timeout_us;
+	timer->args.callback(timer->args.arg);
+	return true;
+}
+
+void fake_wifi_reset() {
+	event_head = 0;
+	event_count = 0;
+	connect_script_length = 0;
+	connect_script_next = 0;
+	for (int i = 0; i < timer_count; i++) {
+		timers[i].armed = false;
+	}
+	fake_wifi_connects = 0;
+	fake_wifi_scans = 0;
+	fake_wifi_scan_lost = false;
+	fake_wifi_app_events_posted = 0;
+}
+
+/* Event groups - a wait delivers the events posted meanwhile, and moves the clock on if it times out */
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buffer) {
+	buffer->bits = 0;
+	return buffer;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+	((StaticEventGroup_t *)group)->bits |= bits;
+	return ((StaticEventGroup_t *)group)->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+	EventBits_t previous = ((StaticEventGroup_t *)group)->bits;
+
+	((StaticEventGroup_t *)group)->bits &= ~bits;
+	return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+	return ((StaticEventGroup_t *)group)->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+		BaseType_t wait_for_all, TickType_t ticks) {
+	fake_wifi_deliver();
+
+	EventBits_t current = xEventGroupGetBits(group);
+	bool met = wait_for_all ? ((current & bits) == bits) : ((current & bits) != 0);
+
+	if (met && clear_on_exit) {
+		xEventGroupClearBits(group, bits);
+	} else if (!met && ticks != portMAX_DELAY) {
+		fake_time_us += (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+	}
+
+	return current;
+}
+
+/* Default event loop */
+
+esp_err_t esp_event_loop_create_default(void) {
+	return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+		esp_event_handler_t event_handler, void *event_handler_arg, esp_event_handler_instance_t *instance) {
+	for (int i = 0; i < FAKE_HANDLERS; i++) {
+		if (handlers[i].handler == NULL) {
+			handlers[i] = (fake_handler_t){ event_base, event_id, event_handler, event_handler_arg };
+			*instance = &handlers[i];
+			return ESP_OK;
+		}
+	}
+	return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_event_handler_instance_unregister(esp_event_base_t event_base, int32_t event_id,
+		esp_event_handler_instance_t instance) {
+	memset(instance, 0, sizeof(fake_handler_t));
+	return ESP_OK;
+}
+
+/* Timers */
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+	if (timer_count == FAKE_TIMERS) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	timers[timer_count].args = *create_args;
+	timers[timer_count].armed = false;
+	*out_handle = &timers[timer_count++];
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+	if (timer->armed) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	timer->armed = true;
+	timer->timeout_us = timeout_us;
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+	if (!timer->armed) {
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	timer->armed = false;
+	return ESP_OK;
+}
+
+/* WiFi driver */
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) {
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_deinit(void) {
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage) {
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void) {
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void) {
+	fake_wifi_connects++;
+
+	if (connect_script_next < connect_script_length) {
+		uint8_t outcome = connect_script[connect_script_next++];
+
+		if (outcome == FAKE_CONNECT_GOT_IP) {
+			fake_wifi_post_got_ip();
+		} else {
+			fake_wifi_post_disconnected(outcome);
+		}
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block) {
+	wifi_event_sta_scan_done_t done = { .number = 0 };
+	uint16_t count;
+
+	fake_wifi_scans++;
+	if (fake_wifi_scan_lost) {
+		return ESP_OK;
+	}
+	esp_wifi_scan_get_ap_num(&count);
+	done.number = (count > UINT8_MAX) ? UINT8_MAX : count;
+	post(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &done, sizeof(done));
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info) {
+	return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_efuse_mac_get_default(uint8_t *mac) {
+	memset(mac, 0, 6);
+	return ESP_OK;
+}
+
+/* Network interfaces */
+
+esp_err_t esp_netif_init(void) {
+	return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void) {
+	return (esp_netif_t *)&sta_netif;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void) {
+	return (esp_netif_t *)&ap_netif;
+}
+
+void esp_netif_destroy(esp_netif_t *netif) {
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *netif, esp_netif_ip_info_t *ip_info) {
+	memset(ip_info, 0, sizeof(esp_netif_ip_info_t));
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_clear_default_wifi_driver_and_handlers(void *esp_netif) {
+	return ESP_OK;
+}
+
+/* mbedTLS - no PMK is ever derived */
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t md_type) {
+	return NULL;
+}
+
+void mbedtls_md_init(mbedtls_md_context_t *ctx) {
+	ctx->md_info = NULL;
+}
+
+void mbedtls_md_free(mbedtls_md_context_t *ctx) {
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac) {
+	return -1;
+}
+
+int mbedtls_pkcs5_pbkdf2_hmac(mbedtls_md_context_t *ctx, const unsigned char *password, size_t plen,
+		const unsigned char *salt, size_t slen, unsigned int iteration_count, uint32_t key_length,
+		unsigned char *output) {
+	return -1;
+}
+
+/* Event queue and timeline */
+
+esp_err_t app_events_post(app_event_type_t type, int32_t data) {
+	fake_wifi_app_event = type;
+	fake_wifi_app_event_data = data;
+	fake_wifi_app_events_posted++;
+	return ESP_OK;
+}
+
+void timeline_record(timeline_event_t event, uint32_t arg) {
+}
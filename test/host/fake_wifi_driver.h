@@ -0,0 +1,89 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Fake WiFi Driver
+ * Stand-ins for the WiFi driver, default event loop,
+ * event groups and timers used by wifi.c, and for the
+ * event queue and timeline it reports to. Events are
+ * queued as the driver would post them, and delivered
+ * whenever the caller waits on an event group, or when
+ * a test asks.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HOST_FAKE_WIFI_DRIVER_H_
+#define HOST_FAKE_WIFI_DRIVER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_wifi.h"
+#include "esp_timer.h"
+#include "app_events.h"
+
+/* Outcome of a scripted connect that associates and gets an IP address. Any other outcome
+ * is the reason of the disconnect it ends in. */
+#define FAKE_CONNECT_GOT_IP 0
+
+/* Longest script of connect outcomes */
+#define FAKE_CONNECT_SCRIPT_SIZE 32
+
+/* Calls made to the driver since the last reset */
+extern int fake_wifi_connects;
+extern int fake_wifi_scans;
+
+/* Set to make scans post no SCAN_DONE, as when the driver never finishes the scan */
+extern bool fake_wifi_scan_lost;
+
+/* Last event posted to the state machine, its data, and the number posted since the last reset */
+extern app_event_type_t fake_wifi_app_event;
+extern int32_t fake_wifi_app_event_data;
+extern int fake_wifi_app_events_posted;
+
+/**
+ * @brief Set the outcomes of the next esp_wifi_connect() calls, taken in order. Once they are
+ * used up, a connect posts nothing, as when the AP never answers.
+ * @param outcomes Disconnect reasons, or FAKE_CONNECT_GOT_IP
+ * @param count Number of outcomes
+ */
+void fake_wifi_script_connects(const uint8_t *outcomes, int count);
+
+/**
+ * @brief Post the events of the station losing its AP
+ * @param reason Disconnect reason
+ */
+void fake_wifi_post_disconnected(uint8_t reason);
+
+/**
+ * @brief Post the events of the station associating and getting an IP address
+ */
+void fake_wifi_post_got_ip();
+
+/**
+ * @brief Deliver the events posted so far to the registered handlers, in order
+ * @return Number of events delivered
+ */
+int fake_wifi_deliver();
+
+/**
+ * @brief Check whether a one-shot timer is waiting to fire
+ * @param timer Timer to check
+ * @param timeout_us Timeout it was started with. May be NULL.
+ */
+bool fake_timer_armed(esp_timer_handle_t timer, uint64_t *timeout_us);
+
+/**
+ * @brief Fire an armed one-shot timer, moving the fake clock on by its timeout
+ * @return true if it was armed
+ */
+bool fake_timer_fire(esp_timer_handle_t timer);
+
+/**
+ * @brief Forget posted events, scripted connects, armed timers and the counters
+ */
+void fake_wifi_reset();
+
+#endif /* HOST_FAKE_WIFI_DRIVER_H_ */
@@ -0,0 +1,236 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Host Fakes
+ * Stand-ins for the ESP-IDF services used by the
+ * modules under test - a settable clock, a WiFi driver
+ * that returns canned scan results, NVS held in RAM,
+ * and a socket layer that captures sent datagrams.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+
+#include "memory.h"
+#include "fakes.h"
+
+/* Keys the fake NVS can hold, and the largest value of each */
+#define FAKE_NVS_KEYS 8
+#define FAKE_NVS_VALUE_SIZE 1024
+
+int64_t fake_time_us;
+
+uint8_t fake_sent[FAKE_DATAGRAM_SIZE];
+size_t fake_sent_length;
+int fake_sent_count;
+
+int fake_nvs_writes;
+
+static wifi_ap_record_t scan_records[64];
+static int scan_count;
+
+typedef struct {
+	char key[16];
+	size_t length;
+	uint8_t value[FAKE_NVS_VALUE_SIZE];
+} fake_nvs_entry_t;
+
+static fake_nvs_entry_t nvs[FAKE_NVS_KEYS];
+
+const char *esp_err_to_name(esp_err_t code) {
+	static char name[16];
+
+	snprintf(name, sizeof(name), "0x%x", code);
+	return name;
+}
+
+int64_t esp_timer_get_time(void) {
+	return fake_time_us;
+}
+
+uint32_t esp_random(void) {
+	return (uint32_t)rand();
+}
+
+/* FreeRTOS - the host runs everything in one thread, so locks are always free */
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+	return buffer;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer) {
+	return buffer;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+	return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+	return pdTRUE;
+}
+
+/* Tasks are never started on the host. Tests call the work functions directly. */
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code, const char *name, uint32_t stack_depth, void *parameters,
+		UBaseType_t priority, StackType_t *stack, StaticTask_t *task_buffer) {
+	return task_buffer;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+}
+
+eTaskState eTaskGetState(TaskHandle_t task) {
+	return eDeleted;
+}
+
+void vTaskDelay(TickType_t ticks) {
+	fake_time_us += (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+	return 0;
+}
+
+/* Sockets */
+
+ssize_t fake_sendto(int fd, const void *data, size_t length, int flags, const struct sockaddr *to, socklen_t to_length) {
+	fake_sent_length = (length < sizeof(fake_sent)) ? length : sizeof(fake_sent);
+	memcpy(fake_sent, data, fake_sent_length);
+	fake_sent_count++;
+	return length;
+}
+
+void fake_sockets_reset() {
+	fake_sent_length = 0;
+	fake_sent_count = 0;
+}
+
+/* WiFi driver */
+
+uint32_t get_ap_ip_address() {
+	// 192.168.4.1 in network byte order, as esp_netif holds it
+	return htonl(0xC0A80401);
+}
+
+void fake_wifi_set_scan(const wifi_ap_record_t *records, int count) {
+	if (count > (int)(sizeof(scan_records)/sizeof(scan_records[0]))) {
+		count = sizeof(scan_records)/sizeof(scan_records[0]);
+	}
+	memcpy(scan_records, records, count * sizeof(wifi_ap_record_t));
+	scan_count = count;
+}
+
+wifi_ap_record_t fake_ap_record(const char *ssid, uint8_t bssid_tail, int8_t rssi, uint8_t channel,
+		wifi_auth_mode_t authmode) {
+	wifi_ap_record_t record = {
+			.bssid = { 0x24, 0x0A, 0xC4, 0x00, 0x00, bssid_tail },
+			.primary = channel,
+			.rssi = rssi,
+			.authmode = authmode
+	};
+
+	snprintf((char *)record.ssid, sizeof(record.ssid), "%s", ssid);
+	return record;
+}
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *number) {
+	*number = scan_count;
+	return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *ap_records) {
+	if (*number > scan_count) {
+		*number = scan_count;
+	}
+	memcpy(ap_records, scan_records, *number * sizeof(wifi_ap_record_t));
+	return ESP_OK;
+}
+
+/* NVS, as seen through memory.c */
+
+static fake_nvs_entry_t *find_key(const char *key, bool create) {
+	fake_nvs_entry_t *free_entry = NULL;
+
+	for (int i = 0; i < FAKE_NVS_KEYS; i++) {
+		if (strcmp(nvs[i].key, key) == 0) {
+			return &nvs[i];
+		}
+		if (free_entry == NULL && nvs[i].key[0] == '\0') {
+			free_entry = &nvs[i];
+		}
+	}
+
+	if (create && free_entry != NULL) {
+		snprintf(free_entry->key, sizeof(free_entry->key), "%s", key);
+		free_entry->length = 0;
+		return free_entry;
+	}
+	return NULL;
+}
+
+void fake_nvs_reset() {
+	memset(nvs, 0, sizeof(nvs));
+	fake_nvs_writes = 0;
+}
+
+esp_err_t read_blob(char *key, void *value, size_t *length) {
+	fake_nvs_entry_t *entry = find_key(key, false);
+
+	if (entry == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	if (*length < entry->length) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	memcpy(value, entry->value, entry->length);
+	*length = entry->length;
+	return ESP_OK;
+}
+
+esp_err_t write_blob(char *key, const void *value, size_t length) {
+	fake_nvs_entry_t *entry = find_key(key, true);
+
+	if (entry == NULL || length > FAKE_NVS_VALUE_SIZE) {
+		return ESP_ERR_NO_MEM;
+	}
+	memcpy(entry->value, value, length);
+	entry->length = length;
+	fake_nvs_writes++;
+	return ESP_OK;
+}
+
+esp_err_t read_string(char *key, char *string, size_t *required_size) {
+	return read_blob(key, string, required_size);
+}
+
+esp_err_t write_string(char *key, char *string) {
+	return write_blob(key, string, strlen(string) + 1);
+}
+
+esp_err_t erase_key(char *key) {
+	fake_nvs_entry_t *entry = find_key(key, false);
+
+	if (entry == NULL) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	memset(entry, 0, sizeof(fake_nvs_entry_t));
+	fake_nvs_writes++;
+	return ESP_OK;
+}
@@ -0,0 +1,60 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Host Fakes
+ * Stand-ins for the ESP-IDF services used by the
+ * modules under test - a settable clock, a WiFi driver
+ * that returns canned scan results, NVS held in RAM,
+ * and a socket layer that captures sent datagrams.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HOST_FAKES_H_
+#define HOST_FAKES_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_wifi.h"
+
+/* Largest datagram kept by the fake socket layer */
+#define FAKE_DATAGRAM_SIZE 512
+
+/* Time returned by esp_timer_get_time() (us). Only moves when a test moves it. */
+extern int64_t fake_time_us;
+
+/* Last datagram passed to sendto(), and the number sent since the last reset */
+extern uint8_t fake_sent[FAKE_DATAGRAM_SIZE];
+extern size_t fake_sent_length;
+extern int fake_sent_count;
+
+/* Number of writes made to the fake NVS since the last reset */
+extern int fake_nvs_writes;
+
+/**
+ * @brief Set the records returned by the next esp_wifi_scan_get_ap_records() calls
+ * @param records Scan records. Copied.
+ * @param count Number of records
+ */
+void fake_wifi_set_scan(const wifi_ap_record_t *records, int count);
+
+/**
+ * @brief Build a scan record
+ */
+wifi_ap_record_t fake_ap_record(const char *ssid, uint8_t bssid_tail, int8_t rssi, uint8_t channel,
+		wifi_auth_mode_t authmode);
+
+/**
+ * @brief Forget every key held by the fake NVS and zero its write counter
+ */
+void fake_nvs_reset();
+
+/**
+ * @brief Forget the last datagram sent and zero the send counter
+ */
+void fake_sockets_reset();
+
+#endif /* HOST_FAKES_H_ */
@@ -0,0 +1,50 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Fuzz Targets
+ * Interface between the fuzz targets and the drivers
+ * that run them - libFuzzer when built with clang, or
+ * the mutation loop in fuzz_main.c otherwise.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HOST_FUZZ_H_
+#define HOST_FUZZ_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Largest input the drivers generate */
+#define FUZZ_MAX_INPUT 1024
+
+/**
+ * @brief Run the code under test on one input. Aborts if an invariant does not hold.
+ * @return 0, as libFuzzer expects
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+/**
+ * @brief Get the number of seed inputs the target provides
+ */
+int fuzz_seed_count(void);
+
+/**
+ * @brief Get a seed input
+ * @param index Index of seed
+ * @param out Output input, FUZZ_MAX_INPUT bytes
+ * @return Length of input
+ */
+size_t fuzz_seed(int index, uint8_t *out);
+
+/* Abort with a message if an invariant does not hold, in any build */
+#define FUZZ_ASSERT(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: invariant failed: %s\n", __FILE__, __LINE__, #cond); \
+		abort(); \
+	} \
+} while (0)
+
+#endif /* HOST_FUZZ_H_ */
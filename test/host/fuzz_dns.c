@@ -0,0 +1,71 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * DNS Fuzz Target
+ * Feeds arbitrary packets to dns_parse_query() and
+ * checks that any view it accepts lies within the
+ * packet.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+#include "dns_corpus.h"
+#include "dns.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	dns_query_view_t view;
+
+	// Copy, so that ASan catches any read past the packet
+	uint8_t *packet = malloc(size ? size : 1);
+	memcpy(packet, data, size);
+
+	if (dns_parse_query(packet, size, &view) == ESP_OK) {
+		FUZZ_ASSERT(size >= DNS_HEADER_LEN);
+		FUZZ_ASSERT(view.qdcount >= 1 && view.qdcount <= DNS_MAX_QUESTIONS);
+		FUZZ_ASSERT(view.question_end <= size);
+		FUZZ_ASSERT(!(view.flags & (FLAG_QR | FLAG_OPCODE | FLAG_TC)));
+
+		size_t pos = DNS_HEADER_LEN;
+		for (int i = 0; i < view.qdcount; i++) {
+			const dns_question_t *question = &view.questions[i];
+
+			// Questions follow one another, each a name of whole labels then type and class
+			FUZZ_ASSERT(question->name == pos);
+			FUZZ_ASSERT(question->name_len >= 1 && question->name_len <= DNS_MAX_NAME_LEN);
+			FUZZ_ASSERT(packet[question->name + question->name_len - 1] == 0);
+			pos += question->name_len + 2*sizeof(uint16_t);
+			FUZZ_ASSERT(pos <= size);
+		}
+		FUZZ_ASSERT(pos == view.question_end);
+	}
+
+	free(packet);
+	return 0;
+}
+
+static dns_corpus_query_t seeds[DNS_CORPUS_MAX];
+static int seed_count = -1;
+
+static void load_seeds() {
+	if (seed_count < 0) {
+		seed_count = dns_corpus_build(seeds);
+	}
+}
+
+int fuzz_seed_count(void) {
+	load_seeds();
+	return seed_count;
+}
+
+size_t fuzz_seed(int index, uint8_t *out) {
+	load_seeds();
+	memcpy(out, seeds[index].data, seeds[index].length);
+	return seeds[index].length;
+}
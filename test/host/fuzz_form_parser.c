@@ -0,0 +1,123 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Form Parser Fuzz Target
+ * Feeds arbitrary bodies to the form parser, whole and
+ * in pieces, and checks that fields stay within their
+ * buffers and that the split makes no difference.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+#include "cred_store.h"
+#include "form_parser.h"
+
+/* Fields asked for, one of them much smaller than any real one */
+#define FUZZ_FIELDS 3
+#define FUZZ_SMALL_SIZE 4
+
+/* Bodies the mutations start from. The first byte of an input picks the encoding and piece size. */
+static const char *seeds[] = {
+		"\x01ssid=home&password=secret",
+		"\x02password=two+words&ssid=a%26b%3Dc",
+		"\x03pass%77ord=%2f%7e&x=1&&ssid",
+		"\x04ssid=ssssssssssssssssssssssssssssssss&password=%41",
+		"\x05" "a=1&b=%zz",
+		"\x81{\"ssid\":\"home\",\"password\":\"p w\"}",
+		"\x82{\"password\":\"a\\\"b\\\\c\\/\\u00e9\\u20ac\\n\"}",
+		"\x83{\"x\":123,\"pin\":true,\"ssid\":null}",
+		"\x84{\"ssid\":{\"a\":1}}",
+};
+#define SEED_COUNT (sizeof(seeds)/sizeof(seeds[0]))
+
+/* Result of one parse */
+typedef struct {
+	esp_err_t err;
+	char values[FUZZ_FIELDS][PWORD_SIZE];
+	form_field_t fields[FUZZ_FIELDS];
+} fuzz_parse_t;
+
+/*
+ * @brief Parse a body in pieces of a given size, checking the fields after every piece
+ */
+static void parse(fuzz_parse_t *out, form_type_t type, const uint8_t *body, size_t size, size_t piece) {
+	static const char *names[FUZZ_FIELDS] = { "ssid", "password", "pin" };
+	static const size_t sizes[FUZZ_FIELDS] = { SSID_SIZE, PWORD_SIZE, FUZZ_SMALL_SIZE };
+	form_parser_t parser;
+
+	memset(out, 0, sizeof(fuzz_parse_t));
+	for (int i = 0; i < FUZZ_FIELDS; i++) {
+		out->fields[i].name = names[i];
+		out->fields[i].value = out->values[i];
+		out->fields[i].size = sizes[i];
+	}
+
+	form_parser_init(&parser, type, out->fields, FUZZ_FIELDS);
+	for (size_t pos = 0; pos < size && out->err == ESP_OK; pos += piece) {
+		size_t n = (size - pos < piece) ? size - pos : piece;
+
+		out->err = form_parser_feed(&parser, (const char *)&body[pos], n);
+
+		for (int i = 0; i < FUZZ_FIELDS; i++) {
+			const form_field_t *field = &out->fields[i];
+
+			FUZZ_ASSERT(field->length < field->size);
+			FUZZ_ASSERT(field->value[field->length] == '\0');
+			FUZZ_ASSERT(field->present || field->length == 0);
+		}
+	}
+	if (out->err == ESP_OK) {
+		out->err = form_parser_finish(&parser);
+	}
+
+	FUZZ_ASSERT(out->err == ESP_OK || out->err == ESP_ERR_INVALID_ARG ||
+			out->err == ESP_ERR_INVALID_SIZE || out->err == ESP_ERR_NOT_SUPPORTED);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	static fuzz_parse_t whole;
+	static fuzz_parse_t pieces;
+
+	if (size == 0) {
+		return 0;
+	}
+	form_type_t type = (data[0] & 0x80) ? FORM_JSON : FORM_URLENCODED;
+	size_t piece = (data[0] & 0x7F) % 16 + 1;
+
+	// Copy, so that ASan catches any read past the body
+	size_t body_size = size - 1;
+	uint8_t *body = malloc(body_size ? body_size : 1);
+	memcpy(body, &data[1], body_size);
+
+	parse(&whole, type, body, body_size, body_size ? body_size : 1);
+	parse(&pieces, type, body, body_size, piece);
+
+	// Splitting the body changes nothing
+	FUZZ_ASSERT(whole.err == pieces.err);
+	for (int i = 0; i < FUZZ_FIELDS; i++) {
+		FUZZ_ASSERT(whole.fields[i].present == pieces.fields[i].present);
+		FUZZ_ASSERT(whole.fields[i].length == pieces.fields[i].length);
+		FUZZ_ASSERT(memcmp(whole.values[i], pieces.values[i], whole.fields[i].length) == 0);
+	}
+
+	free(body);
+	return 0;
+}
+
+int fuzz_seed_count(void) {
+	return SEED_COUNT;
+}
+
+size_t fuzz_seed(int index, uint8_t *out) {
+	size_t length = strlen(seeds[index]);
+
+	memcpy(out, seeds[index], length);
+	return length;
+}
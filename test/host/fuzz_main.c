@@ -0,0 +1,142 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Fuzz Driver
+ * Mutation loop for hosts without libFuzzer. Starts
+ * from the seeds of the target and applies random
+ * byte flips, insertions, deletions, truncations and
+ * splices. Files given on the command line are run
+ * once each instead, to replay a crash.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+
+/* Mutations applied to a seed before it is run */
+#define FUZZ_MAX_MUTATIONS 8
+
+/*
+ * @brief Apply one random mutation to an input
+ * @return New length of input
+ */
+static size_t mutate(uint8_t *data, size_t size) {
+	size_t pos = size ? (size_t)rand() % size : 0;
+
+	switch (rand() % 6) {
+	case	0:
+		// Flip a bit
+		if (size) {
+			data[pos] ^= 1 << (rand() % 8);
+		}
+		break;
+	case	1:
+		// Replace a byte, favouring values with meaning in length fields
+		if (size) {
+			static const uint8_t interesting[] = { 0x00, 0x01, 0x3F, 0x40, 0x7F, 0x80, 0xC0, 0xFF };
+			data[pos] = (rand() % 2) ? interesting[rand() % sizeof(interesting)] : rand();
+		}
+		break;
+	case	2:
+		// Insert a byte
+		if (size < FUZZ_MAX_INPUT) {
+			memmove(&data[pos + 1], &data[pos], size - pos);
+			data[pos] = rand();
+			size++;
+		}
+		break;
+	case	3:
+		// Delete a byte
+		if (size) {
+			memmove(&data[pos], &data[pos + 1], size - pos - 1);
+			size--;
+		}
+		break;
+	case	4:
+		// Truncate
+		size = pos;
+		break;
+	default:
+		// Copy a run of the input over another part of it
+		if (size > 1) {
+			size_t from = rand() % size;
+			size_t length = rand() % (size - (from > pos ? from : pos));
+			memmove(&data[pos], &data[from], length);
+		}
+		break;
+	}
+
+	return size;
+}
+
+/*
+ * @brief Run the target once on the contents of a file
+ */
+static int run_file(const char *path) {
+	static uint8_t data[FUZZ_MAX_INPUT];
+	FILE *file = fopen(path, "rb");
+
+	if (file == NULL) {
+		perror(path);
+		return 1;
+	}
+	size_t size = fread(data, 1, sizeof(data), file);
+	fclose(file);
+
+	LLVMFuzzerTestOneInput(data, size);
+	printf("%s: ok\n", path);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	static uint8_t data[FUZZ_MAX_INPUT];
+	long runs = 100000;
+	unsigned seed = 1;
+
+	// FUZZ_RUNS and FUZZ_SEED make a run repeatable
+	if (getenv("FUZZ_RUNS") != NULL) {
+		runs = atol(getenv("FUZZ_RUNS"));
+	}
+	if (getenv("FUZZ_SEED") != NULL) {
+		seed = atoi(getenv("FUZZ_SEED"));
+	}
+
+	if (argc > 1) {
+		int failed = 0;
+		for (int i = 1; i < argc; i++) {
+			failed |= run_file(argv[i]);
+		}
+		return failed;
+	}
+
+	srand(seed);
+	int seeds = fuzz_seed_count();
+
+	for (long run = 0; run < runs; run++) {
+		size_t size;
+
+		if (run % 16 == 0) {
+			// Now and then try input with no structure at all
+			size = rand() % 64;
+			for (size_t i = 0; i < size; i++) {
+				data[i] = rand();
+			}
+		} else {
+			size = fuzz_seed(rand() % seeds, data);
+			for (int m = rand() % FUZZ_MAX_MUTATIONS + 1; m > 0; m--) {
+				size = mutate(data, size);
+			}
+		}
+
+		LLVMFuzzerTestOneInput(data, size);
+	}
+
+	printf("%ld runs from %d seeds (FUZZ_SEED=%u): no invariant failed\n", runs, seeds, seed);
+	return 0;
+}
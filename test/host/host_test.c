@@ -0,0 +1,16 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Host Tests
+ * Checks and timers shared by the host test programs.
+ * Each program runs its tests when started with no
+ * arguments, and its benchmarks with --bench.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "host_test.h"
+
+int host_test_failures;
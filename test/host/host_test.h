@@ -0,0 +1,77 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Host Tests
+ * Checks and timers shared by the host test programs.
+ * Each program runs its tests when started with no
+ * arguments, and its benchmarks with --bench.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+extern int host_test_failures;
+
+/* Record a failure, and carry on with the rest of the test */
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		host_test_failures++; \
+	} \
+} while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+	long long actual_ = (long long)(actual); \
+	long long expected_ = (long long)(expected); \
+	if (actual_ != expected_) { \
+		fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", \
+				__FILE__, __LINE__, #actual, #expected, actual_, expected_); \
+		host_test_failures++; \
+	} \
+} while (0)
+
+#define RUN_TEST(test) do { \
+	int before_ = host_test_failures; \
+	test(); \
+	printf("%-48s %s\n", #test, (host_test_failures == before_) ? "ok" : "FAILED"); \
+} while (0)
+
+/* Exit status of a test program */
+#define HOST_TEST_RESULT() ((host_test_failures == 0) ? 0 : 1)
+
+/*
+ * @brief Monotonic time in nanoseconds
+ */
+static inline uint64_t host_time_ns(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/*
+ * @brief Host CPU cycle counter, or 0 where there is none to read.
+ * Host cycles only give the relative cost of two paths - the ESP32 is far slower.
+ */
+static inline uint64_t host_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+#endif /* HOST_TEST_H_ */
@@ -0,0 +1,225 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Legacy DNS Reply
+ * The reply path of the original captive portal,
+ * kept only so that the benchmark can compare it with
+ * the precomputed reply engine.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "legacy_dns_reply.h"
+
+#define DNS_LEN 512
+
+#define FLAG_QR (1<<7)
+#define FLAG_TC (1<<1) //Truncated
+
+#define FLAG_RA (1<<7)
+
+#define QTYPE_A  1
+#define QCLASS_IN 1
+
+uint32_t get_ap_ip_address();
+
+// Header for DNS packet
+typedef struct {
+	uint16_t id;
+	uint8_t flags;
+	uint8_t rcode;
+	uint16_t qdcount;
+	uint16_t ancount;
+	uint16_t nscount;
+	uint16_t arcount;
+} DnsHeader;
+
+// Type and class information for each DNS query
+typedef struct {
+	uint16_t type;
+	uint16_t class;
+} DnsQuestionFooter;
+
+// Header and Footer that make up a DNS query
+typedef struct {
+	DnsHeader header;
+	DnsQuestionFooter footer;
+} DnsQuery;
+
+// Footer for a DNS reply - followed by rdata
+typedef struct {
+	uint16_t name;
+	uint16_t type;
+	uint16_t class;
+	uint32_t ttl;
+	uint16_t rdlength;
+} DnsResponseFooter;
+
+static esp_err_t get_dns_query_info(char* data, unsigned short length, DnsQuery *query, bool verbose) {
+	int len;
+	char *p = data;
+	// Get Header
+	query->header.id = (int)p[0]*256 + (int)p[1];
+	query->header.flags = p[2];
+	query->header.rcode = p[3];
+	query->header.qdcount = (int)p[4]*256 + (int)p[5];
+	query->header.ancount = (int)p[6]*256 + (int)p[7];
+	query->header.nscount = (int)p[8]*256 + (int)p[9];
+	query->header.arcount = (int)p[10]*256 + (int)p[11];
+
+	if (query->header.ancount || query->header.nscount || query->header.arcount) {
+		return ESP_FAIL;
+	}
+	if (query->header.flags&FLAG_TC) {
+		return ESP_FAIL;
+	}
+
+	p = &p[12];
+
+	while(p[0] != 0) {
+		len = (int) p++[0];
+		p += len;
+	}
+	p++;
+
+	query->footer.type = (int)p[0]*256 + (int)p[1];
+	query->footer.class = (int)p[2]*256 + (int)p[3];
+
+	return ESP_OK;
+}
+
+static esp_err_t get_rdata(uint32_t ip, uint8_t *footer) {
+
+	footer[3] = floor(ip / pow(2, 24));
+	ip -= footer[3] * pow(2, 24);
+
+	footer[2] = floor(ip / pow(2, 16));
+	ip -= footer[2] * pow(2, 16);
+
+	footer[1] = floor(ip / pow(2, 8));
+	ip -= footer[1] * pow(2, 8);
+
+	footer[0] = ip;
+
+	return ESP_OK;
+}
+
+static esp_err_t copy_uint16(uint16_t from, char *to) {
+	uint8_t num = floor(from / pow(2, 8));
+	to[0] = (char)num;
+
+	to[1] = (char)from-num*pow(2,8);
+
+	return ESP_OK;
+}
+
+static int alter_query_to_reply(DnsHeader *header, DnsResponseFooter *footer, uint8_t *rdata, char *reply, unsigned short original_length) {
+	char *footer_ptr = &reply[original_length]; // Set pointer to end of query
+	char *header_ptr = reply;
+
+	// Copy over header - ID
+	copy_uint16(header->id, header_ptr);
+	header_ptr += sizeof(uint16_t);
+
+	memcpy(header_ptr, &header->flags, sizeof(uint8_t));
+	header_ptr += sizeof(uint8_t);
+
+	memcpy(header_ptr, &header->rcode, sizeof(uint8_t));
+	header_ptr += sizeof(uint8_t);
+
+	copy_uint16(header->qdcount, header_ptr);
+	header_ptr += sizeof(uint16_t);
+
+	copy_uint16(header->ancount, header_ptr);
+	header_ptr += sizeof(uint16_t);
+
+	copy_uint16(header->nscount, header_ptr);
+	header_ptr += sizeof(uint16_t);
+
+	copy_uint16(header->arcount, header_ptr);
+	header_ptr += sizeof(uint16_t);
+
+	// Move rend to beginning of footer
+	copy_uint16(footer->name, footer_ptr);
+	footer_ptr += sizeof(uint16_t);
+
+	copy_uint16(footer->type, footer_ptr);
+	footer_ptr += sizeof(uint16_t);
+
+	copy_uint16(footer->class, footer_ptr);
+	footer_ptr += sizeof(uint16_t);
+
+	for (int i = 0; i < 3; i++) {
+		footer_ptr[i] = 0;
+	}
+	footer_ptr[2] = 1;
+	footer_ptr += sizeof(uint32_t);
+
+	copy_uint16(footer->rdlength, footer_ptr);
+	footer_ptr += sizeof(uint16_t);
+
+	// Copy over footer and IP address
+	memcpy(footer_ptr, rdata, 4);
+	footer_ptr += 4;
+
+	return footer_ptr-reply;
+}
+
+void legacy_captive_portal_recv(int sockFd, struct sockaddr_in *premote_addr, char *pusrdata, unsigned short length) {
+	char reply[DNS_LEN];
+	int transmit_length;
+	DnsQuery query;
+	DnsHeader response_header;
+	DnsResponseFooter response_footer;
+	uint32_t ip_address;
+
+	// Sanity Checks
+	if (length > DNS_LEN) {
+		return;
+	}
+	if (length < sizeof(DnsHeader)) {
+		return;
+	}
+
+	// Response will be same as request with some added data
+	memcpy(reply, pusrdata, length);
+
+	// The original aborted the device here, through ESP_ERROR_CHECK
+	if (get_dns_query_info(pusrdata, length, &query, 1) != ESP_OK) {
+		return;
+	}
+
+	// Build response header
+	response_header = query.header;
+	response_header.flags |= FLAG_QR;
+	response_header.rcode |= FLAG_RA;
+	response_header.ancount = 1;
+
+	if (query.footer.type == QTYPE_A) {
+		// This is a request for an IPv4 address
+
+		uint8_t rdata[4];
+
+		response_footer.name = pow(2, 15) + pow(2, 14) + 12;
+		response_footer.type = QTYPE_A;    // A record
+		response_footer.class = QCLASS_IN; // An internet address
+		response_footer.ttl = 10;
+		response_footer.rdlength = 4;
+
+		// Get IP address
+		ip_address = get_ap_ip_address();
+		get_rdata(ip_address, rdata);
+
+		transmit_length = alter_query_to_reply(&response_header, &response_footer, rdata, reply, length);
+
+		sendto(sockFd, (uint8_t*)reply, transmit_length, 0, (struct sockaddr *)premote_addr, sizeof(struct sockaddr_in));
+	}
+}
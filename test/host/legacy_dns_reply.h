@@ -0,0 +1,26 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Legacy DNS Reply
+ * The reply path of the original captive portal,
+ * kept only so that the benchmark can compare it with
+ * the precomputed reply engine.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HOST_LEGACY_DNS_REPLY_H_
+#define HOST_LEGACY_DNS_REPLY_H_
+
+#include "lwip/sockets.h"
+
+/**
+ * @brief Answer a query the way the original captive_portal_recv() did.
+ * Only well-formed A queries with no additional records may be given to it - the
+ * original aborted the device on anything else.
+ */
+void legacy_captive_portal_recv(int sockFd, struct sockaddr_in *premote_addr, char *pusrdata, unsigned short length);
+
+#endif /* HOST_LEGACY_DNS_REPLY_H_ */
@@ -0,0 +1,42 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Legacy Scan List
+ * The scan list reply of the original POST handler,
+ * kept only so that the benchmark can compare it with
+ * the cached JSON list.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdio.h>
+
+#include "wifi.h"
+#include "legacy_scan_list.h"
+
+esp_err_t legacy_send_scan_list(httpd_req_t *req) {
+	int apCount = get_ap_count();
+	if (apCount == 0) {
+		return ESP_OK;
+	}
+
+	char key[14];
+	char ssid_string[33];
+
+	for (int i = 0; i < apCount; i++) {
+		sprintf(key, "AP%d", i);
+		sprintf(ssid_string, "%s", (char *)get_ap_details(i).ssid);
+
+		httpd_resp_sendstr_chunk(req, key);
+		httpd_resp_sendstr_chunk(req, ",");
+		httpd_resp_sendstr_chunk(req, ssid_string);
+		if (i != apCount-1) {
+			httpd_resp_sendstr_chunk(req, ",");
+		}
+	}
+
+	httpd_resp_send_chunk(req, "", 0);
+	return ESP_OK;
+}
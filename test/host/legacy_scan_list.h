@@ -0,0 +1,25 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Legacy Scan List
+ * The scan list reply of the original POST handler,
+ * kept only so that the benchmark can compare it with
+ * the cached JSON list.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HOST_LEGACY_SCAN_LIST_H_
+#define HOST_LEGACY_SCAN_LIST_H_
+
+#include "esp_http_server.h"
+
+/**
+ * @brief Send the scan list the way the "network-selection" branch of the original
+ * post_handler() did: "AP<n>,<ssid>" pairs, comma separated, a chunk per piece.
+ */
+esp_err_t legacy_send_scan_list(httpd_req_t *req);
+
+#endif /* HOST_LEGACY_SCAN_LIST_H_ */
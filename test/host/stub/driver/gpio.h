@@ -0,0 +1,9 @@
+/* Host stand-in for ESP-IDF driver/gpio.h. Only the declarations pulled in through first_boot.h. */
+
+#ifndef HOST_STUB_DRIVER_GPIO_H_
+#define HOST_STUB_DRIVER_GPIO_H_
+
+#define GPIO_NUM_39 39
+#define GPIO_MODE_INPUT 1
+
+#endif /* HOST_STUB_DRIVER_GPIO_H_ */
@@ -0,0 +1,9 @@
+/* Host stand-in for ESP-IDF esp_attr.h */
+
+#ifndef HOST_STUB_ESP_ATTR_H_
+#define HOST_STUB_ESP_ATTR_H_
+
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+
+#endif /* HOST_STUB_ESP_ATTR_H_ */
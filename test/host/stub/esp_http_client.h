@@ -0,0 +1,33 @@
+/* Host stand-in for ESP-IDF esp_http_client.h. Only the event types used by the server's client handler. */
+
+#ifndef HOST_STUB_ESP_HTTP_CLIENT_H_
+#define HOST_STUB_ESP_HTTP_CLIENT_H_
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef struct esp_http_client *esp_http_client_handle_t;
+
+typedef enum {
+	HTTP_EVENT_ERROR = 0,
+	HTTP_EVENT_ON_CONNECTED,
+	HTTP_EVENT_HEADER_SENT,
+	HTTP_EVENT_ON_HEADER,
+	HTTP_EVENT_ON_DATA,
+	HTTP_EVENT_ON_FINISH,
+	HTTP_EVENT_DISCONNECTED
+} esp_http_client_event_id_t;
+
+typedef struct {
+	esp_http_client_event_id_t event_id;
+	esp_http_client_handle_t client;
+	void *data;
+	int data_len;
+	void *user_data;
+	char *header_key;
+	char *header_value;
+} esp_http_client_event_t;
+
+bool esp_http_client_is_chunked_response(esp_http_client_handle_t client);
+
+#endif /* HOST_STUB_ESP_HTTP_CLIENT_H_ */
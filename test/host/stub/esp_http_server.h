@@ -0,0 +1,147 @@
+/* Host stand-in for ESP-IDF esp_http_server.h. Requests are driven, and responses captured,
+ * by fake_httpd.c. */
+
+#ifndef HOST_STUB_ESP_HTTP_SERVER_H_
+#define HOST_STUB_ESP_HTTP_SERVER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#define ESP_ERR_HTTPD_BASE          0xb000
+#define ESP_ERR_HTTPD_RESULT_TRUNC  (ESP_ERR_HTTPD_BASE + 6)
+
+#define HTTPD_SOCK_ERR_FAIL     -1
+#define HTTPD_SOCK_ERR_INVALID  -2
+#define HTTPD_SOCK_ERR_TIMEOUT  -3
+
+#define HTTPD_RESP_USE_STRLEN -1
+
+typedef void *httpd_handle_t;
+
+typedef enum {
+	HTTP_GET = 1,
+	HTTP_POST = 3
+} httpd_method_t;
+
+typedef struct httpd_req {
+	httpd_handle_t handle;
+	int method;
+	const char uri[513];
+	size_t content_len;
+	void *aux;
+	void *user_ctx;
+} httpd_req_t;
+
+typedef bool (*httpd_uri_match_func_t)(const char *reference_uri, const char *uri_to_match, size_t match_upto);
+
+typedef struct {
+	unsigned task_priority;
+	size_t stack_size;
+	BaseType_t core_id;
+	uint16_t server_port;
+	uint16_t ctrl_port;
+	uint16_t max_open_sockets;
+	uint16_t max_uri_handlers;
+	uint16_t max_resp_headers;
+	uint16_t backlog_conn;
+	bool lru_purge_enable;
+	uint16_t recv_wait_timeout;
+	uint16_t send_wait_timeout;
+	httpd_uri_match_func_t uri_match_fn;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() { \
+		.task_priority = tskIDLE_PRIORITY+5, .stack_size = 4096, .core_id = tskNO_AFFINITY, \
+		.server_port = 80, .ctrl_port = 32768, .max_open_sockets = 7, .max_uri_handlers = 8, \
+		.max_resp_headers = 8, .backlog_conn = 5, .lru_purge_enable = false, \
+		.recv_wait_timeout = 5, .send_wait_timeout = 5, .uri_match_fn = NULL }
+
+typedef struct {
+	const char *uri;
+	httpd_method_t method;
+	esp_err_t (*handler)(httpd_req_t *r);
+	void *user_ctx;
+	bool is_websocket;
+} httpd_uri_t;
+
+typedef enum {
+	HTTPD_400_BAD_REQUEST = 400,
+	HTTPD_404_NOT_FOUND = 404,
+	HTTPD_408_REQ_TIMEOUT = 408,
+	HTTPD_500_INTERNAL_SERVER_ERROR = 500
+} httpd_err_code_t;
+
+typedef enum {
+	HTTPD_WS_TYPE_CONTINUE = 0x0,
+	HTTPD_WS_TYPE_TEXT = 0x1,
+	HTTPD_WS_TYPE_BINARY = 0x2,
+	HTTPD_WS_TYPE_CLOSE = 0x8,
+	HTTPD_WS_TYPE_PING = 0x9,
+	HTTPD_WS_TYPE_PONG = 0xA
+} httpd_ws_type_t;
+
+typedef struct {
+	bool final;
+	bool fragmented;
+	httpd_ws_type_t type;
+	uint8_t *payload;
+	size_t len;
+} httpd_ws_frame_t;
+
+typedef enum {
+	HTTPD_WS_CLIENT_INVALID = 0x0,
+	HTTPD_WS_CLIENT_HTTP = 0x1,
+	HTTPD_WS_CLIENT_WEBSOCKET = 0x2
+} httpd_ws_client_info_t;
+
+typedef void (*httpd_work_fn_t)(void *arg);
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+esp_err_t httpd_stop(httpd_handle_t handle);
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler);
+bool httpd_uri_match_wildcard(const char *reference_uri, const char *uri_to_match, size_t match_upto);
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg);
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len);
+int httpd_req_to_sockfd(httpd_req_t *r);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size);
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg);
+
+static inline esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str) {
+	return httpd_resp_send(r, str, (str == NULL) ? 0 : HTTPD_RESP_USE_STRLEN);
+}
+
+static inline esp_err_t httpd_resp_sendstr_chunk(httpd_req_t *r, const char *str) {
+	return httpd_resp_send_chunk(r, str, (str == NULL) ? 0 : HTTPD_RESP_USE_STRLEN);
+}
+
+static inline esp_err_t httpd_resp_send_404(httpd_req_t *r) {
+	return httpd_resp_send_err(r, HTTPD_404_NOT_FOUND, NULL);
+}
+
+static inline esp_err_t httpd_resp_send_408(httpd_req_t *r) {
+	return httpd_resp_send_err(r, HTTPD_408_REQ_TIMEOUT, NULL);
+}
+
+static inline esp_err_t httpd_resp_send_500(httpd_req_t *r) {
+	return httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len);
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame);
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd);
+
+#endif /* HOST_STUB_ESP_HTTP_SERVER_H_ */
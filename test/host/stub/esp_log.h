@@ -0,0 +1,16 @@
+/* Host stand-in for ESP-IDF esp_log.h. Logging is compiled out, but formats are still checked. */
+
+#ifndef HOST_STUB_ESP_LOG_H_
+#define HOST_STUB_ESP_LOG_H_
+
+#include <stdio.h>
+
+#define HOST_LOG(format, ...) do { if (0) printf(format, ##__VA_ARGS__); } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG(format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) HOST_LOG(format, ##__VA_ARGS__)
+
+#endif /* HOST_STUB_ESP_LOG_H_ */
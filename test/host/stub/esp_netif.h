@@ -0,0 +1,49 @@
+/* Host stand-in for ESP-IDF esp_netif.h. Interfaces are only passed around by handle. */
+
+#ifndef HOST_STUB_ESP_NETIF_H_
+#define HOST_STUB_ESP_NETIF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef struct esp_netif_obj esp_netif_t;
+
+typedef struct {
+	uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+	esp_ip4_addr_t ip;
+	esp_ip4_addr_t netmask;
+	esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+extern esp_event_base_t IP_EVENT;
+
+typedef enum {
+	IP_EVENT_STA_GOT_IP = 0,
+	IP_EVENT_STA_LOST_IP
+} ip_event_t;
+
+typedef struct {
+	int if_index;
+	esp_netif_t *esp_netif;
+	esp_netif_ip_info_t ip_info;
+	bool ip_changed;
+} ip_event_got_ip_t;
+
+/* Addresses are held in network byte order */
+#define IP2STR(ipaddr) ((uint8_t *)(&(ipaddr)->addr))[0], ((uint8_t *)(&(ipaddr)->addr))[1], \
+		((uint8_t *)(&(ipaddr)->addr))[2], ((uint8_t *)(&(ipaddr)->addr))[3]
+#define IPSTR "%d.%d.%d.%d"
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_create_default_wifi_sta(void);
+esp_netif_t *esp_netif_create_default_wifi_ap(void);
+void esp_netif_destroy(esp_netif_t *netif);
+esp_err_t esp_netif_get_ip_info(esp_netif_t *netif, esp_netif_ip_info_t *ip_info);
+esp_err_t esp_wifi_clear_default_wifi_driver_and_handlers(void *esp_netif);
+
+#endif /* HOST_STUB_ESP_NETIF_H_ */
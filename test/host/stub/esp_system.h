@@ -0,0 +1,12 @@
+/* Host stand-in for ESP-IDF esp_system.h */
+
+#ifndef HOST_STUB_ESP_SYSTEM_H_
+#define HOST_STUB_ESP_SYSTEM_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+uint32_t esp_random(void);
+esp_err_t esp_efuse_mac_get_default(uint8_t *mac);
+
+#endif /* HOST_STUB_ESP_SYSTEM_H_ */
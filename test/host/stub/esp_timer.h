@@ -0,0 +1,26 @@
+/* Host stand-in for ESP-IDF esp_timer.h. Time comes from the fake clock in fakes.c.
+ * One-shot timers only fire when a test fires them - see fake_wifi_driver.h. */
+
+#ifndef HOST_STUB_ESP_TIMER_H_
+#define HOST_STUB_ESP_TIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef struct {
+	esp_timer_cb_t callback;
+	void *arg;
+	const char *name;
+	bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+int64_t esp_timer_get_time(void);
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+#endif /* HOST_STUB_ESP_TIMER_H_ */
@@ -0,0 +1,36 @@
+/* Host stand-in for ESP-IDF esp_wifi.h. Scan results come from the fake driver in fakes.c,
+ * and the rest of the driver from fake_wifi_driver.c. */
+
+#ifndef HOST_STUB_ESP_WIFI_H_
+#define HOST_STUB_ESP_WIFI_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_wifi_types.h"
+
+#define ESP_ERR_WIFI_PASSWORD (ESP_ERR_WIFI_BASE + 10)
+
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+
+typedef struct {
+	int unused;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT() { 0 }
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_deinit(void);
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_stop(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_disconnect(void);
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info);
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *number);
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *ap_records);
+
+#endif /* HOST_STUB_ESP_WIFI_H_ */
@@ -0,0 +1,171 @@
+/* Host stand-in for ESP-IDF esp_wifi_types.h - configuration, scan records, events and disconnect reasons */
+
+#ifndef HOST_STUB_ESP_WIFI_TYPES_H_
+#define HOST_STUB_ESP_WIFI_TYPES_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_event.h"
+
+typedef enum {
+	WIFI_MODE_NULL = 0,
+	WIFI_MODE_STA,
+	WIFI_MODE_AP,
+	WIFI_MODE_APSTA
+} wifi_mode_t;
+
+typedef enum {
+	WIFI_IF_STA = 0,
+	WIFI_IF_AP
+} wifi_interface_t;
+
+#define ESP_IF_WIFI_STA WIFI_IF_STA
+#define ESP_IF_WIFI_AP  WIFI_IF_AP
+
+typedef enum {
+	WIFI_STORAGE_FLASH,
+	WIFI_STORAGE_RAM
+} wifi_storage_t;
+
+typedef enum {
+	WIFI_AUTH_OPEN = 0,
+	WIFI_AUTH_WEP,
+	WIFI_AUTH_WPA_PSK,
+	WIFI_AUTH_WPA2_PSK,
+	WIFI_AUTH_WPA_WPA2_PSK,
+	WIFI_AUTH_WPA2_ENTERPRISE,
+	WIFI_AUTH_WPA3_PSK,
+	WIFI_AUTH_WPA2_WPA3_PSK,
+	WIFI_AUTH_MAX
+} wifi_auth_mode_t;
+
+typedef struct {
+	uint8_t bssid[6];
+	uint8_t ssid[33];
+	uint8_t primary;
+	int second;
+	int8_t rssi;
+	wifi_auth_mode_t authmode;
+} wifi_ap_record_t;
+
+typedef enum {
+	WIFI_FAST_SCAN = 0,
+	WIFI_ALL_CHANNEL_SCAN
+} wifi_scan_method_t;
+
+typedef enum {
+	WIFI_CONNECT_AP_BY_SIGNAL = 0,
+	WIFI_CONNECT_AP_BY_SECURITY
+} wifi_sort_method_t;
+
+typedef enum {
+	WIFI_SCAN_TYPE_ACTIVE = 0,
+	WIFI_SCAN_TYPE_PASSIVE
+} wifi_scan_type_t;
+
+typedef struct {
+	uint32_t min;
+	uint32_t max;
+} wifi_active_scan_time_t;
+
+typedef struct {
+	wifi_active_scan_time_t active;
+	uint32_t passive;
+} wifi_scan_time_t;
+
+typedef struct {
+	uint8_t *ssid;
+	uint8_t *bssid;
+	uint8_t channel;
+	bool show_hidden;
+	wifi_scan_type_t scan_type;
+	wifi_scan_time_t scan_time;
+} wifi_scan_config_t;
+
+typedef struct {
+	uint8_t ssid[32];
+	uint8_t password[64];
+	uint8_t ssid_len;
+	uint8_t channel;
+	wifi_auth_mode_t authmode;
+	uint8_t max_connection;
+} wifi_ap_config_t;
+
+typedef struct {
+	uint8_t ssid[32];
+	uint8_t password[64];
+	wifi_scan_method_t scan_method;
+	bool bssid_set;
+	uint8_t bssid[6];
+	uint8_t channel;
+	wifi_sort_method_t sort_method;
+} wifi_sta_config_t;
+
+typedef union {
+	wifi_ap_config_t ap;
+	wifi_sta_config_t sta;
+} wifi_config_t;
+
+extern esp_event_base_t WIFI_EVENT;
+
+typedef enum {
+	WIFI_EVENT_WIFI_READY = 0,
+	WIFI_EVENT_SCAN_DONE,
+	WIFI_EVENT_STA_START,
+	WIFI_EVENT_STA_STOP,
+	WIFI_EVENT_STA_CONNECTED,
+	WIFI_EVENT_STA_DISCONNECTED,
+	WIFI_EVENT_STA_AUTHMODE_CHANGE,
+	WIFI_EVENT_AP_START = 12,
+	WIFI_EVENT_AP_STOP,
+	WIFI_EVENT_AP_STACONNECTED,
+	WIFI_EVENT_AP_STADISCONNECTED
+} wifi_event_t;
+
+typedef struct {
+	uint32_t status;
+	uint8_t number;
+	uint8_t scan_id;
+} wifi_event_sta_scan_done_t;
+
+typedef struct {
+	uint8_t ssid[32];
+	uint8_t ssid_len;
+	uint8_t bssid[6];
+	uint8_t reason;
+} wifi_event_sta_disconnected_t;
+
+typedef struct {
+	uint8_t mac[6];
+	uint8_t aid;
+} wifi_event_ap_staconnected_t;
+
+typedef struct {
+	uint8_t mac[6];
+	uint8_t aid;
+} wifi_event_ap_stadisconnected_t;
+
+typedef enum {
+	WIFI_REASON_UNSPECIFIED              = 1,
+	WIFI_REASON_AUTH_EXPIRE              = 2,
+	WIFI_REASON_AUTH_LEAVE               = 3,
+	WIFI_REASON_ASSOC_EXPIRE             = 4,
+	WIFI_REASON_ASSOC_TOOMANY            = 5,
+	WIFI_REASON_NOT_AUTHED               = 6,
+	WIFI_REASON_NOT_ASSOCED              = 7,
+	WIFI_REASON_ASSOC_LEAVE              = 8,
+	WIFI_REASON_ASSOC_NOT_AUTHED         = 9,
+	WIFI_REASON_MIC_FAILURE              = 14,
+	WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT   = 15,
+	WIFI_REASON_GROUP_KEY_UPDATE_TIMEOUT = 16,
+	WIFI_REASON_IE_IN_4WAY_DIFFERS       = 17,
+	WIFI_REASON_802_1X_AUTH_FAILED       = 23,
+	WIFI_REASON_BEACON_TIMEOUT           = 200,
+	WIFI_REASON_NO_AP_FOUND              = 201,
+	WIFI_REASON_AUTH_FAIL                = 202,
+	WIFI_REASON_ASSOC_FAIL               = 203,
+	WIFI_REASON_HANDSHAKE_TIMEOUT        = 204,
+	WIFI_REASON_CONNECTION_FAIL          = 205,
+} wifi_err_reason_t;
+
+#endif /* HOST_STUB_ESP_WIFI_TYPES_H_ */
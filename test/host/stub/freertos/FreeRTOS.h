@@ -0,0 +1,43 @@
+/* Host stand-in for FreeRTOS.h. The modules under test run in a single thread on the host. */
+
+#ifndef HOST_STUB_FREERTOS_H_
+#define HOST_STUB_FREERTOS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdPASS  pdTRUE
+
+#define portMAX_DELAY      ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS 10
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY   0x7FFFFFFF
+
+#define portNUM_PROCESSORS 2
+
+#define BIT0 0x01
+#define BIT1 0x02
+#define BIT2 0x04
+#define BIT3 0x08
+#define BIT4 0x10
+#define BIT5 0x20
+#define BIT6 0x40
+#define BIT7 0x80
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux)  ((void)(mux))
+
+#endif /* HOST_STUB_FREERTOS_H_ */
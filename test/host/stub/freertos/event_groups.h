@@ -0,0 +1,22 @@
+/* Host stand-in for FreeRTOS event_groups.h. Waits never block - see fake_wifi_driver.c. */
+
+#ifndef HOST_STUB_FREERTOS_EVENT_GROUPS_H_
+#define HOST_STUB_FREERTOS_EVENT_GROUPS_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+typedef struct {
+	EventBits_t bits;
+} StaticEventGroup_t;
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buffer);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+		BaseType_t wait_for_all, TickType_t ticks);
+
+#endif /* HOST_STUB_FREERTOS_EVENT_GROUPS_H_ */
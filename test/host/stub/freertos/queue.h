@@ -0,0 +1,10 @@
+/* Host stand-in for FreeRTOS queue.h */
+
+#ifndef HOST_STUB_FREERTOS_QUEUE_H_
+#define HOST_STUB_FREERTOS_QUEUE_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *QueueHandle_t;
+
+#endif /* HOST_STUB_FREERTOS_QUEUE_H_ */
@@ -0,0 +1,20 @@
+/* Host stand-in for FreeRTOS semphr.h. With a single thread, every take succeeds at once. */
+
+#ifndef HOST_STUB_FREERTOS_SEMPHR_H_
+#define HOST_STUB_FREERTOS_SEMPHR_H_
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+typedef struct {
+	int count;
+} StaticSemaphore_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer);
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif /* HOST_STUB_FREERTOS_SEMPHR_H_ */
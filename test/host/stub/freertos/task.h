@@ -0,0 +1,32 @@
+/* Host stand-in for FreeRTOS task.h. Tasks are never run on the host - see fakes.c. */
+
+#ifndef HOST_STUB_FREERTOS_TASK_H_
+#define HOST_STUB_FREERTOS_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef struct {
+	int unused;
+} StaticTask_t;
+
+typedef enum {
+	eRunning = 0,
+	eReady,
+	eBlocked,
+	eSuspended,
+	eDeleted,
+	eInvalid
+} eTaskState;
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t code, const char *name, uint32_t stack_depth, void *parameters,
+		UBaseType_t priority, StackType_t *stack, StaticTask_t *task_buffer);
+void vTaskDelete(TaskHandle_t task);
+void vTaskSuspend(TaskHandle_t task);
+eTaskState eTaskGetState(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+#endif /* HOST_STUB_FREERTOS_TASK_H_ */
@@ -0,0 +1 @@
+/* Host stand-in for lwIP err.h. Nothing under test uses it. */
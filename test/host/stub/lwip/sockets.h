@@ -0,0 +1,20 @@
+/* Host stand-in for lwIP sockets.h, mapped onto the host's BSD sockets */
+
+#ifndef HOST_STUB_LWIP_SOCKETS_H_
+#define HOST_STUB_LWIP_SOCKETS_H_
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+/* lwIP's sockaddr_in has a length field that Linux lacks. It is only ever written, so padding will do. */
+#define sin_len sin_zero[0]
+
+/* Datagrams sent by the firmware are captured by fakes.c rather than sent */
+#define sendto fake_sendto
+ssize_t fake_sendto(int fd, const void *data, size_t length, int flags, const struct sockaddr *to, socklen_t to_length);
+
+#endif /* HOST_STUB_LWIP_SOCKETS_H_ */
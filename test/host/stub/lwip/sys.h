@@ -0,0 +1 @@
+/* Host stand-in for lwIP sys.h. Nothing under test uses it. */
@@ -0,0 +1,13 @@
+/* Host stand-in for mbedTLS pkcs5.h */
+
+#ifndef HOST_STUB_MBEDTLS_PKCS5_H_
+#define HOST_STUB_MBEDTLS_PKCS5_H_
+
+#include <stdint.h>
+#include "mbedtls/md.h"
+
+int mbedtls_pkcs5_pbkdf2_hmac(mbedtls_md_context_t *ctx, const unsigned char *password, size_t plen,
+		const unsigned char *salt, size_t slen, unsigned int iteration_count, uint32_t key_length,
+		unsigned char *output);
+
+#endif /* HOST_STUB_MBEDTLS_PKCS5_H_ */
@@ -0,0 +1 @@
+/* Host stand-in for ESP-IDF mdns.h. Nothing under test uses it. */
@@ -0,0 +1 @@
+/* Host stand-in for ESP-IDF nvs_flash.h. NVS is replaced by the fake memory module in fakes.c. */
@@ -0,0 +1,8 @@
+/* Host stand-in for the generated sdkconfig.h - the project settings the modules under test read */
+
+#ifndef HOST_STUB_SDKCONFIG_H_
+#define HOST_STUB_SDKCONFIG_H_
+
+#define CONFIG_LWIP_MAX_SOCKETS 16
+
+#endif /* HOST_STUB_SDKCONFIG_H_ */
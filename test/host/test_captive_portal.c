@@ -0,0 +1,705 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Captive Portal Host Tests
+ * Replies built by the DNS server for each kind of
+ * query, a benchmark of the reply engine against the
+ * reply path of the original firmware, a replay of the
+ * probe sequences clients send on joining the AP, and a
+ * load generator with one client flooding the server.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <ctype.h>
+
+#include "host_test.h"
+#include "fakes.h"
+#include "dns_corpus.h"
+#include "legacy_dns_reply.h"
+
+/* The reply engine is static, so the server is built into the test */
+#include "captive_portal.c"
+
+/* Rounds of the corpus replayed by the benchmark */
+#define BENCH_ROUNDS 20000
+
+/* Timed runs of each reply path. The median is reported. */
+#define BENCH_REPEATS 9
+
+/* Longest probe sequence replayed */
+#define PROBE_SEQUENCE_MAX 6
+
+/*
+ * Probe sequences sent by clients on joining the AP, as captured from each OS. All queries
+ * of a sequence go out together, and the portal pops up once the last is resolved or
+ * abandoned. The timeout is the first retransmission interval of the client's stub resolver,
+ * so is the least an unanswered query costs.
+ */
+typedef struct {
+	const char *client;
+	uint32_t timeout_ms;
+	int count;
+	struct {
+		const char *name;
+		uint16_t qtype;
+	} queries[PROBE_SEQUENCE_MAX];
+} probe_sequence_t;
+
+static const probe_sequence_t probe_sequences[] = {
+		{ "iOS", 1000, 3, {
+				{ "captive.apple.com", QTYPE_A },
+				{ "captive.apple.com", QTYPE_AAAA },
+				{ "captive.apple.com", QTYPE_HTTPS } } },
+		{ "Android", 5000, 4, {
+				{ "connectivitycheck.gstatic.com", QTYPE_A },
+				{ "connectivitycheck.gstatic.com", QTYPE_AAAA },
+				{ "www.google.com", QTYPE_A },
+				{ "www.google.com", QTYPE_AAAA } } },
+		{ "Windows", 1000, 4, {
+				{ "www.msftconnecttest.com", QTYPE_A },
+				{ "www.msftconnecttest.com", QTYPE_AAAA },
+				{ "dns.msftncsi.com", QTYPE_A },
+				{ "dns.msftncsi.com", QTYPE_AAAA } } },
+		{ "Linux", 5000, 2, {
+				{ "nmcheck.gnome.org", QTYPE_A },
+				{ "nmcheck.gnome.org", QTYPE_AAAA } } },
+		{ "Chrome", 1000, 3, {
+				{ "example.com", QTYPE_A },
+				{ "example.com", QTYPE_AAAA },
+				{ "example.com", QTYPE_HTTPS } } },
+};
+#define PROBE_SEQUENCE_COUNT (sizeof(probe_sequences)/sizeof(probe_sequences[0]))
+
+/*
+ * Load model. The server handles one datagram at a time from a receive mailbox of
+ * LOAD_MAILBOX entries, as lwIP does, and datagrams arriving at a full mailbox are lost.
+ * Service times are estimates for the ESP32: a rate-limited query is dropped after the
+ * bucket lookup, so costs far less than one that is parsed and answered.
+ */
+#define LOAD_MAILBOX 6
+#define LOAD_REPLY_US 250
+#define LOAD_DROP_US 25
+#define LOAD_DURATION_US 10000000
+#define LOAD_FLOOD_INTERVAL_US 200       // 5000 queries/s from the flooding station
+#define LOAD_CLIENT_INTERVAL_US 250000   // 4 queries/s from each other station
+#define LOAD_CLIENTS 3
+#define LOAD_MAX_SAMPLES (2 * LOAD_CLIENTS * LOAD_DURATION_US / LOAD_CLIENT_INTERVAL_US)
+
+/* Query waiting in the mailbox */
+typedef struct {
+	int64_t arrival_us;
+	uint8_t host;
+} load_packet_t;
+
+/* Outcome of a load run, for the well-behaved stations only */
+typedef struct {
+	int sent;
+	int lost;                            // Dropped at the mailbox or never answered
+	uint32_t latency_us[LOAD_MAX_SAMPLES];
+	int answered;
+} load_result_t;
+
+/* Answer record expected for every A question pointing at the first name in the packet */
+static const uint8_t expected_answer[DNS_ANSWER_LEN] = {
+		0xC0, 0x0C, 0, QTYPE_A, 0, QCLASS_IN, 0, 0, 0, DNS_ANSWER_TTL, 0, 4, 192, 168, 4, 1
+};
+
+/*
+ * @brief Address of a station on the AP network
+ */
+static struct sockaddr_in station(uint8_t host) {
+	struct sockaddr_in addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(0xC0A80400 | host);
+	addr.sin_port = htons(5353);
+
+	return addr;
+}
+
+/*
+ * @brief Pass a query to the server as if it came from a station
+ * @return Number of replies sent
+ */
+static int query_from(uint8_t host, const uint8_t *query, size_t length) {
+	uint8_t packet[DNS_LEN];
+	struct sockaddr_in from = station(host);
+
+	memcpy(packet, query, length);
+	fake_sockets_reset();
+	captive_portal_recv(&from, packet, length);
+
+	return fake_sent_count;
+}
+
+static uint16_t reply_field(int offset) {
+	return (fake_sent[offset] << 8) | fake_sent[offset + 1];
+}
+
+static void setup() {
+	// The portal starts a few seconds after boot
+	fake_time_us = 5000000;
+	prepare_replies();
+}
+
+static void test_a_query_gets_ap_address() {
+	uint8_t query[DNS_LEN];
+	setup();
+
+	size_t length = dns_encode_query(query, 0x1234, "example.com", QTYPE_A, false);
+
+	CHECK_EQ(query_from(2, query, length), 1);
+	CHECK_EQ(fake_sent_length, length + DNS_ANSWER_LEN);
+	CHECK_EQ(reply_field(0), 0x1234);
+	CHECK_EQ(fake_sent[2], FLAG_QR | FLAG_AA | FLAG_RD);
+	CHECK_EQ(fake_sent[3], FLAG_RA | RCODE_NOERROR);
+	CHECK_EQ(reply_field(4), 1);
+	CHECK_EQ(reply_field(6), 1);
+	CHECK_EQ(reply_field(8), 0);
+	CHECK_EQ(reply_field(10), 0);
+	CHECK(memcmp(&fake_sent[length], expected_answer, DNS_ANSWER_LEN) == 0);
+	CHECK_EQ(stats.replies, 1);
+}
+
+static void test_probe_host_served_from_table() {
+	uint8_t query[DNS_LEN];
+	setup();
+
+	size_t length = dns_encode_query(query, 0xBEEF, "Captive.Apple.COM", QTYPE_A, false);
+
+	CHECK_EQ(query_from(2, query, length), 1);
+	CHECK_EQ(stats.probe_hits, 1);
+	CHECK_EQ(stats.probe_misses, 0);
+	CHECK_EQ(fake_sent_length, length + DNS_ANSWER_LEN);
+	CHECK_EQ(reply_field(0), 0xBEEF);
+	CHECK_EQ(fake_sent[2], FLAG_QR | FLAG_AA | FLAG_RD);
+	// Name comes back with the case the client used
+	CHECK(memcmp(&fake_sent[DNS_HEADER_LEN], &query[DNS_HEADER_LEN], length - DNS_HEADER_LEN) == 0);
+	// Probe answers carry the longer TTL
+	CHECK_EQ(fake_sent[length + 9], DNS_PROBE_TTL);
+	CHECK(memcmp(&fake_sent[length + 12], &expected_answer[12], 4) == 0);
+}
+
+/*
+ * @brief Every probe host is found in any case, and a name that only shares its length and
+ * ends with one is not
+ */
+static void test_every_probe_host_found() {
+	uint8_t query[DNS_LEN];
+	char upper[DNS_PROBE_NAME_LEN];
+	setup();
+
+	for (int i = 0; i < DNS_PROBE_NAME_COUNT; i++) {
+		for (int j = 0; j <= strlen(probe_names[i].name); j++) {
+			upper[j] = toupper((unsigned char)probe_names[i].name[j]);
+		}
+		size_t length = dns_encode_query(query, i, upper, QTYPE_A, false);
+		CHECK_EQ(query_from(2, query, length), 1);
+		fake_time_us += 1000000;
+	}
+	CHECK_EQ(stats.probe_hits, DNS_PROBE_NAME_COUNT);
+
+	size_t length = dns_encode_query(query, 1, "connectivitycheck.gstatix.com", QTYPE_A, false);
+	CHECK_EQ(query_from(2, query, length), 1);
+	length = dns_encode_query(query, 1, "xonnectivitycheck.gstatic.com", QTYPE_A, false);
+	CHECK_EQ(query_from(2, query, length), 1);
+	CHECK_EQ(stats.probe_hits, DNS_PROBE_NAME_COUNT);
+	CHECK_EQ(stats.probe_misses, 2);
+}
+
+static void test_every_question_answered() {
+	uint8_t query[DNS_LEN];
+	uint8_t second[DNS_LEN];
+	setup();
+
+	// Two A questions - the second name starts where the first question ends
+	size_t length = dns_encode_query(query, 1, "one.example", QTYPE_A, false);
+	size_t second_length = dns_encode_query(second, 1, "two.example", QTYPE_A, false);
+	memcpy(&query[length], &second[DNS_HEADER_LEN], second_length - DNS_HEADER_LEN);
+	uint16_t second_name = length;
+	length += second_length - DNS_HEADER_LEN;
+	query[5] = 2;
+
+	CHECK_EQ(query_from(2, query, length), 1);
+	CHECK_EQ(reply_field(4), 2);
+	CHECK_EQ(reply_field(6), 2);
+	CHECK_EQ(fake_sent_length, length + 2*DNS_ANSWER_LEN);
+	CHECK_EQ(reply_field(length), DNS_NAME_POINTER | DNS_HEADER_LEN);
+	CHECK_EQ(reply_field(length + DNS_ANSWER_LEN), DNS_NAME_POINTER | second_name);
+}
+
+static void test_edns_record_not_echoed() {
+	uint8_t query[DNS_LEN];
+	uint8_t plain[DNS_LEN];
+	setup();
+
+	size_t question_end = dns_encode_query(plain, 7, "example.com", QTYPE_A, false);
+	size_t length = dns_encode_query(query, 7, "example.com", QTYPE_A, true);
+
+	CHECK(length > question_end);
+	CHECK_EQ(query_from(2, query, length), 1);
+	CHECK_EQ(reply_field(10), 0);
+	CHECK_EQ(fake_sent_length, question_end + DNS_ANSWER_LEN);
+}
+
+static void test_aaaa_gets_nodata() {
+	uint8_t query[DNS_LEN];
+	setup();
+
+	size_t length = dns_encode_query(query, 9, "example.com", QTYPE_AAAA, false);
+
+	CHECK_EQ(query_from(2, query, length), 1);
+	CHECK_EQ(fake_sent[3], FLAG_RA | RCODE_NOERROR);
+	CHECK_EQ(reply_field(6), 0);
+	CHECK_EQ(reply_field(8), 1);
+	CHECK_EQ(fake_sent_length, length + DNS_SOA_LEN);
+	// The SOA is owned by the root, not by the name queried
+	CHECK_EQ(fake_sent[length], 0);
+	CHECK_EQ(reply_field(length + 1), QTYPE_SOA);
+	CHECK_EQ(reply_field(length + 9), DNS_SOA_LEN - 11);
+}
+
+static void test_nxdomain_policy() {
+	uint8_t query[DNS_LEN];
+	setup();
+
+	CHECK_EQ(captive_portal_set_policy(QTYPE_AAAA, DNS_POLICY_NXDOMAIN), ESP_OK);
+	size_t length = dns_encode_query(query, 9, "example.com", QTYPE_AAAA, false);
+
+	CHECK_EQ(query_from(2, query, length), 1);
+	CHECK_EQ(fake_sent[3], FLAG_RA | RCODE_NXDOMAIN);
+	CHECK_EQ(reply_field(8), 1);
+	CHECK_EQ(fake_sent[length], 0);
+
+	CHECK_EQ(captive_portal_set_policy(QTYPE_AAAA, DNS_POLICY_DROP), ESP_OK);
+	CHECK_EQ(query_from(2, query, length), 0);
+
+	CHECK_EQ(captive_portal_set_policy(QTYPE_AAAA, DNS_POLICY_NODATA), ESP_OK);
+}
+
+/*
+ * @brief Probe hosts follow the A policy like any other name, rather than always being answered
+ */
+static void test_probe_host_follows_policy() {
+	uint8_t query[DNS_LEN];
+	setup();
+
+	size_t length = dns_encode_query(query, 9, "captive.apple.com", QTYPE_A, false);
+
+	CHECK_EQ(captive_portal_set_policy(QTYPE_A, DNS_POLICY_NXDOMAIN), ESP_OK);
+	CHECK_EQ(query_from(2, query, length), 1);
+	CHECK_EQ(fake_sent[3], FLAG_RA | RCODE_NXDOMAIN);
+	CHECK_EQ(reply_field(6), 0);
+	CHECK_EQ(reply_field(8), 1);
+
+	CHECK_EQ(captive_portal_set_policy(QTYPE_A, DNS_POLICY_NODATA), ESP_OK);
+	CHECK_EQ(query_from(2, query, length), 1);
+	CHECK_EQ(fake_sent[3], FLAG_RA | RCODE_NOERROR);
+	CHECK_EQ(reply_field(6), 0);
+
+	CHECK_EQ(captive_portal_set_policy(QTYPE_A, DNS_POLICY_DROP), ESP_OK);
+	CHECK_EQ(query_from(2, query, length), 0);
+	CHECK_EQ(stats.probe_hits, 0);
+
+	CHECK_EQ(captive_portal_set_policy(QTYPE_A, DNS_POLICY_ANSWER), ESP_OK);
+	CHECK_EQ(query_from(2, query, length), 1);
+	CHECK_EQ(stats.probe_hits, 1);
+	CHECK_EQ(fake_sent_length, length + DNS_ANSWER_LEN);
+}
+
+static void test_new_client_takes_free_entry() {
+	uint8_t query[DNS_LEN];
+	setup();
+
+	// Straight after boot every entry has been seen at time 0
+	fake_time_us = 0;
+	size_t length = dns_encode_query(query, 9, "example.com", QTYPE_A, false);
+
+	for (int i = 0; i < DNS_BUCKET_CAPACITY; i++) {
+		query_from(2, query, length);
+	}
+	CHECK_EQ(query_from(3, query, length), 1);
+
+	// The first station is still out of budget rather than starting afresh
+	CHECK_EQ(query_from(2, query, length), 0);
+}
+
+static void test_malformed_query_dropped() {
+	uint8_t query[DNS_LEN];
+	setup();
+
+	size_t length = dns_encode_query(query, 9, "example.com", QTYPE_A, false);
+
+	CHECK_EQ(query_from(2, query, length - 3), 0);
+	CHECK_EQ(stats.malformed, 1);
+	CHECK_EQ(query_from(2, query, DNS_HEADER_LEN - 1), 0);
+	CHECK_EQ(stats.malformed, 2);
+}
+
+static void test_flooding_client_limited_alone() {
+	uint8_t query[DNS_LEN];
+	int replies = 0;
+	setup();
+
+	size_t length = dns_encode_query(query, 9, "example.com", QTYPE_A, false);
+
+	// A burst well over the bucket, all at the same instant
+	for (int i = 0; i < 2*DNS_BUCKET_CAPACITY; i++) {
+		replies += query_from(2, query, length);
+	}
+	CHECK_EQ(replies, DNS_BUCKET_CAPACITY);
+	CHECK_EQ(stats.rate_limited, DNS_BUCKET_CAPACITY);
+
+	// Another station still has its whole budget
+	CHECK_EQ(query_from(3, query, length), 1);
+
+	// The flooding station earns replies back over time
+	fake_time_us += 1000000;
+	replies = 0;
+	for (int i = 0; i < 2*DNS_BUCKET_CAPACITY; i++) {
+		replies += query_from(2, query, length);
+	}
+	CHECK_EQ(replies, DNS_BUCKET_REFILL_PER_SEC);
+}
+
+/* Cost of replying by one path, from one timed run */
+typedef struct {
+	double ns_per_reply;
+	double cycles_per_reply;
+	int replies_per_round;
+} reply_cost_t;
+
+/*
+ * @brief Replay queries through a reply path and time it
+ * @param legacy Set to use the reply path of the original firmware
+ * @param corpus Queries to replay
+ * @param count Number of queries
+ */
+static reply_cost_t time_path(bool legacy, const dns_corpus_query_t *corpus, int count) {
+	uint8_t packet[DNS_LEN];
+	struct sockaddr_in from = station(2);
+
+	setup();
+	fake_sockets_reset();
+
+	uint64_t start_ns = host_time_ns();
+	uint64_t start_cycles = host_cycles();
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		for (int i = 0; i < count; i++) {
+			memcpy(packet, corpus[i].data, corpus[i].length);
+			// Queries arrive slowly enough that the client is never rate limited
+			fake_time_us += 100000;
+			if (legacy) {
+				legacy_captive_portal_recv(sockFd, &from, (char *)packet, corpus[i].length);
+			} else {
+				captive_portal_recv(&from, packet, corpus[i].length);
+			}
+		}
+	}
+	uint64_t cycles = host_cycles() - start_cycles;
+	uint64_t elapsed_ns = host_time_ns() - start_ns;
+
+	return (reply_cost_t){
+			.ns_per_reply = (double)elapsed_ns / fake_sent_count,
+			.cycles_per_reply = (double)cycles / fake_sent_count,
+			.replies_per_round = fake_sent_count / BENCH_ROUNDS
+	};
+}
+
+static int compare_costs(const void *a, const void *b) {
+	double x = ((const reply_cost_t *)a)->cycles_per_reply;
+	double y = ((const reply_cost_t *)b)->cycles_per_reply;
+	return (x > y) - (x < y);
+}
+
+static void bench_reply_paths() {
+	static dns_corpus_query_t corpus[DNS_CORPUS_MAX];
+	static dns_corpus_query_t plain_a[DNS_CORPUS_MAX];
+	static const char *const labels[] = { "original, plain A queries", "current, plain A queries", "current, whole corpus" };
+	reply_cost_t costs[3][BENCH_REPEATS];
+	int count = dns_corpus_build(corpus);
+	int plain_count = 0;
+
+	// The original firmware only answered A queries, and aborted on an EDNS record
+	for (int i = 0; i < count; i++) {
+		if (corpus[i].qtype == QTYPE_A && !corpus[i].edns) {
+			plain_a[plain_count++] = corpus[i];
+		}
+	}
+
+	// Paths take turns, so that a change of clock speed part way through falls on all of them
+	for (int repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+		costs[0][repeat] = time_path(true, plain_a, plain_count);
+		costs[1][repeat] = time_path(false, plain_a, plain_count);
+		costs[2][repeat] = time_path(false, corpus, count);
+	}
+
+	printf("DNS reply paths, median of %d runs of %d rounds (host timings)\n", BENCH_REPEATS, BENCH_ROUNDS);
+	for (int path = 0; path < 3; path++) {
+		qsort(costs[path], BENCH_REPEATS, sizeof(reply_cost_t), compare_costs);
+		reply_cost_t *median = &costs[path][BENCH_REPEATS/2];
+		printf("%-28s %9.0f queries/s %7.0f ns/reply %7.0f cycles/reply (%d replies per round)\n", labels[path],
+				1e9 / median->ns_per_reply, median->ns_per_reply, median->cycles_per_reply, median->replies_per_round);
+	}
+	printf("original/current, plain A: %.2fx the cycles\n",
+			costs[0][BENCH_REPEATS/2].cycles_per_reply / costs[1][BENCH_REPEATS/2].cycles_per_reply);
+}
+
+/* Server state during a load run. Times are relative to the start of the run. */
+typedef struct {
+	load_packet_t mailbox[LOAD_MAILBOX];
+	int head;
+	int queued;
+	int64_t free_us;          // Time the server finishes its current query
+	bool unlimited;           // Model the original firmware, which had no rate limiting
+	uint8_t query[DNS_LEN];   // Query sent by every station
+	size_t length;
+} load_server_t;
+
+/*
+ * @brief Serve queries from the mailbox until the server is busy past a given time
+ * @param server Server state
+ * @param start_us Fake clock at the start of the run
+ * @param until_us Time to serve up to
+ * @param result Outcome for the well-behaved stations
+ */
+static void load_serve(load_server_t *server, int64_t start_us, int64_t until_us, load_result_t *result) {
+	while (server->queued > 0 && server->free_us <= until_us) {
+		load_packet_t *packet = &server->mailbox[server->head];
+		int64_t begin_us = (packet->arrival_us > server->free_us) ? packet->arrival_us : server->free_us;
+
+		fake_time_us = start_us + begin_us;
+		if (server->unlimited) {
+			for (int i = 0; i < DNS_CLIENT_TABLE_SIZE; i++) {
+				client_table[i].tokens = DNS_BUCKET_CAPACITY*DNS_TOKEN;
+			}
+		}
+		bool answered = query_from(packet->host, server->query, server->length) > 0;
+		server->free_us = begin_us + (answered ? LOAD_REPLY_US : LOAD_DROP_US);
+
+		if (packet->host != 2) {
+			if (answered) {
+				result->latency_us[result->answered++] = server->free_us - packet->arrival_us;
+			} else {
+				result->lost++;
+			}
+		}
+		server->head = (server->head + 1) % LOAD_MAILBOX;
+		server->queued--;
+	}
+}
+
+/*
+ * @brief Run one station flooding the server alongside well-behaved stations
+ * @param unlimited Set to model the original firmware, which had no rate limiting
+ * @param result Latency of each answered query from the well-behaved stations
+ */
+static void run_load(bool unlimited, load_result_t *result) {
+	static load_server_t server;
+	int64_t next_flood_us = 0;
+	int64_t next_client_us[LOAD_CLIENTS];
+	uint32_t seed = 1;
+
+	setup();
+	memset(&server, 0, sizeof(server));
+	memset(result, 0, sizeof(load_result_t));
+	server.unlimited = unlimited;
+	server.length = dns_encode_query(server.query, 9, "example.com", QTYPE_A, false);
+
+	// Stations start out of phase with each other
+	for (int i = 0; i < LOAD_CLIENTS; i++) {
+		next_client_us[i] = (i + 1) * LOAD_CLIENT_INTERVAL_US / (LOAD_CLIENTS + 1);
+	}
+
+	int64_t start_us = fake_time_us;
+	while (1) {
+		// Next arrival - the flooding station is host 2, the others hosts 3 onwards
+		int64_t arrival_us = next_flood_us;
+		int client = -1;
+		for (int i = 0; i < LOAD_CLIENTS; i++) {
+			if (next_client_us[i] < arrival_us) {
+				arrival_us = next_client_us[i];
+				client = i;
+			}
+		}
+		if (arrival_us >= LOAD_DURATION_US) {
+			break;
+		}
+
+		load_serve(&server, start_us, arrival_us, result);
+
+		if (client < 0) {
+			next_flood_us += LOAD_FLOOD_INTERVAL_US;
+		} else {
+			result->sent++;
+			// Up to 10% jitter, so the stations do not stay locked to the flood
+			seed = seed * 1103515245 + 12345;
+			next_client_us[client] += LOAD_CLIENT_INTERVAL_US - (seed >> 16) % (LOAD_CLIENT_INTERVAL_US / 10);
+		}
+
+		if (server.queued == LOAD_MAILBOX) {
+			if (client >= 0) {
+				result->lost++;
+			}
+			continue;
+		}
+		server.mailbox[(server.head + server.queued) % LOAD_MAILBOX] = (load_packet_t){
+				.arrival_us = arrival_us,
+				.host = (client < 0) ? 2 : 3 + client
+		};
+		server.queued++;
+	}
+
+	// Queries still in the mailbox are served once the load stops
+	load_serve(&server, start_us, INT64_MAX, result);
+}
+
+static int compare_latency(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * @brief Latency below which a fraction of the answered queries fall
+ */
+static uint32_t load_percentile(load_result_t *result, int percent) {
+	if (result->answered == 0) {
+		return 0;
+	}
+	qsort(result->latency_us, result->answered, sizeof(uint32_t), compare_latency);
+
+	return result->latency_us[(result->answered - 1) * percent / 100];
+}
+
+/*
+ * @brief Report the latency seen by well-behaved stations with and without rate limiting
+ */
+static void bench_flood_load() {
+	static load_result_t result;
+
+	printf("One station flooding at %d queries/s, %d others at %d queries/s, %d s (modelled ESP32 costs)\n",
+			1000000 / LOAD_FLOOD_INTERVAL_US, LOAD_CLIENTS, 1000000 / LOAD_CLIENT_INTERVAL_US,
+			LOAD_DURATION_US / 1000000);
+	for (int limited = 0; limited <= 1; limited++) {
+		run_load(!limited, &result);
+		printf("%-20s other stations: %4d sent %4d lost   p50 %6u us   p99 %6u us   max %6u us\n",
+				limited ? "per-client limit" : "no limit (original)", result.sent, result.lost,
+				load_percentile(&result, 50), load_percentile(&result, 99), load_percentile(&result, 100));
+	}
+}
+
+/*
+ * @brief A flooding station costs the others no lost queries, and only a few replies' worth of delay
+ */
+static void test_flood_leaves_others_served() {
+	static load_result_t result;
+
+	run_load(false, &result);
+	CHECK_EQ(result.lost, 0);
+	CHECK_EQ(result.answered, result.sent);
+	CHECK(load_percentile(&result, 99) <= LOAD_MAILBOX * LOAD_REPLY_US);
+}
+
+/*
+ * @brief Replay a probe sequence through a reply path
+ * @param sequence Queries sent by the client
+ * @param legacy Set to use the reply path of the original firmware
+ * @param unanswered Number of queries left without a reply
+ * @return Time until the client has resolved every query, in nanoseconds
+ */
+static uint64_t replay_sequence(const probe_sequence_t *sequence, bool legacy, int *unanswered) {
+	uint8_t query[DNS_LEN];
+	struct sockaddr_in from = station(2);
+	uint64_t slowest_ns = 0;
+
+	setup();
+	*unanswered = 0;
+
+	for (int i = 0; i < sequence->count; i++) {
+		size_t length = dns_encode_query(query, 0x100 + i, sequence->queries[i].name,
+				sequence->queries[i].qtype, false);
+		uint64_t elapsed_ns;
+
+		fake_sockets_reset();
+		uint64_t start_ns = host_time_ns();
+		if (legacy) {
+			legacy_captive_portal_recv(sockFd, &from, (char *)query, length);
+		} else {
+			captive_portal_recv(&from, query, length);
+		}
+		elapsed_ns = host_time_ns() - start_ns;
+
+		// A dropped query is only given up on once the resolver times out
+		if (fake_sent_count == 0) {
+			elapsed_ns = (uint64_t)sequence->timeout_ms * 1000000;
+			(*unanswered)++;
+		}
+		if (elapsed_ns > slowest_ns) {
+			slowest_ns = elapsed_ns;
+		}
+	}
+
+	return slowest_ns;
+}
+
+/*
+ * @brief Report how long each client waits on DNS before it can show the portal
+ */
+static void replay_probe_sequences() {
+	int unanswered_legacy;
+	int unanswered;
+
+	printf("Probe sequences, time until every query is resolved (resolver timeouts assumed)\n");
+	for (int i = 0; i < PROBE_SEQUENCE_COUNT; i++) {
+		const probe_sequence_t *sequence = &probe_sequences[i];
+		uint64_t legacy_ns = replay_sequence(sequence, true, &unanswered_legacy);
+		uint64_t current_ns = replay_sequence(sequence, false, &unanswered);
+
+		printf("%-8s original %5.0f ms (%d of %d dropped)   current %6.2f us (%d of %d dropped)\n",
+				sequence->client, legacy_ns / 1e6, unanswered_legacy, sequence->count,
+				current_ns / 1e3, unanswered, sequence->count);
+	}
+}
+
+/*
+ * @brief Every query of every probe sequence is answered straight away
+ */
+static void test_probe_sequences_answered() {
+	int unanswered;
+
+	for (int i = 0; i < PROBE_SEQUENCE_COUNT; i++) {
+		replay_sequence(&probe_sequences[i], false, &unanswered);
+		CHECK_EQ(unanswered, 0);
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		bench_reply_paths();
+		replay_probe_sequences();
+		bench_flood_load();
+		return 0;
+	}
+
+	RUN_TEST(test_a_query_gets_ap_address);
+	RUN_TEST(test_probe_host_served_from_table);
+	RUN_TEST(test_every_probe_host_found);
+	RUN_TEST(test_every_question_answered);
+	RUN_TEST(test_edns_record_not_echoed);
+	RUN_TEST(test_aaaa_gets_nodata);
+	RUN_TEST(test_nxdomain_policy);
+	RUN_TEST(test_probe_sequences_answered);
+	RUN_TEST(test_malformed_query_dropped);
+	RUN_TEST(test_flooding_client_limited_alone);
+	RUN_TEST(test_probe_host_follows_policy);
+	RUN_TEST(test_new_client_takes_free_entry);
+	RUN_TEST(test_flood_leaves_others_served);
+
+	return HOST_TEST_RESULT();
+}
@@ -0,0 +1,123 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Connect Policy Host Tests
+ * Disconnect reasons fed through the classifier and
+ * the retry counter, and the bounds of the backoff.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "host_test.h"
+#include "esp_wifi_types.h"
+#include "connect_policy.h"
+#include "disconnect_reasons.h"
+
+static void test_reasons_classified() {
+	for (int i = 0; i < disconnect_reason_count; i++) {
+		if (connect_policy_is_auth_failure(disconnect_reasons[i].reason) != disconnect_reasons[i].auth_failure) {
+			fprintf(stderr, "reason %d\n", disconnect_reasons[i].reason);
+			CHECK(false);
+		}
+	}
+}
+
+/*
+ * @brief However often the AP cannot be reached, the password is never taken to be wrong
+ */
+static void test_transient_failures_keep_credentials() {
+	connect_policy_t policy = CONNECT_POLICY_DEFAULT();
+	connect_retry_t retry;
+
+	for (int i = 0; i < disconnect_reason_count; i++) {
+		if (disconnect_reasons[i].auth_failure) {
+			continue;
+		}
+		connect_retry_init(&retry, &policy);
+		for (int attempt = 0; attempt < 100; attempt++) {
+			CHECK(!connect_retry_failed(&retry, disconnect_reasons[i].reason));
+		}
+	}
+}
+
+/*
+ * @brief Rejections count across transient failures, and one alone is not enough
+ */
+static void test_repeated_rejection_means_wrong_password() {
+	connect_policy_t policy = CONNECT_POLICY_DEFAULT();
+	connect_retry_t retry;
+
+	CHECK(policy.max_auth_failures >= 2);
+	connect_retry_init(&retry, &policy);
+	CHECK(!connect_retry_failed(&retry, WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT));
+	CHECK(!connect_retry_failed(&retry, WIFI_REASON_AUTH_EXPIRE));
+	CHECK(!connect_retry_failed(&retry, 0));
+	for (int i = 2; i < policy.max_auth_failures; i++) {
+		CHECK(!connect_retry_failed(&retry, WIFI_REASON_AUTH_FAIL));
+	}
+	CHECK(connect_retry_failed(&retry, WIFI_REASON_AUTH_FAIL));
+
+	// A new series starts again
+	connect_retry_init(&retry, &policy);
+	CHECK_EQ(retry.auth_failures, 0);
+}
+
+/*
+ * @brief Each pause lies between half and all of a backoff that doubles up to the maximum
+ */
+static void test_backoff_doubles_within_jitter() {
+	connect_policy_t policy = CONNECT_POLICY_DEFAULT();
+	connect_retry_t low, high;
+	uint32_t backoff_ms = policy.backoff_base_ms;
+
+	connect_retry_init(&low, &policy);
+	connect_retry_init(&high, &policy);
+	for (int i = 0; i < 40; i++) {
+		uint32_t shortest = connect_retry_next_delay_ms(&low, 0);
+		uint32_t longest = connect_retry_next_delay_ms(&high, backoff_ms/2);
+
+		CHECK_EQ(shortest, backoff_ms/2);
+		CHECK_EQ(longest, backoff_ms);
+		CHECK(longest <= policy.backoff_max_ms);
+		backoff_ms = (backoff_ms*2 < policy.backoff_max_ms) ? backoff_ms*2 : policy.backoff_max_ms;
+	}
+	CHECK_EQ(low.backoff_ms, policy.backoff_max_ms);
+
+	// Any random number gives a pause in range, even with a backoff that would overflow if doubled
+	policy.backoff_base_ms = UINT32_MAX/2 + 1;
+	policy.backoff_max_ms = UINT32_MAX;
+	connect_retry_init(&low, &policy);
+	for (int i = 0; i < 4; i++) {
+		uint32_t backoff = low.backoff_ms;
+		uint32_t delay_ms = connect_retry_next_delay_ms(&low, UINT32_MAX - i);
+
+		CHECK(delay_ms >= backoff/2 && delay_ms <= backoff);
+		CHECK(low.backoff_ms >= backoff);
+	}
+}
+
+/*
+ * @brief A zero backoff gives no pause, whatever the random number
+ */
+static void test_zero_backoff() {
+	connect_policy_t policy = CONNECT_POLICY_DEFAULT();
+	connect_retry_t retry;
+
+	policy.backoff_base_ms = 0;
+	policy.backoff_max_ms = 0;
+	connect_retry_init(&retry, &policy);
+	CHECK_EQ(connect_retry_next_delay_ms(&retry, 12345), 0);
+	CHECK_EQ(connect_retry_next_delay_ms(&retry, 12345), 0);
+}
+
+int main() {
+	RUN_TEST(test_reasons_classified);
+	RUN_TEST(test_transient_failures_keep_credentials);
+	RUN_TEST(test_repeated_rejection_means_wrong_password);
+	RUN_TEST(test_backoff_doubles_within_jitter);
+	RUN_TEST(test_zero_backoff);
+
+	return HOST_TEST_RESULT();
+}
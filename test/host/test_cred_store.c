@@ -0,0 +1,302 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Credential Store Host Tests
+ * Ranking of the known networks against simulated
+ * scan results, and the bookkeeping that feeds it.
+ * With --bench, counts the flash writes made while
+ * the known networks stay out of reach.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "host_test.h"
+#include "fakes.h"
+#include "cred_store.h"
+#include "memory.h"
+
+/* Retry rounds in a day of the station retrying every 30 s */
+#define BENCH_ROUNDS (24*60*60/30)
+
+/*
+ * @brief Build a network as seen by a scan
+ */
+static ap_details_t seen(const char *ssid, int8_t rssi, uint8_t channel) {
+	ap_details_t ap = { .authmode = WIFI_AUTH_WPA2_PSK, .rssi = rssi, .channel = channel };
+
+	snprintf(ap.ssid, sizeof(ap.ssid), "%s", ssid);
+	ap.bssid[5] = channel;
+	return ap;
+}
+
+/*
+ * @brief SSID of a ranked candidate
+ */
+static const char *ranked_ssid(const cred_candidate_t *candidate) {
+	static cred_entry_t entry;
+
+	cred_store_get(candidate->entry, &entry);
+	return entry.ssid;
+}
+
+/*
+ * @brief Start from an empty table, as on a device that has never been provisioned
+ */
+static void setup() {
+	fake_nvs_reset();
+	cred_store_load();
+}
+
+static void test_empty_table_ranks_nothing() {
+	cred_candidate_t ranked[CRED_STORE_CAPACITY];
+	ap_details_t visible[] = { seen("floor", -50, 6) };
+	setup();
+
+	CHECK_EQ(cred_store_count(), 0);
+	CHECK_EQ(cred_store_rank(visible, 1, ranked, CRED_STORE_CAPACITY), 0);
+	CHECK_EQ(cred_store_rank(NULL, 0, ranked, CRED_STORE_CAPACITY), 0);
+}
+
+static void test_only_visible_networks_ranked() {
+	cred_candidate_t ranked[CRED_STORE_CAPACITY];
+	ap_details_t visible[] = { seen("cafe", -40, 1), seen("staging", -70, 11), seen("neighbour", -30, 6) };
+	setup();
+
+	cred_store_add("floor", "password1", CRED_PRIORITY_DEFAULT);
+	cred_store_add("staging", "password2", CRED_PRIORITY_DEFAULT);
+
+	CHECK_EQ(cred_store_rank(visible, 3, ranked, CRED_STORE_CAPACITY), 1);
+	CHECK(strcmp(ranked_ssid(&ranked[0]), "staging") == 0);
+	CHECK_EQ(ranked[0].rssi, -70);
+	CHECK_EQ(ranked[0].channel, 11);
+	CHECK_EQ(ranked[0].bssid[5], 11);
+
+	// Without a scan every known network is a candidate
+	CHECK_EQ(cred_store_rank(NULL, 0, ranked, CRED_STORE_CAPACITY), 2);
+	CHECK_EQ(ranked[0].channel, 0);
+}
+
+static void test_priority_beats_signal() {
+	cred_candidate_t ranked[CRED_STORE_CAPACITY];
+	ap_details_t visible[] = { seen("staging", -35, 1), seen("floor", -80, 6) };
+	setup();
+
+	cred_store_add("staging", "password2", CRED_PRIORITY_DEFAULT);
+	cred_store_add("floor", "password1", CRED_PRIORITY_DEFAULT + 10);
+
+	CHECK_EQ(cred_store_rank(visible, 2, ranked, CRED_STORE_CAPACITY), 2);
+	CHECK(strcmp(ranked_ssid(&ranked[0]), "floor") == 0);
+	CHECK(strcmp(ranked_ssid(&ranked[1]), "staging") == 0);
+}
+
+static void test_failures_then_success_then_signal() {
+	cred_candidate_t ranked[CRED_STORE_CAPACITY];
+	ap_details_t visible[] = { seen("a", -40, 1), seen("b", -60, 6), seen("c", -80, 11) };
+	setup();
+
+	cred_store_add("a", "password", CRED_PRIORITY_DEFAULT);
+	cred_store_add("b", "password", CRED_PRIORITY_DEFAULT);
+	cred_store_add("c", "password", CRED_PRIORITY_DEFAULT);
+
+	// Nothing known about any of them - strongest first
+	cred_store_rank(visible, 3, ranked, CRED_STORE_CAPACITY);
+	CHECK(strcmp(ranked_ssid(&ranked[0]), "a") == 0);
+	CHECK(strcmp(ranked_ssid(&ranked[2]), "c") == 0);
+
+	// Most recent success beats signal
+	cred_store_record_result("c", ESP_OK, NULL);
+	cred_store_rank(visible, 3, ranked, CRED_STORE_CAPACITY);
+	CHECK(strcmp(ranked_ssid(&ranked[0]), "c") == 0);
+	CHECK(strcmp(ranked_ssid(&ranked[1]), "a") == 0);
+
+	// A failure since then beats both
+	cred_store_record_result("c", ESP_ERR_TIMEOUT, NULL);
+	cred_store_rank(visible, 3, ranked, CRED_STORE_CAPACITY);
+	CHECK(strcmp(ranked_ssid(&ranked[0]), "a") == 0);
+	CHECK(strcmp(ranked_ssid(&ranked[2]), "c") == 0);
+}
+
+static void test_rank_truncated_to_max() {
+	cred_candidate_t ranked[CRED_STORE_CAPACITY];
+	ap_details_t visible[] = { seen("a", -40, 1), seen("b", -60, 6), seen("c", -80, 11) };
+	setup();
+
+	cred_store_add("a", "password", CRED_PRIORITY_DEFAULT);
+	cred_store_add("b", "password", CRED_PRIORITY_DEFAULT);
+	cred_store_add("c", "password", CRED_PRIORITY_DEFAULT + 1);
+
+	CHECK_EQ(cred_store_rank(visible, 3, ranked, 1), 1);
+	CHECK(strcmp(ranked_ssid(&ranked[0]), "c") == 0);
+}
+
+static void test_full_table_forgets_last_ranked() {
+	char ssid[SSID_SIZE];
+	cred_entry_t entry;
+	setup();
+
+	for (int i = 0; i < CRED_STORE_CAPACITY; i++) {
+		snprintf(ssid, sizeof(ssid), "net%d", i);
+		cred_store_add(ssid, "password", CRED_PRIORITY_DEFAULT + i);
+	}
+	CHECK_EQ(cred_store_add("new", "password", CRED_PRIORITY_DEFAULT), ESP_OK);
+	CHECK_EQ(cred_store_count(), CRED_STORE_CAPACITY);
+
+	// net0 had the lowest priority
+	for (int i = 0; i < cred_store_count(); i++) {
+		cred_store_get(i, &entry);
+		CHECK(strcmp(entry.ssid, "net0") != 0);
+	}
+}
+
+static void test_rejected_password_forgets_network() {
+	setup();
+
+	cred_store_add("floor", "wrong", CRED_PRIORITY_DEFAULT);
+	cred_store_record_result("floor", ESP_ERR_TIMEOUT, NULL);
+	CHECK_EQ(cred_store_count(), 1);
+	cred_store_record_result("floor", ESP_ERR_WIFI_PASSWORD, NULL);
+	CHECK_EQ(cred_store_count(), 0);
+}
+
+static void test_table_survives_reload() {
+	cred_entry_t entry;
+	ap_hint_t hint = { .bssid = { 1, 2, 3, 4, 5, 6 }, .channel = 6 };
+	setup();
+
+	cred_store_add("floor", "password1", CRED_PRIORITY_DEFAULT);
+	cred_store_record_result("floor", ESP_OK, &hint);
+
+	// Reading the table back from NVS, as on the next boot
+	cred_store_load();
+	CHECK_EQ(cred_store_count(), 1);
+	CHECK_EQ(cred_store_get(0, &entry), ESP_OK);
+	CHECK(strcmp(entry.pword, "password1") == 0);
+	CHECK_EQ(entry.has_hint, 1);
+	CHECK_EQ(entry.hint.channel, 6);
+}
+
+static void test_failures_not_written() {
+	cred_entry_t entry;
+	setup();
+
+	cred_store_add("floor", "password", CRED_PRIORITY_DEFAULT);
+	fake_nvs_writes = 0;
+
+	// An AP that stays down, retried well past the count saturating
+	for (int i = 0; i < 300; i++) {
+		CHECK_EQ(cred_store_record_result("floor", ESP_ERR_TIMEOUT, NULL), ESP_OK);
+	}
+	CHECK_EQ(fake_nvs_writes, 0);
+	cred_store_get(0, &entry);
+	CHECK_EQ(entry.fail_count, UINT8_MAX);
+
+	// Coming back is written, and clears the count
+	cred_store_record_result("floor", ESP_OK, NULL);
+	CHECK_EQ(fake_nvs_writes, 1);
+	cred_store_load();
+	cred_store_get(0, &entry);
+	CHECK_EQ(entry.fail_count, 0);
+}
+
+static void test_unchanged_success_not_written() {
+	ap_hint_t hint = { .bssid = { 1, 2, 3, 4, 5, 6 }, .channel = 6 };
+	setup();
+
+	cred_store_add("floor", "password", CRED_PRIORITY_DEFAULT);
+	cred_store_add("cafe", "password", CRED_PRIORITY_DEFAULT);
+	cred_store_record_result("floor", ESP_OK, &hint);
+	fake_nvs_writes = 0;
+
+	// Same network, same AP
+	cred_store_record_result("floor", ESP_OK, &hint);
+	cred_store_record_result("floor", ESP_OK, NULL);
+	CHECK_EQ(fake_nvs_writes, 0);
+
+	// Roamed to another AP
+	hint.channel = 11;
+	cred_store_record_result("floor", ESP_OK, &hint);
+	CHECK_EQ(fake_nvs_writes, 1);
+
+	// Another network became the most recent
+	cred_store_record_result("cafe", ESP_OK, NULL);
+	CHECK_EQ(fake_nvs_writes, 2);
+
+	// A failure since the last success has to be cleared
+	cred_store_record_result("cafe", ESP_ERR_TIMEOUT, NULL);
+	cred_store_record_result("cafe", ESP_OK, NULL);
+	CHECK_EQ(fake_nvs_writes, 3);
+}
+
+static void test_legacy_pair_migrated() {
+	cred_entry_t entry;
+	fake_nvs_reset();
+
+	write_string(SSID_HANDLE, "floor");
+	write_string(PWORD_HANDLE, "password1");
+
+	cred_store_load();
+	CHECK_EQ(cred_store_count(), 1);
+	cred_store_get(0, &entry);
+	CHECK(strcmp(entry.ssid, "floor") == 0);
+	CHECK(strcmp(entry.pword, "password1") == 0);
+
+	char value[SSID_SIZE];
+	size_t size = sizeof(value);
+	CHECK_EQ(read_string(SSID_HANDLE, value, &size), ESP_ERR_NOT_FOUND);
+}
+
+/*
+ * @brief Fail every known network once per retry round for a day, then reconnect,
+ * and report the NVS writes made against one per failure
+ */
+static void bench_retry_rounds() {
+	char ssid[SSID_SIZE];
+	static uint8_t blob[4096];
+	size_t size = sizeof(blob);
+	setup();
+
+	for (int i = 0; i < CRED_STORE_CAPACITY; i++) {
+		snprintf(ssid, sizeof(ssid), "net%d", i);
+		cred_store_add(ssid, "password", CRED_PRIORITY_DEFAULT);
+	}
+	read_blob("cred_table", blob, &size);
+	fake_nvs_writes = 0;
+
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		for (int i = 0; i < CRED_STORE_CAPACITY; i++) {
+			snprintf(ssid, sizeof(ssid), "net%d", i);
+			cred_store_record_result(ssid, ESP_ERR_TIMEOUT, NULL);
+		}
+	}
+	int failure_writes = fake_nvs_writes;
+	cred_store_record_result("net0", ESP_OK, NULL);
+
+	printf("cred store, %d networks failing every 30 s for a day, then one reconnect\n", CRED_STORE_CAPACITY);
+	printf("%-24s %6d writes %9u bytes\n", "saved on every failure",
+			BENCH_ROUNDS * CRED_STORE_CAPACITY + 1, (unsigned)((BENCH_ROUNDS * CRED_STORE_CAPACITY + 1) * size));
+	printf("%-24s %6d writes %9u bytes (%d during the failures)\n", "failures in RAM",
+			fake_nvs_writes, (unsigned)(fake_nvs_writes * size), failure_writes);
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		bench_retry_rounds();
+		return 0;
+	}
+
+	RUN_TEST(test_empty_table_ranks_nothing);
+	RUN_TEST(test_only_visible_networks_ranked);
+	RUN_TEST(test_priority_beats_signal);
+	RUN_TEST(test_failures_then_success_then_signal);
+	RUN_TEST(test_rank_truncated_to_max);
+	RUN_TEST(test_full_table_forgets_last_ranked);
+	RUN_TEST(test_rejected_password_forgets_network);
+	RUN_TEST(test_table_survives_reload);
+	RUN_TEST(test_failures_not_written);
+	RUN_TEST(test_unchanged_success_not_written);
+	RUN_TEST(test_legacy_pair_migrated);
+
+	return HOST_TEST_RESULT();
+}
@@ -0,0 +1,205 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * DNS Parser Host Tests
+ * Queries accepted and rejected by dns_parse_query(),
+ * and a benchmark of its throughput on the corpus of
+ * probe queries.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "host_test.h"
+#include "dns_corpus.h"
+#include "dns.h"
+
+/* Rounds of the corpus parsed by the benchmark */
+#define BENCH_ROUNDS 200000
+
+/*
+ * @brief Encode a query for a name made of labels of the given lengths
+ * @return Length of query
+ */
+static size_t encode_labels(uint8_t *out, const int *labels, int count) {
+	uint8_t *p = out;
+
+	memset(p, 0, DNS_HEADER_LEN);
+	p[5] = 1;
+	p += DNS_HEADER_LEN;
+	for (int i = 0; i < count; i++) {
+		*p++ = labels[i];
+		memset(p, 'a', labels[i]);
+		p += labels[i];
+	}
+	*p++ = 0;
+	*p++ = 0;
+	*p++ = QTYPE_A;
+	*p++ = 0;
+	*p++ = QCLASS_IN;
+
+	return p - out;
+}
+
+static void test_corpus_parses() {
+	static dns_corpus_query_t corpus[DNS_CORPUS_MAX];
+	dns_query_view_t view;
+	int count = dns_corpus_build(corpus);
+
+	for (int i = 0; i < count; i++) {
+		CHECK_EQ(dns_parse_query(corpus[i].data, corpus[i].length, &view), ESP_OK);
+		CHECK_EQ(view.qdcount, 1);
+		CHECK_EQ(view.questions[0].type, corpus[i].qtype);
+		CHECK_EQ(view.questions[0].class, QCLASS_IN);
+		CHECK_EQ(view.arcount, corpus[i].edns ? 1 : 0);
+		CHECK(view.question_end <= corpus[i].length);
+	}
+}
+
+static void test_view_points_into_packet() {
+	uint8_t query[DNS_LEN];
+	dns_query_view_t view;
+
+	size_t length = dns_encode_query(query, 0xABCD, "captive.apple.com", QTYPE_HTTPS, false);
+
+	CHECK_EQ(dns_parse_query(query, length, &view), ESP_OK);
+	CHECK_EQ(view.id, 0xABCD);
+	CHECK_EQ(view.flags, FLAG_RD);
+	CHECK_EQ(view.questions[0].name, DNS_HEADER_LEN);
+	CHECK_EQ(view.questions[0].name_len, strlen("captive.apple.com") + 2);
+	CHECK_EQ(view.question_end, length);
+}
+
+static void test_several_questions() {
+	uint8_t query[DNS_LEN];
+	uint8_t second[DNS_LEN];
+	dns_query_view_t view;
+
+	size_t length = dns_encode_query(query, 1, "a.example", QTYPE_A, false);
+	size_t second_length = dns_encode_query(second, 1, "bb.example", QTYPE_AAAA, false);
+	memcpy(&query[length], &second[DNS_HEADER_LEN], second_length - DNS_HEADER_LEN);
+	uint16_t second_name = length;
+	length += second_length - DNS_HEADER_LEN;
+	query[5] = 2;
+
+	CHECK_EQ(dns_parse_query(query, length, &view), ESP_OK);
+	CHECK_EQ(view.qdcount, 2);
+	CHECK_EQ(view.questions[1].name, second_name);
+	CHECK_EQ(view.questions[1].type, QTYPE_AAAA);
+	CHECK_EQ(view.question_end, length);
+
+	// Claims a third question that is not there
+	query[5] = 3;
+	CHECK_EQ(dns_parse_query(query, length, &view), ESP_ERR_INVALID_SIZE);
+
+	query[5] = DNS_MAX_QUESTIONS + 1;
+	CHECK_EQ(dns_parse_query(query, length, &view), ESP_ERR_NOT_SUPPORTED);
+}
+
+static void test_header_rejections() {
+	uint8_t query[DNS_LEN];
+	dns_query_view_t view;
+	size_t length = dns_encode_query(query, 1, "example.com", QTYPE_A, false);
+
+	CHECK_EQ(dns_parse_query(query, DNS_HEADER_LEN - 1, &view), ESP_ERR_INVALID_SIZE);
+
+	// A reply
+	query[2] |= FLAG_QR;
+	CHECK_EQ(dns_parse_query(query, length, &view), ESP_ERR_INVALID_ARG);
+	query[2] &= ~FLAG_QR;
+
+	// Not a standard query
+	query[2] |= 2 << 3;
+	CHECK_EQ(dns_parse_query(query, length, &view), ESP_ERR_INVALID_ARG);
+	query[2] &= ~FLAG_OPCODE;
+
+	query[2] |= FLAG_TC;
+	CHECK_EQ(dns_parse_query(query, length, &view), ESP_ERR_NOT_SUPPORTED);
+	query[2] &= ~FLAG_TC;
+
+	// Answers in a query
+	query[7] = 1;
+	CHECK_EQ(dns_parse_query(query, length, &view), ESP_ERR_INVALID_ARG);
+	query[7] = 0;
+
+	query[5] = 0;
+	CHECK_EQ(dns_parse_query(query, length, &view), ESP_ERR_INVALID_ARG);
+}
+
+static void test_truncated_anywhere() {
+	uint8_t query[DNS_LEN];
+	dns_query_view_t view;
+	size_t length = dns_encode_query(query, 1, "connectivitycheck.gstatic.com", QTYPE_A, false);
+
+	for (size_t cut = DNS_HEADER_LEN; cut < length; cut++) {
+		CHECK_EQ(dns_parse_query(query, cut, &view), ESP_ERR_INVALID_SIZE);
+	}
+}
+
+static void test_name_limits() {
+	uint8_t query[DNS_LEN];
+	dns_query_view_t view;
+
+	memset(query, 0, sizeof(query));
+
+	// Longest label
+	int longest_label[] = { DNS_MAX_LABEL_LEN };
+	CHECK_EQ(dns_parse_query(query, encode_labels(query, longest_label, 1), &view), ESP_OK);
+
+	// Label lengths of 64 and up are compression pointers or reserved types
+	query[DNS_HEADER_LEN] = DNS_MAX_LABEL_LEN + 1;
+	CHECK_EQ(dns_parse_query(query, DNS_LEN, &view), ESP_ERR_INVALID_SIZE);
+	query[DNS_HEADER_LEN] = 0xC0;
+	CHECK_EQ(dns_parse_query(query, DNS_LEN, &view), ESP_ERR_INVALID_SIZE);
+
+	// 255 bytes in all, counting the length bytes and the root label, is the most allowed
+	int longest_name[] = { 63, 63, 63, 61 };
+	size_t length = encode_labels(query, longest_name, 4);
+	CHECK_EQ(dns_parse_query(query, length, &view), ESP_OK);
+	CHECK_EQ(view.questions[0].name_len, DNS_MAX_NAME_LEN);
+
+	int too_long[] = { 63, 63, 63, 62 };
+	length = encode_labels(query, too_long, 4);
+	CHECK_EQ(dns_parse_query(query, length, &view), ESP_ERR_INVALID_SIZE);
+}
+
+static void bench_parse() {
+	static dns_corpus_query_t corpus[DNS_CORPUS_MAX];
+	dns_query_view_t view;
+	int count = dns_corpus_build(corpus);
+	size_t bytes = 0;
+	int parsed = 0;
+
+	uint64_t start_ns = host_time_ns();
+	uint64_t start_cycles = host_cycles();
+	for (int round = 0; round < BENCH_ROUNDS; round++) {
+		for (int i = 0; i < count; i++) {
+			parsed += (dns_parse_query(corpus[i].data, corpus[i].length, &view) == ESP_OK);
+			bytes += corpus[i].length;
+		}
+	}
+	uint64_t cycles = host_cycles() - start_cycles;
+	uint64_t elapsed_ns = host_time_ns() - start_ns;
+
+	printf("dns_parse_query, %d rounds of %d queries (host timings)\n", BENCH_ROUNDS, count);
+	printf("%9.0f queries/s %7.1f MB/s %7.1f ns/query %7.1f cycles/query\n",
+			parsed * 1e9 / elapsed_ns, bytes * 1e3 / elapsed_ns,
+			(double)elapsed_ns / parsed, (double)cycles / parsed);
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		bench_parse();
+		return 0;
+	}
+
+	RUN_TEST(test_corpus_parses);
+	RUN_TEST(test_view_points_into_packet);
+	RUN_TEST(test_several_questions);
+	RUN_TEST(test_header_rejections);
+	RUN_TEST(test_truncated_anywhere);
+	RUN_TEST(test_name_limits);
+
+	return HOST_TEST_RESULT();
+}
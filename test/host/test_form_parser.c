@@ -0,0 +1,221 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Form Parser Host Tests
+ * A table of edge-case bodies, each fed to the parser
+ * in pieces of every size, and a benchmark of its
+ * throughput on typical credential forms.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdlib.h>
+
+#include "host_test.h"
+#include "cred_store.h"
+#include "form_parser.h"
+
+/* Bodies parsed by the benchmark */
+#define BENCH_BODIES 500000
+
+/* Piece size the server receives bodies in */
+#define BENCH_CHUNK_SIZE 64
+
+/* A body, and what parsing it should give */
+typedef struct {
+	const char *name;
+	form_type_t type;
+	const char *body;
+	esp_err_t result;        // First error from feeding, or the result of finishing
+	const char *ssid;        // Expected SSID, or NULL if the field should be absent
+	const char *password;    // Expected password, or NULL if the field should be absent
+} form_case_t;
+
+#define SSID_32 "ssssssssssssssssssssssssssssssss"
+#define PWORD_63 "ppppppppppppppppppppppppppppppppppppppppppppppppppppppppppppppp"
+#define KEY_40 "kkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkk"
+
+static const form_case_t cases[] = {
+		{ "plain", FORM_URLENCODED, "ssid=home&password=secret", ESP_OK, "home", "secret" },
+		{ "plus is a space", FORM_URLENCODED, "password=two+words+", ESP_OK, NULL, "two words " },
+		{ "percent escapes", FORM_URLENCODED, "password=a%26b%3Dc%25d%2b", ESP_OK, NULL, "a&b=c%d+" },
+		{ "lower case hex", FORM_URLENCODED, "password=%2f%7e", ESP_OK, NULL, "/~" },
+		{ "escaped name", FORM_URLENCODED, "pass%77ord=x", ESP_OK, NULL, "x" },
+		{ "truncated percent", FORM_URLENCODED, "password=abc%", ESP_ERR_INVALID_ARG, NULL, NULL },
+		{ "half a percent", FORM_URLENCODED, "password=abc%4", ESP_ERR_INVALID_ARG, NULL, NULL },
+		{ "bad hex", FORM_URLENCODED, "password=%zz", ESP_ERR_INVALID_ARG, NULL, NULL },
+		{ "longest SSID", FORM_URLENCODED, "ssid=" SSID_32, ESP_OK, SSID_32, NULL },
+		{ "overlong SSID", FORM_URLENCODED, "ssid=" SSID_32 "s", ESP_ERR_INVALID_SIZE, NULL, NULL },
+		{ "longest password", FORM_URLENCODED, "password=" PWORD_63, ESP_OK, NULL, PWORD_63 },
+		{ "overlong password", FORM_URLENCODED, "password=" PWORD_63 "p", ESP_ERR_INVALID_SIZE, NULL, NULL },
+		{ "overlong escaped", FORM_URLENCODED, "ssid=" SSID_32 "%41", ESP_ERR_INVALID_SIZE, NULL, NULL },
+		{ "overlong unknown name", FORM_URLENCODED, KEY_40 "=1&ssid=x", ESP_OK, "x", NULL },
+		{ "unknown fields skipped", FORM_URLENCODED, "a=1&password=x&b", ESP_OK, NULL, "x" },
+		{ "repeated field", FORM_URLENCODED, "ssid=a&ssid=b", ESP_OK, "b", NULL },
+		{ "name without value", FORM_URLENCODED, "ssid&password=", ESP_OK, "", "" },
+		{ "equals in value", FORM_URLENCODED, "password=a=b", ESP_OK, NULL, "a=b" },
+		{ "empty body", FORM_URLENCODED, "", ESP_OK, NULL, NULL },
+		{ "empty pairs", FORM_URLENCODED, "&&ssid=x&&", ESP_OK, "x", NULL },
+		{ "json", FORM_JSON, " {\"ssid\" : \"home\", \"password\":\"p w\"} ", ESP_OK, "home", "p w" },
+		{ "json escapes", FORM_JSON, "{\"password\":\"a\\\"b\\\\c\\/\\u00e9\\u20ac\\n\"}", ESP_OK, NULL,
+				"a\"b\\c/\xC3\xA9\xE2\x82\xAC\n" },
+		{ "json escaped name", FORM_JSON, "{\"\\u0073sid\":\"x\"}", ESP_OK, "x", NULL },
+		{ "json truncated escape", FORM_JSON, "{\"password\":\"\\u00\"}", ESP_ERR_INVALID_ARG, NULL, NULL },
+		{ "json unknown escape", FORM_JSON, "{\"password\":\"\\q\"}", ESP_ERR_INVALID_ARG, NULL, NULL },
+		{ "json surrogate pair", FORM_JSON, "{\"password\":\"\\ud83d\\ude00\"}", ESP_ERR_NOT_SUPPORTED, NULL, NULL },
+		{ "json nested", FORM_JSON, "{\"ssid\":{\"a\":1}}", ESP_ERR_NOT_SUPPORTED, NULL, NULL },
+		{ "json number", FORM_JSON, "{\"ssid\":123,\"password\":true}", ESP_OK, "123", "true" },
+		{ "json raw control", FORM_JSON, "{\"ssid\":\"a\tb\"}", ESP_ERR_INVALID_ARG, NULL, NULL },
+		{ "json unterminated", FORM_JSON, "{\"ssid\":\"x\"", ESP_ERR_INVALID_ARG, NULL, NULL },
+		{ "json trailing garbage", FORM_JSON, "{\"ssid\":\"x\"} x", ESP_ERR_INVALID_ARG, NULL, NULL },
+		{ "json overlong", FORM_JSON, "{\"ssid\":\"" SSID_32 "s\"}", ESP_ERR_INVALID_SIZE, NULL, NULL },
+		{ "json not an object", FORM_JSON, "[\"ssid\"]", ESP_ERR_INVALID_ARG, NULL, NULL },
+};
+#define CASE_COUNT (sizeof(cases)/sizeof(cases[0]))
+
+/*
+ * @brief Parse a body fed in pieces of a given size
+ * @return First error from feeding, or the result of finishing
+ */
+static esp_err_t parse_in_pieces(form_type_t type, const char *body, size_t piece, form_field_t *fields, size_t count) {
+	form_parser_t parser;
+	size_t length = strlen(body);
+	esp_err_t err;
+
+	form_parser_init(&parser, type, fields, count);
+	for (size_t pos = 0; pos < length; pos += piece) {
+		size_t n = (length - pos < piece) ? length - pos : piece;
+
+		// Copy, so that ASan catches any read past the piece
+		char *copy = malloc(n);
+		memcpy(copy, &body[pos], n);
+		err = form_parser_feed(&parser, copy, n);
+		free(copy);
+
+		if (err != ESP_OK) {
+			return err;
+		}
+	}
+
+	return form_parser_finish(&parser);
+}
+
+/*
+ * @brief Check a field against the value expected of it
+ */
+static void check_field(const char *name, size_t piece, const form_field_t *field, const char *expected) {
+	if (expected == NULL) {
+		CHECK(!field->present);
+		CHECK_EQ(field->length, 0);
+	} else if (!field->present || field->length != strlen(expected) || strcmp(field->value, expected) != 0) {
+		fprintf(stderr, "%s, pieces of %u: %s is \"%s\"\n", name, (unsigned)piece, field->name, field->value);
+		CHECK(false);
+	}
+	CHECK_EQ(field->value[field->length], '\0');
+}
+
+/*
+ * @brief Every case gives the same result however its body is split, including through
+ * the middle of an escape
+ */
+static void test_edge_cases_in_every_piece_size() {
+	char ssid[SSID_SIZE];
+	char password[PWORD_SIZE];
+	form_field_t fields[] = {
+			{ .name = "ssid", .value = ssid, .size = sizeof(ssid) },
+			{ .name = "password", .value = password, .size = sizeof(password) },
+	};
+
+	for (int i = 0; i < CASE_COUNT; i++) {
+		const form_case_t *c = &cases[i];
+		size_t length = strlen(c->body);
+
+		for (size_t piece = 1; piece <= length || piece == 1; piece++) {
+			esp_err_t err = parse_in_pieces(c->type, c->body, piece, fields, 2);
+
+			if (err != c->result) {
+				fprintf(stderr, "%s, pieces of %u: got 0x%x\n", c->name, (unsigned)piece, err);
+				CHECK_EQ(err, c->result);
+				continue;
+			}
+			if (err == ESP_OK) {
+				check_field(c->name, piece, &fields[0], c->ssid);
+				check_field(c->name, piece, &fields[1], c->password);
+			}
+		}
+	}
+}
+
+/*
+ * @brief A field smaller than the value stops the parse without writing past the field
+ */
+static void test_value_never_overruns_field() {
+	char small[4];
+	char guard[4] = { 'g', 'g', 'g', 'g' };
+	form_parser_t parser;
+	form_field_t fields[] = {
+			{ .name = "ssid", .value = small, .size = sizeof(small) },
+	};
+
+	form_parser_init(&parser, FORM_URLENCODED, fields, 1);
+	CHECK_EQ(form_parser_feed(&parser, "ssid=abc", 8), ESP_OK);
+	CHECK_EQ(form_parser_feed(&parser, "d", 1), ESP_ERR_INVALID_SIZE);
+	CHECK(strcmp(small, "abc") == 0);
+	CHECK(memcmp(guard, "gggg", 4) == 0);
+}
+
+/*
+ * @brief Parse a body over and over in server-sized pieces, and report the throughput
+ */
+static void bench_body(const char *label, form_type_t type, const char *body) {
+	char ssid[SSID_SIZE];
+	char password[PWORD_SIZE];
+	form_field_t fields[] = {
+			{ .name = "ssid", .value = ssid, .size = sizeof(ssid) },
+			{ .name = "password", .value = password, .size = sizeof(password) },
+	};
+	form_parser_t parser;
+	size_t length = strlen(body);
+	int parsed = 0;
+
+	uint64_t start_ns = host_time_ns();
+	uint64_t start_cycles = host_cycles();
+	for (int i = 0; i < BENCH_BODIES; i++) {
+		esp_err_t err = ESP_OK;
+
+		form_parser_init(&parser, type, fields, 2);
+		for (size_t pos = 0; pos < length && err == ESP_OK; pos += BENCH_CHUNK_SIZE) {
+			err = form_parser_feed(&parser, &body[pos], (length - pos < BENCH_CHUNK_SIZE) ? length - pos : BENCH_CHUNK_SIZE);
+		}
+		parsed += (err == ESP_OK && form_parser_finish(&parser) == ESP_OK);
+	}
+	uint64_t cycles = host_cycles() - start_cycles;
+	uint64_t elapsed_ns = host_time_ns() - start_ns;
+
+	printf("%-24s %3u bytes %9.0f bodies/s %7.1f MB/s %7.1f ns/body %6.1f cycles/byte\n", label,
+			(unsigned)length, parsed * 1e9 / elapsed_ns, (double)parsed * length * 1e3 / elapsed_ns,
+			(double)elapsed_ns / parsed, (double)cycles / parsed / length);
+}
+
+static void bench_parse() {
+	printf("form parser, %d bodies each in %d byte pieces (host timings)\n", BENCH_BODIES, BENCH_CHUNK_SIZE);
+	bench_body("urlencoded", FORM_URLENCODED, "ssid=Home+Network&password=correct+horse+battery+staple");
+	bench_body("urlencoded, escaped", FORM_URLENCODED,
+			"ssid=Caf%C3%A9+%26+Bar&password=%21%40%23%24%25%5E%26%2A%28%29%2B%3D%7B%7D%5B%5D");
+	bench_body("urlencoded, longest", FORM_URLENCODED, "ssid=" SSID_32 "&password=" PWORD_63);
+	bench_body("json", FORM_JSON, "{\"ssid\":\"Home Network\",\"password\":\"correct horse battery staple\"}");
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		bench_parse();
+		return 0;
+	}
+
+	RUN_TEST(test_edge_cases_in_every_piece_size);
+	RUN_TEST(test_value_never_overruns_field);
+
+	return HOST_TEST_RESULT();
+}
@@ -0,0 +1,191 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Scan Store Host Tests
+ * Full scans and single-channel merges fed from a
+ * fake WiFi driver.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "host_test.h"
+#include "fakes.h"
+#include "scan_store.h"
+
+/*
+ * @brief SSID of a stored network
+ */
+static const char *ssid_at(int index) {
+	static ap_details_t ap;
+
+	scan_store_get(index, &ap);
+	return ap.ssid;
+}
+
+/*
+ * @brief Start from a store holding one full scan
+ */
+static void setup(const wifi_ap_record_t *records, int count) {
+	scan_store_release();
+	scan_store_init();
+	fake_wifi_set_scan(records, count);
+	scan_store_update();
+}
+
+static void test_full_scan_deduplicated_and_sorted() {
+	ap_details_t ap;
+	wifi_ap_record_t records[] = {
+			fake_ap_record("office", 1, -70, 1, WIFI_AUTH_WPA2_PSK),
+			fake_ap_record("cafe", 2, -50, 6, WIFI_AUTH_OPEN),
+			fake_ap_record("office", 3, -40, 11, WIFI_AUTH_WPA2_PSK),
+			fake_ap_record("", 4, -20, 6, WIFI_AUTH_WPA2_PSK),
+	};
+	setup(records, 4);
+
+	// Hidden networks are skipped, and each SSID is kept once at its strongest BSSID
+	CHECK_EQ(scan_store_count(), 2);
+	CHECK_EQ(scan_store_get(0, &ap), ESP_OK);
+	CHECK(strcmp(ap.ssid, "office") == 0);
+	CHECK_EQ(ap.rssi, -40);
+	CHECK_EQ(ap.channel, 11);
+	CHECK_EQ(ap.bssid[5], 3);
+	CHECK(strcmp(ssid_at(1), "cafe") == 0);
+
+	CHECK_EQ(scan_store_get(2, &ap), ESP_ERR_INVALID_ARG);
+	CHECK_EQ(ap.ssid[0], '\0');
+}
+
+static void test_merge_keeps_order_when_only_signal_changes() {
+	wifi_ap_record_t records[] = {
+			fake_ap_record("strong", 1, -40, 6, WIFI_AUTH_WPA2_PSK),
+			fake_ap_record("weak", 2, -80, 6, WIFI_AUTH_WPA2_PSK),
+	};
+	setup(records, 2);
+	uint32_t generation = scan_store_generation();
+
+	// The weak network is now the stronger, but indices shown on the page must hold
+	records[1].rssi = -30;
+	fake_wifi_set_scan(records, 2);
+	CHECK_EQ(scan_store_merge_channel(6), ESP_OK);
+
+	CHECK_EQ(scan_store_generation(), generation);
+	CHECK(strcmp(ssid_at(0), "strong") == 0);
+	CHECK(strcmp(ssid_at(1), "weak") == 0);
+}
+
+static void test_merge_adds_new_network() {
+	wifi_ap_record_t records[] = {
+			fake_ap_record("strong", 1, -40, 6, WIFI_AUTH_WPA2_PSK),
+	};
+	wifi_ap_record_t channel_1[] = {
+			fake_ap_record("new", 2, -20, 1, WIFI_AUTH_WPA2_PSK),
+	};
+	setup(records, 1);
+	uint32_t generation = scan_store_generation();
+
+	fake_wifi_set_scan(channel_1, 1);
+	scan_store_merge_channel(1);
+
+	CHECK(scan_store_generation() != generation);
+	CHECK_EQ(scan_store_count(), 2);
+	CHECK(strcmp(ssid_at(0), "new") == 0);
+}
+
+static void test_merge_ages_out_missing_networks() {
+	wifi_ap_record_t records[] = {
+			fake_ap_record("stays", 1, -40, 6, WIFI_AUTH_WPA2_PSK),
+			fake_ap_record("leaves", 2, -50, 6, WIFI_AUTH_WPA2_PSK),
+			fake_ap_record("elsewhere", 3, -60, 11, WIFI_AUTH_WPA2_PSK),
+	};
+	setup(records, 3);
+	uint32_t generation = scan_store_generation();
+
+	// Missing from one scan of its channel - kept
+	fake_wifi_set_scan(records, 1);
+	scan_store_merge_channel(6);
+	CHECK_EQ(scan_store_count(), 3);
+	CHECK_EQ(scan_store_generation(), generation);
+
+	// Missing from a second - removed. The network on another channel is untouched.
+	scan_store_merge_channel(6);
+	CHECK_EQ(scan_store_count(), 2);
+	CHECK(scan_store_generation() != generation);
+	CHECK(strcmp(ssid_at(0), "stays") == 0);
+	CHECK(strcmp(ssid_at(1), "elsewhere") == 0);
+}
+
+static void test_merge_auth_change_is_a_change() {
+	wifi_ap_record_t records[] = {
+			fake_ap_record("office", 1, -40, 6, WIFI_AUTH_OPEN),
+	};
+	ap_details_t ap;
+	setup(records, 1);
+	uint32_t generation = scan_store_generation();
+
+	records[0].authmode = WIFI_AUTH_WPA2_PSK;
+	fake_wifi_set_scan(records, 1);
+	scan_store_merge_channel(6);
+
+	CHECK(scan_store_generation() != generation);
+	scan_store_get(0, &ap);
+	CHECK_EQ(ap.authmode, WIFI_AUTH_WPA2_PSK);
+}
+
+static void test_capacity_bounded() {
+	wifi_ap_record_t records[SCAN_STORE_CAPACITY + 8];
+	char ssid[16];
+
+	for (int i = 0; i < SCAN_STORE_CAPACITY + 8; i++) {
+		snprintf(ssid, sizeof(ssid), "net%d", i);
+		records[i] = fake_ap_record(ssid, i, -30 - i, 1 + i % 11, WIFI_AUTH_WPA2_PSK);
+	}
+	setup(records, SCAN_STORE_CAPACITY + 8);
+
+	CHECK_EQ(scan_store_count(), SCAN_STORE_CAPACITY);
+}
+
+static void test_released_store_reads_empty() {
+	ap_details_t ap;
+	wifi_ap_record_t records[] = {
+			fake_ap_record("office", 1, -40, 6, WIFI_AUTH_OPEN),
+	};
+	setup(records, 1);
+
+	scan_store_release();
+	CHECK_EQ(scan_store_count(), 0);
+	CHECK_EQ(scan_store_get(0, &ap), ESP_ERR_INVALID_ARG);
+	CHECK_EQ(scan_store_merge_channel(6), ESP_ERR_INVALID_STATE);
+}
+
+static void test_find_by_ssid() {
+	ap_details_t ap;
+	wifi_ap_record_t records[] = {
+			fake_ap_record("office", 1, -70, 1, WIFI_AUTH_WPA2_PSK),
+			fake_ap_record("cafe", 2, -50, 6, WIFI_AUTH_OPEN),
+	};
+	setup(records, 2);
+
+	CHECK_EQ(scan_store_find("office", &ap), ESP_OK);
+	CHECK_EQ(ap.channel, 1);
+	CHECK_EQ(scan_store_find("offic", &ap), ESP_ERR_NOT_FOUND);
+	CHECK_EQ(ap.ssid[0], '\0');
+
+	scan_store_release();
+	CHECK_EQ(scan_store_find("office", &ap), ESP_ERR_NOT_FOUND);
+}
+
+int main(int argc, char **argv) {
+	RUN_TEST(test_full_scan_deduplicated_and_sorted);
+	RUN_TEST(test_merge_keeps_order_when_only_signal_changes);
+	RUN_TEST(test_merge_adds_new_network);
+	RUN_TEST(test_merge_ages_out_missing_networks);
+	RUN_TEST(test_merge_auth_change_is_a_change);
+	RUN_TEST(test_capacity_bounded);
+	RUN_TEST(test_released_store_reads_empty);
+	RUN_TEST(test_find_by_ssid);
+
+	scan_store_release();
+	return HOST_TEST_RESULT();
+}
@@ -0,0 +1,664 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * Server Host Tests
+ * Portal endpoints driven through a fake httpd, a
+ * benchmark of the bytes and socket writes each way of
+ * sending the scan list costs per page load, and a
+ * model of page latency under each server profile as
+ * the number of clients grows.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "host_test.h"
+#include "fakes.h"
+#include "fake_httpd.h"
+#include "fake_portal.h"
+#include "legacy_scan_list.h"
+
+/* Handlers are static, so the server is built into the test */
+#include "server.c"
+
+/* Networks in a busy scan */
+#define BENCH_NETWORKS 30
+
+/* Page loads timed by the benchmark */
+#define BENCH_LOADS 20000
+
+/*
+ * Model of phones loading the portal, for the profile load benchmark. Each client sends a
+ * probe, the page and a favicon request over one keep-alive connection, then opens the
+ * WebSocket, which it holds. The worker cost of each request is a fixed part plus a part
+ * per socket write, with the writes counted from the real handlers. Costs are estimates of
+ * the ESP32, not host timings.
+ */
+#define LOAD_MAX_CLIENTS 8
+#define LOAD_PAGE_REQUESTS 3
+#define LOAD_TICK_US 50
+#define LOAD_DURATION_US 20000000
+#define LOAD_ARRIVAL_US 100000        // Clients arrive together, spread over this
+#define LOAD_CONNECT_US 3000          // TCP handshake over the SoftAP
+#define LOAD_REQUEST_US 1500          // Worker time to read a request and run its handler
+#define LOAD_WRITE_US 200             // Worker time per socket write
+#define LOAD_RETRY_US 1000000         // SYN retransmit after a connection is not accepted
+#define LOAD_GIVE_UP_US 10000000
+#define LOAD_RUNS 50                  // Runs pooled per row, each with its own arrival times
+
+/*
+ * @brief Fill the scan store with a number of networks
+ */
+static void scan_networks(int count) {
+	wifi_ap_record_t records[BENCH_NETWORKS];
+	char ssid[33];
+
+	for (int i = 0; i < count; i++) {
+		snprintf(ssid, sizeof(ssid), "Network-%02d-%s", i, (i % 3) ? "Home" : "Guest WiFi");
+		records[i] = fake_ap_record(ssid, i, -40 - i, 1 + i % 11, (i % 4) ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN);
+	}
+	fake_portal_scan(records, count);
+}
+
+/*
+ * @brief Count the occurrences of a string in another
+ */
+static int count_of(const char *haystack, const char *needle) {
+	int count = 0;
+
+	for (const char *p = strstr(haystack, needle); p != NULL; p = strstr(p + 1, needle)) {
+		count++;
+	}
+	return count;
+}
+
+/*
+ * @brief Sort helper for latencies
+ */
+static int compare_int64(const void *a, const void *b) {
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void setup() {
+	fake_httpd_reset();
+	fake_portal_reset();
+	scan_store_release();
+	start_webserver(SERVER_PROFILE_BALANCED);
+}
+
+static void teardown() {
+	stop_webserver(server_handle);
+}
+
+static void test_scan_list_sent_in_one_write() {
+	fake_request_t r;
+	setup();
+	scan_networks(BENCH_NETWORKS);
+
+	fake_request_init(&r, HTTP_GET, "/api/networks");
+	CHECK_EQ(networks_handler(&r.req), ESP_OK);
+
+	CHECK_EQ(fake_response_code(&r), 200);
+	CHECK(strcmp(r.type, "application/json") == 0);
+	CHECK(!r.chunked);
+	// Status line and essential headers, one write per extra header, the blank line, then the body
+	CHECK_EQ(r.writes, 1 + r.header_count + 1 + 1);
+	CHECK_EQ(r.response[0], '[');
+	CHECK_EQ(r.response[r.response_length - 1], ']');
+	CHECK_EQ(count_of(r.response, "\"id\":"), BENCH_NETWORKS);
+	CHECK(strstr(r.response, "{\"id\":0,\"ssid\":\"Network-00-Guest WiFi\",\"rssi\":-40,\"channel\":1,\"auth\":0}") != NULL);
+	teardown();
+}
+
+static void test_scan_list_not_modified() {
+	fake_request_t r;
+	char etag[FAKE_HTTPD_HEADER_SIZE];
+	setup();
+	scan_networks(4);
+
+	fake_request_init(&r, HTTP_GET, "/api/networks");
+	networks_handler(&r.req);
+	snprintf(etag, sizeof(etag), "%s", fake_response_header(&r, "ETag"));
+
+	fake_request_init(&r, HTTP_GET, "/api/networks");
+	fake_request_add_header(&r, "If-None-Match", etag);
+	CHECK_EQ(networks_handler(&r.req), ESP_OK);
+	CHECK_EQ(fake_response_code(&r), 304);
+	CHECK_EQ(r.response_length, 0);
+
+	// A new scan changes the list, so the old copy is stale
+	scan_networks(5);
+	fake_request_init(&r, HTTP_GET, "/api/networks");
+	fake_request_add_header(&r, "If-None-Match", etag);
+	CHECK_EQ(networks_handler(&r.req), ESP_OK);
+	CHECK_EQ(fake_response_code(&r), 200);
+	CHECK(strcmp(fake_response_header(&r, "ETag"), etag) != 0);
+	CHECK_EQ(count_of(r.response, "\"id\":"), 5);
+	teardown();
+}
+
+static void test_scan_list_escapes_ssid() {
+	fake_request_t r;
+	wifi_ap_record_t record = fake_ap_record("a\"b\\c\x01", 1, -50, 6, WIFI_AUTH_WPA2_PSK);
+	setup();
+	fake_portal_scan(&record, 1);
+
+	fake_request_init(&r, HTTP_GET, "/api/networks");
+	networks_handler(&r.req);
+	CHECK(strstr(r.response, "\"ssid\":\"a\\\"b\\\\c\\u0001\"") != NULL);
+	teardown();
+}
+
+/*
+ * @brief The network chosen is the one whose button was pressed, however the list has changed since
+ */
+static void test_select_posts_ssid() {
+	fake_request_t r;
+	wifi_ap_record_t records[] = {
+			fake_ap_record("home", 1, -40, 1, WIFI_AUTH_WPA2_PSK),
+			fake_ap_record("cafe & bar", 2, -60, 6, WIFI_AUTH_OPEN),
+	};
+	setup();
+	fake_portal_scan(records, 2);
+
+	fake_request_init(&r, HTTP_GET, "/");
+	fake_request_add_header(&r, "Accept", "text/html");
+	get_handler(&r.req);
+	CHECK(strstr(r.response, "value=\"cafe &amp; bar\">cafe &amp; bar</button>") != NULL);
+
+	// A rescan reorders the list before the form is submitted
+	records[1].rssi = -20;
+	fake_portal_scan(records, 2);
+	CHECK(strcmp(get_ap_details(0).ssid, "cafe & bar") == 0);
+
+	fake_request_init(&r, HTTP_POST, "/api/select");
+	fake_request_set_body(&r, "AccessPoint=home");
+	CHECK_EQ(select_handler(&r.req), ESP_OK);
+	CHECK(strcmp(chosen_ssid, "home") == 0);
+	CHECK(strcmp(fake_response_header(&r, "Location"), "/network-details") == 0);
+
+	fake_request_init(&r, HTTP_POST, "/api/select");
+	fake_request_set_body(&r, "AccessPoint=cafe+%26+bar");
+	CHECK_EQ(select_handler(&r.req), ESP_OK);
+	CHECK(strcmp(chosen_ssid, "cafe & bar") == 0);
+	CHECK(strcmp(fake_response_header(&r, "Location"), "/connection-check") == 0);
+
+	// A network that has gone sends the user back to the list as it is now
+	fake_portal_scan(records, 1);
+	fake_request_init(&r, HTTP_POST, "/api/select");
+	fake_request_set_body(&r, "AccessPoint=cafe+%26+bar");
+	CHECK_EQ(select_handler(&r.req), ESP_OK);
+	CHECK_EQ(fake_response_code(&r), 303);
+	CHECK(strcmp(fake_response_header(&r, "Location"), DEFAULT_PAGE "?gone") == 0);
+	CHECK(strcmp(chosen_ssid, "cafe & bar") == 0);
+	teardown();
+}
+
+/*
+ * @brief Gzipped assets are only sent compressed to clients that accept gzip, with an ETag per encoding
+ */
+static void test_gzip_asset_negotiated() {
+	fake_request_t r;
+	const portal_asset_t *asset = NULL;
+	char plain_etag[FAKE_HTTPD_HEADER_SIZE];
+	setup();
+
+	for (size_t i = 0; i < portal_asset_count && asset == NULL; i++) {
+		if (portal_assets[i].plain != NULL) {
+			asset = &portal_assets[i];
+		}
+	}
+	CHECK(asset != NULL);
+	if (asset == NULL) {
+		teardown();
+		return;
+	}
+
+	fake_request_init(&r, HTTP_GET, asset->path);
+	fake_request_add_header(&r, "Accept-Encoding", "gzip, deflate, br");
+	CHECK_EQ(get_handler(&r.req), ESP_OK);
+	CHECK(strcmp(fake_response_header(&r, "Content-Encoding"), "gzip") == 0);
+	CHECK(strcmp(fake_response_header(&r, "Vary"), "Accept-Encoding") == 0);
+	CHECK_EQ(r.response_length, asset->length);
+
+	// No Accept-Encoding, or gzip refused, gets the uncompressed copy
+	const char *refusals[] = { NULL, "identity", "gzip;q=0, deflate", "gzip ; q=0.0" };
+	for (int i = 0; i < sizeof(refusals)/sizeof(refusals[0]); i++) {
+		fake_request_init(&r, HTTP_GET, asset->path);
+		if (refusals[i] != NULL) {
+			fake_request_add_header(&r, "Accept-Encoding", refusals[i]);
+		}
+		CHECK_EQ(get_handler(&r.req), ESP_OK);
+		CHECK(fake_response_header(&r, "Content-Encoding") == NULL);
+		CHECK_EQ(r.response_length, asset->plain_length);
+		CHECK(memcmp(r.response, asset->plain, asset->plain_length) == 0);
+	}
+	snprintf(plain_etag, sizeof(plain_etag), "%s", fake_response_header(&r, "ETag"));
+	CHECK(strcmp(plain_etag, asset->etag) != 0);
+
+	// The uncompressed copy revalidates against its own ETag only
+	fake_request_init(&r, HTTP_GET, asset->path);
+	fake_request_add_header(&r, "If-None-Match", plain_etag);
+	get_handler(&r.req);
+	CHECK_EQ(fake_response_code(&r), 304);
+
+	fake_request_init(&r, HTTP_GET, asset->path);
+	fake_request_add_header(&r, "Accept-Encoding", "gzip;q=0.5");
+	fake_request_add_header(&r, "If-None-Match", plain_etag);
+	get_handler(&r.req);
+	CHECK_EQ(fake_response_code(&r), 200);
+	CHECK_EQ(r.response_length, asset->length);
+	teardown();
+}
+
+static void test_status_wait_capped() {
+	fake_request_t r;
+	setup();
+	fake_connection_test_state = CONNECTION_TEST_ASSOCIATING;
+
+	// No wait unless one is asked for
+	fake_request_init(&r, HTTP_GET, "/api/status?known=queued");
+	CHECK_EQ(status_handler(&r.req), ESP_OK);
+	CHECK_EQ(fake_connection_test_wait_ms, 0);
+	CHECK(strcmp(r.response, "{\"state\":\"associating\"}") == 0);
+
+	// A wait within the window is kept, so the page really long-polls
+	fake_request_init(&r, HTTP_GET, "/api/status?wait=1500&known=associating");
+	CHECK_EQ(status_handler(&r.req), ESP_OK);
+	CHECK_EQ(fake_connection_test_wait_ms, 1500);
+
+	// A longer one would hold the only worker past the timeouts of the requests behind it
+	fake_request_init(&r, HTTP_GET, "/api/status?wait=60000&known=associating");
+	CHECK_EQ(status_handler(&r.req), ESP_OK);
+	CHECK_EQ(fake_connection_test_wait_ms, STATUS_MAX_WAIT_MS);
+	for (int profile = SERVER_PROFILE_LOW_MEMORY; profile <= SERVER_PROFILE_HIGH_CONCURRENCY; profile++) {
+		CHECK(STATUS_MAX_WAIT_MS < server_profiles[profile].timeout_s * 1000);
+	}
+	teardown();
+}
+
+/*
+ * @brief The user is only told of a connection once the connection test has saved the network,
+ * not when the station first gets an IP address
+ */
+static void test_user_informed_after_network_saved() {
+	fake_request_t r;
+	setup();
+
+	fake_request_init(&r, HTTP_GET, "/ws");
+	fake_ws_set_open(r.fd, true);
+	CHECK_EQ(ws_handler(&r.req), ESP_OK);
+
+	// The station gets an address while the test is still saving the network
+	fake_portal_set_state(CONNECTION_TEST_ASSOCIATING);
+	fake_portal_notify(WIFI_NOTIFY_ASSOCIATED);
+	fake_portal_notify(WIFI_NOTIFY_GOT_IP);
+	CHECK(strcmp(fake_ws_frame, "{\"event\":\"state\",\"state\":\"associating\"}") == 0);
+	CHECK_EQ(fake_ws_frames_sent, 1);
+	CHECK_EQ(fake_app_events_posted, 0);
+
+	fake_portal_set_state(CONNECTION_TEST_GOT_IP);
+	CHECK(strcmp(fake_ws_frame, "{\"event\":\"state\",\"state\":\"got-ip\"}") == 0);
+	CHECK_EQ(fake_app_events_posted, 1);
+	CHECK_EQ(fake_app_event, APP_EVENT_USER_INFORMED);
+
+	// Posted once per portal session
+	fake_request_init(&r, HTTP_GET, "/api/status");
+	CHECK_EQ(status_handler(&r.req), ESP_OK);
+	CHECK_EQ(fake_app_events_posted, 1);
+	teardown();
+}
+
+/*
+ * @brief A state nobody heard about does not count as telling the user
+ */
+static void test_user_not_informed_without_clients() {
+	fake_request_t r;
+	setup();
+
+	fake_portal_set_state(CONNECTION_TEST_GOT_IP);
+	CHECK_EQ(fake_ws_frames_sent, 0);
+	CHECK_EQ(fake_app_events_posted, 0);
+
+	fake_request_init(&r, HTTP_GET, "/api/status?known=associating");
+	CHECK_EQ(status_handler(&r.req), ESP_OK);
+	CHECK_EQ(fake_app_events_posted, 1);
+	CHECK_EQ(fake_app_event, APP_EVENT_USER_INFORMED);
+	teardown();
+}
+
+/*
+ * @brief Send one response over and over, and report its cost
+ * @param label Name of the response
+ * @param send Handler that sends it
+ * @param uri URI requested
+ * @param if_none_match ETag the client holds, or NULL
+ */
+static void bench_response(const char *label, esp_err_t (*send)(httpd_req_t *), const char *uri,
+		const char *if_none_match) {
+	static fake_request_t r;
+
+	uint64_t start_ns = host_time_ns();
+	for (int i = 0; i < BENCH_LOADS; i++) {
+		fake_request_init(&r, HTTP_GET, uri);
+		fake_request_add_header(&r, "Accept", "text/html,application/xhtml+xml");
+		if (if_none_match != NULL) {
+			fake_request_add_header(&r, "If-None-Match", if_none_match);
+		}
+		send(&r.req);
+	}
+	uint64_t elapsed_ns = host_time_ns() - start_ns;
+
+	printf("%-32s %3d  %6u bytes  %4d writes  %6.0f ns\n", label, fake_response_code(&r),
+			(unsigned)r.wire_bytes, r.writes, (double)elapsed_ns / BENCH_LOADS);
+}
+
+/*
+ * @brief Scan list served fresh, as after every scan
+ */
+static esp_err_t send_uncached_list(httpd_req_t *req) {
+	scan_json_generation = get_scan_generation() - 1;
+	return networks_handler(req);
+}
+
+static void bench_scan_list() {
+	fake_request_t r;
+	char list_etag[FAKE_HTTPD_HEADER_SIZE];
+	char page_etag[FAKE_HTTPD_HEADER_SIZE];
+
+	setup();
+	scan_networks(BENCH_NETWORKS);
+
+	fake_request_init(&r, HTTP_GET, "/api/networks");
+	networks_handler(&r.req);
+	snprintf(list_etag, sizeof(list_etag), "%s", fake_response_header(&r, "ETag"));
+	fake_request_init(&r, HTTP_GET, "/");
+	fake_request_add_header(&r, "Accept", "text/html");
+	get_handler(&r.req);
+	snprintf(page_etag, sizeof(page_etag), "%s", fake_response_header(&r, "ETag"));
+
+	printf("Scan list of %d networks, cost per page load (host timings)\n", BENCH_NETWORKS);
+	bench_response("original, chunk per field", legacy_send_scan_list, "/", NULL);
+	bench_response("JSON list, just scanned", send_uncached_list, "/api/networks", NULL);
+	bench_response("JSON list, cached", networks_handler, "/api/networks", NULL);
+	bench_response("JSON list, revalidated", networks_handler, "/api/networks", list_etag);
+	bench_response("selection page, list rendered", get_handler, "/", NULL);
+	bench_response("selection page, revalidated", get_handler, "/", page_etag);
+	teardown();
+}
+
+/* A client socket of the modelled server */
+typedef struct {
+	int owner;             // Client holding it, or -1 if free
+	bool ws;
+	int64_t last_used_us;
+} load_socket_t;
+
+/* A modelled client */
+typedef struct {
+	int64_t start_us;
+	int64_t done_us;       // Time its WebSocket opened, or 0
+	int64_t ready_us;      // Earliest time of its next step
+	int step;              // Requests answered. The last is the WebSocket handshake.
+	int socket;            // Socket it is using, or -1
+	bool waiting;          // Request with the worker
+	bool ws_lost;
+} load_client_t;
+
+/* Outcome of runs of the model */
+typedef struct {
+	int64_t latency_us[LOAD_RUNS * LOAD_MAX_CLIENTS];
+	int completed;
+	int started;
+	int purged;            // Connections closed by LRU purge
+	int ws_lost;           // Clients whose WebSocket was purged, so fell back to polling
+} load_result_t;
+
+/*
+ * @brief Give a client a socket, purging the least recently used if all are taken
+ * @return false if no socket could be had
+ */
+static bool load_connect(load_socket_t *sockets, int socket_count, bool lru, load_client_t *clients, int id,
+		int64_t now, load_result_t *result) {
+	load_socket_t *chosen = NULL;
+
+	for (int i = 0; i < socket_count && chosen == NULL; i++) {
+		if (sockets[i].owner == -1) {
+			chosen = &sockets[i];
+		}
+	}
+	if (chosen == NULL && lru) {
+		for (int i = 0; i < socket_count; i++) {
+			load_socket_t *socket = &sockets[i];
+			bool busy = (socket->owner >= 0 && clients[socket->owner].socket == i && clients[socket->owner].waiting);
+
+			if (!busy && (chosen == NULL || socket->last_used_us < chosen->last_used_us)) {
+				chosen = socket;
+			}
+		}
+		if (chosen != NULL) {
+			load_client_t *victim = &clients[chosen->owner];
+
+			result->purged++;
+			if (victim->socket == chosen - sockets) {
+				victim->socket = -1;
+				victim->ws_lost |= chosen->ws;
+			}
+		}
+	}
+	if (chosen == NULL) {
+		return false;
+	}
+
+	chosen->owner = id;
+	chosen->ws = false;
+	chosen->last_used_us = now;
+	clients[id].socket = chosen - sockets;
+	return true;
+}
+
+/*
+ * @brief Run the model of clients loading the portal against one server configuration,
+ * adding its outcome to a result
+ * @param socket_count Client sockets the server accepts
+ * @param lru LRU purge enabled
+ * @param client_count Clients loading the portal
+ * @param cost_us Worker time of each request
+ */
+static void run_profile_load(int socket_count, bool lru, int client_count,
+		const int64_t cost_us[LOAD_PAGE_REQUESTS + 1], load_result_t *result) {
+	load_socket_t sockets[LOAD_MAX_CLIENTS * 2];
+	load_client_t clients[LOAD_MAX_CLIENTS];
+	int queue[LOAD_MAX_CLIENTS];
+	int queued = 0;
+	int serving = -1;
+	int64_t busy_until_us = 0;
+
+	for (int i = 0; i < socket_count; i++) {
+		sockets[i].owner = -1;
+	}
+	for (int i = 0; i < client_count; i++) {
+		memset(&clients[i], 0, sizeof(load_client_t));
+		clients[i].start_us = (client_count == 1) ? 0 : rand() % LOAD_ARRIVAL_US;
+		clients[i].ready_us = clients[i].start_us;
+		clients[i].socket = -1;
+	}
+
+	for (int64_t now = 0; now < LOAD_DURATION_US; now += LOAD_TICK_US) {
+		// Worker finishes a request
+		if (serving >= 0 && now >= busy_until_us) {
+			load_client_t *client = &clients[serving];
+
+			client->waiting = false;
+			if (client->socket >= 0) {
+				sockets[client->socket].last_used_us = now;
+				if (client->step == LOAD_PAGE_REQUESTS) {
+					sockets[client->socket].ws = true;
+					client->done_us = now;
+				} else if (client->step == LOAD_PAGE_REQUESTS - 1) {
+					// Page connection is left open and idle. The WebSocket needs one of its own.
+					client->socket = -1;
+				}
+				client->step++;
+			}
+			serving = -1;
+		}
+
+		// Clients take their next step
+		for (int i = 0; i < client_count; i++) {
+			load_client_t *client = &clients[i];
+
+			if (client->done_us || client->waiting || now < client->ready_us || now - client->start_us > LOAD_GIVE_UP_US) {
+				continue;
+			}
+			if (client->socket < 0) {
+				client->ready_us = now + (load_connect(sockets, socket_count, lru, clients, i, now, result) ?
+						LOAD_CONNECT_US : LOAD_RETRY_US);
+			} else {
+				sockets[client->socket].last_used_us = now;
+				client->waiting = true;
+				queue[queued++] = i;
+			}
+		}
+
+		// Worker takes the next request. A request whose connection was purged is dropped and resent.
+		while (serving < 0 && queued > 0) {
+			int id = queue[0];
+
+			memmove(&queue[0], &queue[1], --queued * sizeof(int));
+			if (clients[id].socket < 0) {
+				clients[id].waiting = false;
+				continue;
+			}
+			serving = id;
+			busy_until_us = now + cost_us[clients[id].step];
+		}
+	}
+
+	for (int i = 0; i < client_count; i++) {
+		if (clients[i].done_us) {
+			result->latency_us[result->completed++] = clients[i].done_us - clients[i].start_us;
+		}
+		result->ws_lost += clients[i].ws_lost;
+	}
+	result->started += client_count;
+}
+
+/*
+ * @brief Get a percentile of the latencies of a result, in ms
+ */
+static double load_percentile_ms(load_result_t *result, int percent) {
+	if (result->completed == 0) {
+		return 0;
+	}
+	qsort(result->latency_us, result->completed, sizeof(int64_t), compare_int64);
+	return result->latency_us[(result->completed * percent - 1) / 100] / 1000.0;
+}
+
+/*
+ * @brief Model page latency as the number of clients grows, for each server profile
+ */
+static void bench_profiles() {
+	static const char *uris[LOAD_PAGE_REQUESTS] = { "/generate_204", "/network_select.html", "/favicon.ico" };
+	static const int client_counts[] = { 1, 2, 4, 6, 8 };
+	int64_t cost_us[LOAD_PAGE_REQUESTS + 1];
+	fake_request_t r;
+
+	setup();
+	scan_networks(BENCH_NETWORKS);
+	for (int i = 0; i < LOAD_PAGE_REQUESTS; i++) {
+		fake_request_init(&r, HTTP_GET, uris[i]);
+		fake_request_add_header(&r, "Accept", "text/html");
+		get_handler(&r.req);
+		cost_us[i] = LOAD_REQUEST_US + r.writes * LOAD_WRITE_US;
+	}
+	cost_us[LOAD_PAGE_REQUESTS] = LOAD_REQUEST_US + LOAD_WRITE_US;
+	teardown();
+
+	printf("\nPortal load, %d networks listed, %d runs per row (modelled ESP32 costs, page latency to WebSocket open,"
+			" purges and lost WebSockets per run)\n", BENCH_NETWORKS, LOAD_RUNS);
+	// Quoted figures depend on the handlers, so the costs they were modelled with are printed too
+	printf("Worker time per client: probe %.1f ms, page %.1f ms, favicon %.1f ms, WebSocket open %.1f ms\n",
+			cost_us[0] / 1000.0, cost_us[1] / 1000.0, cost_us[2] / 1000.0, cost_us[LOAD_PAGE_REQUESTS] / 1000.0);
+	printf("%-18s %7s %7s %9s %9s %6s %8s %8s\n", "profile", "sockets", "clients", "p50 ms", "p95 ms", "done",
+			"purged", "ws lost");
+	for (int profile = SERVER_PROFILE_LOW_MEMORY; profile <= SERVER_PROFILE_HIGH_CONCURRENCY + 1; profile++) {
+		bool lru = true;
+		int sockets;
+		const char *name;
+
+		// Last row is the balanced profile without LRU purge, as httpd's defaults have it
+		if (profile > SERVER_PROFILE_HIGH_CONCURRENCY) {
+			start_webserver(SERVER_PROFILE_BALANCED);
+			lru = false;
+			name = "balanced, no LRU";
+		} else {
+			start_webserver(profile);
+			lru = fake_httpd_config.lru_purge_enable;
+			name = server_profiles[profile].name;
+		}
+		sockets = fake_httpd_config.max_open_sockets;
+		stop_webserver(server_handle);
+
+		for (int i = 0; i < sizeof(client_counts)/sizeof(client_counts[0]); i++) {
+			static load_result_t result;
+
+			memset(&result, 0, sizeof(result));
+			srand(1);
+			for (int run = 0; run < LOAD_RUNS; run++) {
+				run_profile_load(sockets, lru, client_counts[i], cost_us, &result);
+			}
+			printf("%-18s %7d %7d %9.1f %9.1f %5.0f%% %8.1f %8.1f\n", name, sockets, client_counts[i],
+					load_percentile_ms(&result, 50), load_percentile_ms(&result, 95),
+					100.0 * result.completed / result.started, (double)result.purged / LOAD_RUNS,
+					(double)result.ws_lost / LOAD_RUNS);
+		}
+	}
+}
+
+/*
+ * @brief Every profile fits the socket budget, and keeps LRU purge on
+ */
+static void test_profiles_fit_socket_budget() {
+	fake_httpd_reset();
+	fake_portal_reset();
+
+	CHECK(SERVER_SOCKET_BUDGET > 0);
+	for (int profile = SERVER_PROFILE_LOW_MEMORY; profile <= SERVER_PROFILE_HIGH_CONCURRENCY; profile++) {
+		start_webserver(profile);
+		CHECK(fake_httpd_config.max_open_sockets <= SERVER_SOCKET_BUDGET);
+		CHECK(fake_httpd_config.max_open_sockets >= 1);
+		CHECK(fake_httpd_config.lru_purge_enable);
+		CHECK_EQ(fake_httpd_config.recv_wait_timeout, server_profiles[profile].timeout_s);
+		CHECK(fake_httpd_config.core_id == tskNO_AFFINITY || fake_httpd_config.core_id < portNUM_PROCESSORS);
+		stop_webserver(server_handle);
+	}
+
+	// Enough sockets for every station to hold a WebSocket and load a page
+	start_webserver(SERVER_PROFILE_HIGH_CONCURRENCY);
+	CHECK(fake_httpd_config.max_open_sockets >= MAX_STA_CONN + 1);
+	stop_webserver(server_handle);
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		bench_scan_list();
+		bench_profiles();
+		return 0;
+	}
+
+	RUN_TEST(test_scan_list_sent_in_one_write);
+	RUN_TEST(test_scan_list_not_modified);
+	RUN_TEST(test_scan_list_escapes_ssid);
+	RUN_TEST(test_select_posts_ssid);
+	RUN_TEST(test_gzip_asset_negotiated);
+	RUN_TEST(test_status_wait_capped);
+	RUN_TEST(test_user_informed_after_network_saved);
+	RUN_TEST(test_user_not_informed_without_clients);
+	RUN_TEST(test_profiles_fit_socket_budget);
+
+	return HOST_TEST_RESULT();
+}
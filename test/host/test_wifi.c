@@ -0,0 +1,272 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * INTERNET OF THINGS FIRST BOOT APPLICATION SOFTWARE
+ *
+ * WiFi Host Tests
+ * Disconnect reasons driven through the WiFi event
+ * handler against a fake driver - reconnecting a lost
+ * link with backoff, and the attempts of a connect
+ * under a policy.
+ *
+ * Author:        James Huggard
+ * Last Modified: 17/10/2026
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "host_test.h"
+#include "fakes.h"
+#include "fake_wifi_driver.h"
+#include "disconnect_reasons.h"
+
+/* The fakes stand in for the AP address for the other tests, so the real one is renamed */
+#define get_ap_ip_address wifi_get_ap_ip_address
+
+/* The event handler and relink state are static, so the module is built into the test */
+#include "wifi.c"
+
+/* Policy of the connects under test. Short attempts keep the fake clock runs short. */
+static const connect_policy_t test_policy = {
+		.attempt_timeout_ms = 1000,
+		.total_timeout_ms = 20000,
+		.backoff_base_ms = 500,
+		.backoff_max_ms = 4000,
+		.max_auth_failures = 2
+};
+
+/*
+ * @brief Start WiFi afresh as a station, with the test policy for lost links
+ */
+static void setup() {
+	wifi_manager_deinit();
+	fake_wifi_reset();
+	fake_time_us = 0;
+	set_connect_policy(&test_policy);
+	wifi_manager_set_mode(WIFI_MANAGER_STA);
+}
+
+/*
+ * @brief Bits of the WiFi event group
+ */
+static EventBits_t bits() {
+	return xEventGroupGetBits(s_wifi_event_group);
+}
+
+/*
+ * @brief Bring the station link up, as after a connect
+ */
+static void link_up() {
+	fake_wifi_post_got_ip();
+	fake_wifi_deliver();
+}
+
+/*
+ * @brief Whatever the reason a working link is lost, it is reconnected straight away
+ */
+static void test_lost_link_reconnected_for_every_reason() {
+	for (int i = 0; i < disconnect_reason_count; i++) {
+		uint8_t reason = disconnect_reasons[i].reason;
+		setup();
+		link_up();
+		CHECK(bits() & STA_UP_BIT);
+
+		fake_wifi_post_disconnected(reason);
+		fake_wifi_deliver();
+
+		if (fake_wifi_connects != 1 || !relinking || fake_timer_armed(relink_timer, NULL)) {
+			fprintf(stderr, "reason %d\n", reason);
+		}
+		CHECK_EQ(fake_wifi_connects, 1);
+		CHECK(relinking);
+		CHECK(!fake_timer_armed(relink_timer, NULL));
+		CHECK(!(bits() & STA_UP_BIT));
+		CHECK(bits() & WIFI_FAIL_BIT);
+		CHECK_EQ(get_connection_status(), 0);
+		CHECK_EQ(fake_wifi_app_event, APP_EVENT_STA_DISCONNECTED);
+		CHECK_EQ(fake_wifi_app_event_data, reason);
+	}
+}
+
+/*
+ * @brief Failed reconnects are paced by the policy's backoff, until the link is back
+ */
+static void test_relink_backs_off_until_link_back() {
+	uint32_t backoff_ms = test_policy.backoff_base_ms;
+	uint64_t timeout_us;
+	setup();
+	link_up();
+
+	fake_wifi_post_disconnected(WIFI_REASON_BEACON_TIMEOUT);
+	fake_wifi_deliver();
+	CHECK_EQ(fake_wifi_connects, 1);
+
+	for (int attempt = 2; attempt <= 10; attempt++) {
+		// The reconnect failed too - nothing happens until the backoff has passed
+		fake_wifi_post_disconnected(WIFI_REASON_NO_AP_FOUND);
+		fake_wifi_deliver();
+		CHECK_EQ(fake_wifi_connects, attempt - 1);
+		CHECK(fake_timer_armed(relink_timer, &timeout_us));
+		CHECK(timeout_us >= (uint64_t)backoff_ms * 1000 / 2 && timeout_us <= (uint64_t)backoff_ms * 1000);
+
+		CHECK(fake_timer_fire(relink_timer));
+		CHECK_EQ(fake_wifi_connects, attempt);
+		backoff_ms = (backoff_ms*2 < test_policy.backoff_max_ms) ? backoff_ms*2 : test_policy.backoff_max_ms;
+	}
+
+	// Back - nothing more is tried, and the station is up again
+	link_up();
+	CHECK(!relinking);
+	CHECK(!fake_timer_armed(relink_timer, NULL));
+	CHECK((bits() & (STA_UP_BIT | WIFI_CONNECTED_BIT)) == (STA_UP_BIT | WIFI_CONNECTED_BIT));
+	CHECK_EQ(get_connection_status(), 1);
+	CHECK_EQ(fake_wifi_app_event, APP_EVENT_STA_GOT_IP);
+}
+
+/*
+ * @brief A disconnect with no link to lose, such as the driver giving up, starts nothing
+ */
+static void test_disconnect_without_link_left_alone() {
+	setup();
+
+	fake_wifi_post_disconnected(WIFI_REASON_NO_AP_FOUND);
+	fake_wifi_deliver();
+	CHECK_EQ(fake_wifi_connects, 0);
+	CHECK(!relinking);
+	CHECK(!fake_timer_armed(relink_timer, NULL));
+	CHECK(bits() & WIFI_FAIL_BIT);
+	CHECK(!(bits() & STA_UP_BIT));
+}
+
+/*
+ * @brief Only rejections by the AP end a connect as a wrong password. Every other reason is
+ * retried until the policy's time is up. A connect never starts the relink of a lost link.
+ */
+static void test_connect_gives_up_by_reason() {
+	uint8_t script[FAKE_CONNECT_SCRIPT_SIZE];
+
+	for (int i = 0; i < disconnect_reason_count; i++) {
+		uint8_t reason = disconnect_reasons[i].reason;
+		if (reason == FAKE_CONNECT_GOT_IP) {
+			continue;
+		}
+		setup();
+		memset(script, reason, sizeof(script));
+		fake_wifi_script_connects(script, sizeof(script));
+
+		esp_err_t err = connect_to_ap_directed("floor", "password", NULL, &test_policy);
+
+		if (disconnect_reasons[i].auth_failure) {
+			CHECK_EQ(err, ESP_ERR_WIFI_PASSWORD);
+			CHECK_EQ(fake_wifi_connects, test_policy.max_auth_failures);
+		} else {
+			CHECK_EQ(err, ESP_ERR_TIMEOUT);
+			CHECK(fake_wifi_connects > test_policy.max_auth_failures);
+			CHECK(fake_time_us <= (int64_t)test_policy.total_timeout_ms * 1000);
+		}
+		CHECK(!relinking);
+		CHECK(!fake_timer_armed(relink_timer, NULL));
+		CHECK(!(bits() & STA_UP_BIT));
+	}
+}
+
+/*
+ * @brief A connect keeps going through failures of either kind until one gets through
+ */
+static void test_connect_succeeds_after_failures() {
+	const uint8_t script[] = { WIFI_REASON_NO_AP_FOUND, WIFI_REASON_AUTH_FAIL, FAKE_CONNECT_GOT_IP };
+	setup();
+
+	fake_wifi_script_connects(script, sizeof(script));
+	CHECK_EQ(connect_to_ap_directed("floor", "password", NULL, &test_policy), ESP_OK);
+	CHECK_EQ(fake_wifi_connects, 3);
+	CHECK(bits() & STA_UP_BIT);
+	CHECK(!(bits() & WIFI_FAIL_BIT));
+	CHECK(!relinking);
+
+	// The link made is relinked if it is lost later
+	fake_wifi_post_disconnected(WIFI_REASON_BEACON_TIMEOUT);
+	fake_wifi_deliver();
+	CHECK_EQ(fake_wifi_connects, 4);
+	CHECK(relinking);
+}
+
+/*
+ * @brief A connect made while relinking takes over the station
+ */
+static void test_connect_stops_relink() {
+	const uint8_t script[] = { FAKE_CONNECT_GOT_IP };
+	setup();
+	link_up();
+
+	fake_wifi_post_disconnected(WIFI_REASON_BEACON_TIMEOUT);
+	fake_wifi_post_disconnected(WIFI_REASON_NO_AP_FOUND);
+	fake_wifi_deliver();
+	CHECK(fake_timer_armed(relink_timer, NULL));
+
+	fake_wifi_script_connects(script, sizeof(script));
+	CHECK_EQ(connect_to_ap_directed("cafe", "password", NULL, &test_policy), ESP_OK);
+	CHECK(!relinking);
+	CHECK(!fake_timer_armed(relink_timer, NULL));
+}
+
+/*
+ * @brief A scan only returns once its results are in the store, and says so if they never arrive
+ */
+static void test_scan_returns_once_stored() {
+	wifi_ap_record_t records[] = {
+			fake_ap_record("cafe", 1, -50, 6, WIFI_AUTH_WPA2_PSK),
+			fake_ap_record("library", 2, -70, 11, WIFI_AUTH_OPEN)
+	};
+	setup();
+	fake_wifi_set_scan(records, 2);
+
+	CHECK_EQ(scan_aps(), ESP_OK);
+	CHECK_EQ(scan_store_count(), 2);
+	CHECK(!(bits() & SCAN_MERGED_BIT));
+
+	fake_wifi_scan_lost = true;
+	int64_t start_us = fake_time_us;
+	CHECK_EQ(scan_aps(), ESP_ERR_TIMEOUT);
+	CHECK(fake_time_us - start_us >= SCAN_MERGE_TIMEOUT_MS * 1000LL);
+	scan_store_release();
+}
+
+/* Notifications seen by the test listener */
+static int notifications;
+
+/*
+ * @brief Listener counting the notifications passed to it
+ */
+static void count_notification(wifi_notification_t notification, void *arg) {
+	(void)notification;
+	(*(int *)arg)++;
+}
+
+/*
+ * @brief Once the listener is removed, as before the portal stops, it is not called again
+ */
+static void test_removed_listener_not_called() {
+	setup();
+	notifications = 0;
+	set_wifi_listener(count_notification, &notifications);
+	link_up();
+	int before = notifications;
+	CHECK(before > 0);
+
+	set_wifi_listener(NULL, NULL);
+	fake_wifi_post_disconnected(WIFI_REASON_BEACON_TIMEOUT);
+	fake_wifi_deliver();
+	link_up();
+	CHECK_EQ(notifications, before);
+}
+
+int main() {
+	RUN_TEST(test_lost_link_reconnected_for_every_reason);
+	RUN_TEST(test_relink_backs_off_until_link_back);
+	RUN_TEST(test_disconnect_without_link_left_alone);
+	RUN_TEST(test_connect_gives_up_by_reason);
+	RUN_TEST(test_connect_succeeds_after_failures);
+	RUN_TEST(test_connect_stops_relink);
+	RUN_TEST(test_scan_returns_once_stored);
+	RUN_TEST(test_removed_listener_not_called);
+
+	return HOST_TEST_RESULT();
+}